@@ -32,6 +32,8 @@ static void print_usage(const char* prog) {
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  -p, --port PORT    TCP port to listen on (default: 4000)\n");
     fprintf(stderr, "  -s, --socket PATH  Unix socket path to listen on\n");
+    fprintf(stderr, "  -m, --shm PATH     Same-host driver socket, data via shared memory\n");
+    fprintf(stderr, "  -c, --cache DIR    Keep fonts/images in an on-disk cache\n");
     fprintf(stderr, "  -w, --width WIDTH  Window width (default: 800)\n");
     fprintf(stderr, "  -h, --height H     Window height (default: 600)\n");
     fprintf(stderr, "  --help             Show this help\n");
@@ -40,6 +42,8 @@ static void print_usage(const char* prog) {
 int main(int argc, char** argv) {
     int port = 4000;
     const char* socket_path = NULL;
+    const char* shm_path = NULL;
+    const char* cache_dir = NULL;
     int width = 800;
     int height = 600;
 
@@ -53,6 +57,14 @@ int main(int argc, char** argv) {
             if (i + 1 < argc) {
                 socket_path = argv[++i];
             }
+        } else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--shm") == 0) {
+            if (i + 1 < argc) {
+                shm_path = argv[++i];
+            }
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--cache") == 0) {
+            if (i + 1 < argc) {
+                cache_dir = argv[++i];
+            }
         } else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--width") == 0) {
             if (i + 1 < argc) {
                 width = atoi(argv[++i]);
@@ -78,9 +90,13 @@ int main(int argc, char** argv) {
     scenic_transport_t* transport;
     char address[512];
 
-    if (socket_path) {
+    if (shm_path) {
+        printf("Connecting shared-memory transport via %s...\n", shm_path);
+        transport = scenic_transport_shm_create();
+        snprintf(address, sizeof(address), "%s", shm_path);
+    } else if (socket_path) {
         printf("Creating Unix socket at %s...\n", socket_path);
-        transport = scenic_transport_unix_socket_create();
+        transport = scenic_transport_unix_server_create();
         snprintf(address, sizeof(address), "%s", socket_path);
     } else {
         printf("Creating TCP server on port %d...\n", port);
@@ -94,14 +110,16 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    printf("Waiting for connection...\n");
+    /* Servers return at once; the driver is accepted from the frame loop */
     if (scenic_transport_connect(transport, address) < 0) {
         fprintf(stderr, "Failed to start server/connect\n");
         scenic_transport_destroy(transport);
         scenic_platform_shutdown();
         return 1;
     }
-    printf("Client connected!\n");
+    if (!transport->connected) {
+        printf("Waiting for connection...\n");
+    }
 
     /* Get actual framebuffer size */
     int fb_width, fb_height;
@@ -114,7 +132,12 @@ int main(int argc, char** argv) {
         .height = fb_height,
         .pixel_ratio = ratio,
         .transport = transport,
-        .platform = platform
+        .platform = platform,
+        .recv_budget_us = 4000,  /* Drain bursts for up to 4ms per frame */
+        .event_flush_us = 4000,  /* Batch input events, at most 4ms late */
+        .coalesce_input = true,  /* One CURSOR_POS / SCROLL per batch */
+        .asset_cache_dir = cache_dir,
+        .decode_threads = 2      /* PNG/JPEG decoded off the render thread */
     };
 
     g_renderer = scenic_renderer_create(&config);
@@ -125,9 +148,12 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    /* Send ready event to driver */
-    scenic_renderer_send_ready(g_renderer);
-    scenic_renderer_send_reshape(g_renderer, fb_width, fb_height);
+    /* Client transports are already connected; servers greet the driver
+     * from process_commands once it is accepted */
+    if (transport->connected) {
+        scenic_renderer_send_ready(g_renderer);
+        scenic_renderer_send_reshape(g_renderer, fb_width, fb_height);
+    }
 
     /* Run platform event loop */
     printf("Running... Press ESC to quit\n");
@@ -28,10 +28,20 @@
 #define SCENIC_CMD_PUT_FONT      0x40
 #define SCENIC_CMD_PUT_IMAGE     0x41
 
+/* Asset cache handshake: the PUT_FONT / PUT_IMAGE header with a SHA-256
+ * of the data in place of the data itself. The renderer answers with
+ * ASSET_STATUS; on MISSING the driver sends the normal PUT. */
+#define SCENIC_CMD_PUT_FONT_HASH  0x42  /* name_len data_len hash[32] name */
+#define SCENIC_CMD_PUT_IMAGE_HASH 0x43  /* id_len data_len w h fmt hash[32] id */
+
+/* Replace a w x h rectangle at x, y of an existing image with raw pixels
+ * (fmt 1-4, rows packed); only that rectangle is uploaded */
+#define SCENIC_CMD_PUT_IMAGE_REGION 0x44  /* id_len data_len x y w h fmt id data */
+
 /* Events (renderer -> driver) */
 /* Values from scenic_driver_local (canonical source) */
 #define SCENIC_EVT_RESHAPE       0x05
-#define SCENIC_EVT_READY         0x06
+#define SCENIC_EVT_READY         0x06  /* generation:u64-be */
 #define SCENIC_EVT_TOUCH         0x08
 #define SCENIC_EVT_KEY           0x0A
 #define SCENIC_EVT_CODEPOINT     0x0B
@@ -39,9 +49,10 @@
 #define SCENIC_EVT_MOUSE_BUTTON  0x0D
 #define SCENIC_EVT_SCROLL        0x0E
 #define SCENIC_EVT_CURSOR_ENTER  0x0F
+#define SCENIC_EVT_ASSET_STATUS  0x11  /* status:u8 hash[32] */
 #define SCENIC_EVT_LOG_INFO      0xA0
 #define SCENIC_EVT_LOG_WARN      0xA1
-#define SCENIC_EVT_LOG_ERROR     0xA2
+#define SCENIC_EVT_LOG_ERROR     0xA2  /* message:bytes, e.g. a rejected script */
 
 /* Image formats */
 #define SCENIC_IMG_FMT_ENCODED   0  /* PNG, JPEG, etc. */
@@ -50,6 +61,10 @@
 #define SCENIC_IMG_FMT_RGB       3  /* 3 bytes/pixel */
 #define SCENIC_IMG_FMT_RGBA      4  /* 4 bytes/pixel */
 
+/* ASSET_STATUS values */
+#define SCENIC_ASSET_MISSING     0  /* send the asset with PUT_FONT / PUT_IMAGE */
+#define SCENIC_ASSET_HAVE        1  /* loaded from memory or the on-disk cache */
+
 /* Touch actions */
 #define SCENIC_TOUCH_DOWN        0
 #define SCENIC_TOUCH_UP          1
@@ -25,6 +25,20 @@ typedef struct {
     void (*begin_frame)(void* user_data, int width, int height, float ratio);
     void (*end_frame)(void* user_data);
     void (*swap_buffers)(void* user_data);
+
+    /* Optional partial redraw. buffer_age returns how many frames old the
+     * back buffer's contents are when drawing starts (0: undefined). With
+     * both set, frames that only need part of the window call begin_region
+     * instead of begin_frame; it must clear just x, y, w, h (top-left
+     * origin, in the units of width and height) and keep the rest. Frames
+     * with nothing to redraw call neither and should not be presented. */
+    int (*buffer_age)(void* user_data);
+    void (*begin_region)(void* user_data, int width, int height, float ratio,
+                         int x, int y, int w, int h);
+
+    /* Optional, called from decode threads when an image is ready, to end
+     * an idle wait so process_commands runs and picks it up */
+    void (*wake)(void* user_data);
 } scenic_platform_t;
 
 /* Configuration */
@@ -34,8 +48,61 @@ typedef struct {
     float pixel_ratio;
     scenic_transport_t* transport;      /* NULL for manual command mode */
     scenic_platform_t platform;
+    uint32_t recv_budget_us;            /* 0: one read per process_commands call */
+    uint32_t event_flush_us;            /* 0: send each event at once */
+    bool coalesce_input;                /* merge CURSOR_POS / SCROLL bursts */
+    const char* asset_cache_dir;        /* on-disk font/image cache, NULL: off */
+    int decode_threads;                 /* PNG/JPEG decode workers, 0: decode inline */
+    bool retain_image_pixels;           /* keep CPU copies to survive GL context loss */
 } scenic_renderer_config_t;
 
+/* Renderer statistics */
+typedef struct {
+    /* Most recent scenic_renderer_process_commands call */
+    uint32_t bytes_received;
+    uint32_t commands_processed;
+    uint32_t reads;
+    uint32_t elapsed_us;
+    bool budget_exhausted;              /* stopped by the budget, not an empty transport */
+
+    /* Most recent frame */
+    uint32_t scripts_drawn;
+    uint32_t scripts_culled;            /* off screen or outside the scissor */
+    uint32_t ops_drawn;                 /* shapes and sprites */
+    uint32_t ops_culled;
+    uint32_t shapes_reused;             /* fills and strokes drawn from cached tessellation */
+    uint32_t texts_reused;              /* text drawn from cached row layouts */
+    uint32_t pixels_redrawn;            /* area of the redrawn region, 0 if skipped */
+
+    /* Outbound events, cumulative */
+    uint64_t events_queued;
+    uint64_t events_dropped;            /* queue full, driver not reading */
+    uint64_t events_coalesced;          /* CURSOR_POS / SCROLL merged away */
+    uint64_t event_flushes;             /* send calls issued */
+    uint64_t bytes_sent;
+
+    /* PUT_FONT_HASH / PUT_IMAGE_HASH answers, cumulative */
+    uint64_t assets_have;
+    uint64_t assets_missing;
+
+    /* Images decoded off the GL thread and uploaded, cumulative */
+    uint64_t images_decoded;
+
+    /* CPU copies kept of uploaded images (retain_image_pixels), now */
+    uint64_t image_bytes_retained;
+
+    /* PUT_SCRIPTs that failed verification, cumulative */
+    uint64_t scripts_rejected;
+
+    /* RENDERs that arrived with a frame already owed, cumulative */
+    uint64_t renders_coalesced;
+
+    /* Script puts compiled over the version they replace, and mallocs the
+     * script store has made, cumulative */
+    uint64_t scripts_replaced_in_place;
+    uint64_t script_allocs;
+} scenic_renderer_stats_t;
+
 /*
  * Lifecycle functions
  */
@@ -53,9 +120,16 @@ void scenic_renderer_resize(scenic_renderer_t* r, int w, int h, float ratio);
  * Command processing
  */
 
-/* Process commands from transport (returns commands processed, -1 on error) */
+/* Process commands from transport (returns commands processed, -1 on error)
+ * With a receive budget set, keeps reading and dispatching until the
+ * transport has nothing more or the budget is spent. When a server
+ * transport accepts a driver, READY and RESHAPE are sent automatically;
+ * when its driver goes away, the scene is kept and 0 is returned. */
 int scenic_renderer_process_commands(scenic_renderer_t* r, int timeout_ms);
 
+/* Set the per-call receive budget in microseconds (0 = single read) */
+void scenic_renderer_set_recv_budget(scenic_renderer_t* r, uint32_t budget_us);
+
 /*
  * Manual command interface (when transport is NULL)
  * These functions process command data directly.
@@ -79,6 +153,15 @@ void scenic_renderer_cmd_put_font(scenic_renderer_t* r, const uint8_t* data, uin
 /* Load an image */
 void scenic_renderer_cmd_put_image(scenic_renderer_t* r, const uint8_t* data, uint32_t len);
 
+/* Replace a rectangle of a loaded image */
+void scenic_renderer_cmd_put_image_region(scenic_renderer_t* r, const uint8_t* data, uint32_t len);
+
+/* Load a font / image named by content hash from memory or the asset
+ * cache. Returns SCENIC_ASSET_HAVE, SCENIC_ASSET_MISSING (then send the
+ * normal PUT, which is cached for next time) or -1 if malformed. */
+int scenic_renderer_cmd_put_font_hash(scenic_renderer_t* r, const uint8_t* data, uint32_t len);
+int scenic_renderer_cmd_put_image_hash(scenic_renderer_t* r, const uint8_t* data, uint32_t len);
+
 /* Set global transform */
 void scenic_renderer_cmd_global_tx(scenic_renderer_t* r, const float tx[6]);
 
@@ -89,13 +172,38 @@ void scenic_renderer_cmd_global_tx(scenic_renderer_t* r, const float tx[6]);
 /* Render current scene */
 void scenic_renderer_render(scenic_renderer_t* r);
 
+/* Whether a frame is owed: a RENDER command arrived, the size or context
+ * changed, or a decoded image was uploaded, since the last
+ * scenic_renderer_render. RENDER does not
+ * draw by itself; platform loops render when this is set and otherwise
+ * sleep. */
+bool scenic_renderer_needs_render(const scenic_renderer_t* r);
+
+/* Owe a frame, e.g. for a platform event the renderer cannot see */
+void scenic_renderer_request_render(scenic_renderer_t* r);
+
 /*
  * Event sending (only when transport configured)
+ *
+ * Events are queued and written in one batch by the next
+ * scenic_renderer_flush_events or process_commands call, or sooner once
+ * the oldest queued event is event_flush_us old.
  */
 
-/* Send ready event */
+/* Send all queued events that the transport will take without blocking */
+void scenic_renderer_flush_events(scenic_renderer_t* r);
+
+/* Keep only the latest CURSOR_POS and sum SCROLL deltas between flushes.
+ * KEY, MOUSE_BUTTON, CODEPOINT etc. keep their order relative to them. */
+void scenic_renderer_set_input_coalescing(scenic_renderer_t* r, bool enabled);
+
+/* Send ready event, carrying the current scene generation */
 void scenic_renderer_send_ready(scenic_renderer_t* r);
 
+/* Scene generation token. A driver that sees the same value in READY as
+ * before a reconnect may skip re-sending scripts, fonts and images. */
+uint64_t scenic_renderer_get_generation(const scenic_renderer_t* r);
+
 /* Send reshape event */
 void scenic_renderer_send_reshape(scenic_renderer_t* r, int width, int height);
 
@@ -129,9 +237,15 @@ void scenic_renderer_send_cursor_enter(scenic_renderer_t* r, bool entered);
 /* Get NanoVG context (for advanced use) */
 void* scenic_renderer_get_nvg_context(scenic_renderer_t* r);
 
+/* Get the transport commands are read from, NULL in manual mode */
+scenic_transport_t* scenic_renderer_get_transport(scenic_renderer_t* r);
+
 /* Get current dimensions */
 void scenic_renderer_get_size(scenic_renderer_t* r, int* width, int* height, float* ratio);
 
+/* Get statistics */
+void scenic_renderer_get_stats(scenic_renderer_t* r, scenic_renderer_stats_t* stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,11 +21,19 @@ typedef struct scenic_transport scenic_transport_t;
 typedef struct {
     int (*connect)(scenic_transport_t* t, const char* address);
     void (*disconnect)(scenic_transport_t* t);
+    /* Returns bytes accepted (may be short, 0 if it would block), -1 on error */
     int (*send)(scenic_transport_t* t, const void* data, size_t len);
+    /* Returns bytes read, 0 if nothing is pending, -1 on error or disconnect.
+     * Clearing `connected` on disconnect means a new driver may follow. */
     int (*recv)(scenic_transport_t* t, void* buf, size_t max_len, int timeout_ms);
     bool (*data_available)(scenic_transport_t* t, int timeout_ms);
     int (*get_fd)(scenic_transport_t* t);  /* -1 if not supported */
     void (*destroy)(scenic_transport_t* t);
+    void (*wake)(scenic_transport_t* t);   /* optional, may be NULL */
+    /* Optional, server transports: wait for a client or a wake without
+     * accepting it, so another thread may wait while the owner sends.
+     * True once a client is pending; data_available then accepts it. */
+    bool (*wait_client)(scenic_transport_t* t, int timeout_ms);
 } scenic_transport_ops_t;
 
 /* Base transport structure */
@@ -38,17 +46,35 @@ struct scenic_transport {
 /* Factory functions for built-in transports */
 scenic_transport_t* scenic_transport_unix_socket_create(void);
 scenic_transport_t* scenic_transport_tcp_create(void);
+
+/* Server transports: connect() only binds and listens. The driver is
+ * accepted later, without blocking, from recv/data_available, which
+ * flips `connected`; after a disconnect they listen again. */
+scenic_transport_t* scenic_transport_unix_server_create(void);
 scenic_transport_t* scenic_transport_tcp_server_create(void);
 
+/* Same-host driver: connects to a unix socket, then hands the driver a
+ * memfd with a pair of SPSC rings and moves all data through it.
+ * Linux only; connect fails elsewhere. */
+scenic_transport_t* scenic_transport_shm_create(void);
+
 /* Convenience macros */
 #define scenic_transport_connect(t, addr)    ((t)->ops->connect((t), (addr)))
 #define scenic_transport_disconnect(t)       ((t)->ops->disconnect((t)))
 #define scenic_transport_send(t, d, l)       ((t)->ops->send((t), (d), (l)))
 #define scenic_transport_recv(t, b, m, to)   ((t)->ops->recv((t), (b), (m), (to)))
 #define scenic_transport_data_available(t, to) ((t)->ops->data_available((t), (to)))
+#define scenic_transport_wait_client(t, to)  ((t)->ops->wait_client((t), (to)))
 #define scenic_transport_get_fd(t)           ((t)->ops->get_fd((t)))
 #define scenic_transport_destroy(t)          ((t)->ops->destroy((t)))
 
+/* Interrupt a data_available or wait_client wait in progress on another
+ * thread. The built-in transports also allow send while such a wait is in
+ * progress, except data_available on a server transport with no client
+ * yet: it accepts and sets the fd and connected, so wait on it from
+ * another thread with wait_client until connected. */
+void scenic_transport_wake(scenic_transport_t* t);
+
 #ifdef __cplusplus
 }
 #endif
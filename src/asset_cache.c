@@ -0,0 +1,223 @@
+/*
+ * Content-addressed on-disk asset cache
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "asset_cache.h"
+#include "comms.h"
+
+/* Hashes announced but not yet followed by their PUT; oldest is reused */
+#define EXPECTED_SLOTS 64
+
+typedef struct {
+    asset_kind_t kind;
+    void* p_id;
+    uint32_t id_size;
+    uint8_t hash[SHA256_SIZE];
+} expected_t;
+
+static char g_dir[384] = {0};
+
+/* <dir>/<64 hex digits>; asset_writer_t::tmp_path leaves room for a suffix */
+#define ENTRY_PATH_MAX (384 + 1 + SHA256_SIZE * 2 + 1)
+static expected_t g_expected[EXPECTED_SLOTS];
+static uint32_t g_expected_next = 0;
+
+static void entry_path(char* p_path, size_t len, const uint8_t hash[SHA256_SIZE]) {
+    static const char hex[] = "0123456789abcdef";
+    char name[SHA256_SIZE * 2 + 1];
+    for (int i = 0; i < SHA256_SIZE; i++) {
+        name[i * 2] = hex[hash[i] >> 4];
+        name[i * 2 + 1] = hex[hash[i] & 0xf];
+    }
+    name[SHA256_SIZE * 2] = '\0';
+    snprintf(p_path, len, "%s/%s", g_dir, name);
+}
+
+/* mkdir -p */
+static bool make_dirs(const char* dir) {
+    char path[sizeof(g_dir)];
+    snprintf(path, sizeof(path), "%s", dir);
+    for (char* p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(path, 0755) < 0 && errno != EEXIST) return false;
+        *p = '/';
+    }
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+bool asset_cache_init(const char* dir) {
+    asset_cache_done();
+    if (!dir || !*dir) return false;
+    if (strlen(dir) >= sizeof(g_dir) || !make_dirs(dir)) {
+        log_warn("Unable to create asset cache directory");
+        return false;
+    }
+    snprintf(g_dir, sizeof(g_dir), "%s", dir);
+    return true;
+}
+
+void asset_cache_done(void) {
+    g_dir[0] = '\0';
+    for (int i = 0; i < EXPECTED_SLOTS; i++) {
+        free(g_expected[i].p_id);
+    }
+    memset(g_expected, 0, sizeof(g_expected));
+    g_expected_next = 0;
+}
+
+bool asset_cache_enabled(void) {
+    return g_dir[0] != '\0';
+}
+
+bool asset_cache_map(const uint8_t hash[SHA256_SIZE], asset_map_t* p_map) {
+    p_map->p_data = NULL;
+    p_map->size = 0;
+    if (!asset_cache_enabled()) return false;
+
+    char path[ENTRY_PATH_MAX];
+    entry_path(path, sizeof(path), hash);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    /* The mapping outlives the descriptor */
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+
+    p_map->p_data = p;
+    p_map->size = (size_t)st.st_size;
+    return true;
+}
+
+void asset_cache_unmap(asset_map_t* p_map) {
+    if (p_map->p_data) {
+        munmap((void*)p_map->p_data, p_map->size);
+    }
+    p_map->p_data = NULL;
+    p_map->size = 0;
+}
+
+bool asset_writer_begin(asset_writer_t* p_writer, const uint8_t hash[SHA256_SIZE]) {
+    memset(p_writer, 0, sizeof(*p_writer));
+    p_writer->fd = -1;
+    if (!asset_cache_enabled()) return false;
+
+    memcpy(p_writer->hash, hash, SHA256_SIZE);
+    sha256_init(&p_writer->sha);
+
+    char path[ENTRY_PATH_MAX];
+    entry_path(path, sizeof(path), hash);
+    snprintf(p_writer->tmp_path, sizeof(p_writer->tmp_path), "%s.%d.tmp",
+             path, (int)getpid());
+    p_writer->fd = open(p_writer->tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    return p_writer->fd >= 0;
+}
+
+void asset_writer_write(asset_writer_t* p_writer, const void* p_data, size_t size) {
+    if (p_writer->fd < 0 || p_writer->failed) return;
+    sha256_update(&p_writer->sha, p_data, size);
+
+    const uint8_t* p = p_data;
+    while (size > 0) {
+        ssize_t n = write(p_writer->fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            p_writer->failed = true;
+            return;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+}
+
+bool asset_writer_commit(asset_writer_t* p_writer) {
+    if (p_writer->fd < 0) return false;
+
+    uint8_t digest[SHA256_SIZE];
+    sha256_final(&p_writer->sha, digest);
+    bool ok = !p_writer->failed && memcmp(digest, p_writer->hash, SHA256_SIZE) == 0;
+    if (!ok && !p_writer->failed) {
+        log_warn("Asset does not match its announced hash; not cached");
+    }
+
+    close(p_writer->fd);
+    p_writer->fd = -1;
+    if (ok) {
+        char path[ENTRY_PATH_MAX];
+        entry_path(path, sizeof(path), p_writer->hash);
+        ok = rename(p_writer->tmp_path, path) == 0;
+    }
+    if (!ok) {
+        unlink(p_writer->tmp_path);
+    }
+    return ok;
+}
+
+void asset_writer_abort(asset_writer_t* p_writer) {
+    if (p_writer->fd < 0) return;
+    close(p_writer->fd);
+    p_writer->fd = -1;
+    unlink(p_writer->tmp_path);
+}
+
+bool asset_cache_store(const uint8_t hash[SHA256_SIZE], const void* p_data, size_t size) {
+    asset_writer_t writer;
+    if (!asset_writer_begin(&writer, hash)) return false;
+    asset_writer_write(&writer, p_data, size);
+    return asset_writer_commit(&writer);
+}
+
+static expected_t* find_expected(asset_kind_t kind, sid_t id) {
+    for (int i = 0; i < EXPECTED_SLOTS; i++) {
+        expected_t* p = &g_expected[i];
+        if (p->p_id && p->kind == kind && p->id_size == id.size &&
+            memcmp(p->p_id, id.p_data, id.size) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void asset_cache_expect(asset_kind_t kind, sid_t id, const uint8_t hash[SHA256_SIZE]) {
+    if (!asset_cache_enabled()) return;
+
+    expected_t* p = find_expected(kind, id);
+    if (!p) {
+        p = &g_expected[g_expected_next];
+        g_expected_next = (g_expected_next + 1) % EXPECTED_SLOTS;
+        free(p->p_id);
+        p->p_id = malloc(id.size ? id.size : 1);
+        if (!p->p_id) return;
+        memcpy(p->p_id, id.p_data, id.size);
+        p->id_size = id.size;
+        p->kind = kind;
+    }
+    memcpy(p->hash, hash, SHA256_SIZE);
+}
+
+bool asset_cache_take_expected(asset_kind_t kind, sid_t id, uint8_t hash[SHA256_SIZE]) {
+    if (!asset_cache_enabled()) return false;
+
+    expected_t* p = find_expected(kind, id);
+    if (!p) return false;
+    memcpy(hash, p->hash, SHA256_SIZE);
+    free(p->p_id);
+    p->p_id = NULL;
+    return true;
+}
@@ -0,0 +1,64 @@
+/*
+ * Content-addressed on-disk asset cache
+ *
+ * Font and image payloads are stored under <dir>/<sha256 hex> exactly as
+ * they crossed the wire, and mapped read-only when a driver later names
+ * them by hash. Entries are written to a temporary file and renamed into
+ * place only once their digest checks out, so a crash or a lying driver
+ * never leaves a bad entry behind.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "sha256.h"
+
+typedef enum {
+    ASSET_FONT = 0,
+    ASSET_IMAGE = 1
+} asset_kind_t;
+
+/* Answers to PUT_FONT_HASH / PUT_IMAGE_HASH */
+#define ASSET_MISSING 0
+#define ASSET_HAVE    1
+
+typedef struct {
+    const void* p_data;
+    size_t size;
+} asset_map_t;
+
+typedef struct {
+    int fd;
+    bool failed;
+    sha256_ctx_t sha;
+    uint8_t hash[SHA256_SIZE];
+    char tmp_path[512];
+} asset_writer_t;
+
+/* Create the cache directory if needed; NULL leaves the cache disabled */
+bool asset_cache_init(const char* dir);
+void asset_cache_done(void);
+bool asset_cache_enabled(void);
+
+/* Map the entry for hash read-only */
+bool asset_cache_map(const uint8_t hash[SHA256_SIZE], asset_map_t* p_map);
+void asset_cache_unmap(asset_map_t* p_map);
+
+/* Store a complete payload (digest verified first) */
+bool asset_cache_store(const uint8_t hash[SHA256_SIZE], const void* p_data, size_t size);
+
+/* Incremental store for payloads that arrive in pieces */
+bool asset_writer_begin(asset_writer_t* p_writer, const uint8_t hash[SHA256_SIZE]);
+void asset_writer_write(asset_writer_t* p_writer, const void* p_data, size_t size);
+bool asset_writer_commit(asset_writer_t* p_writer);
+void asset_writer_abort(asset_writer_t* p_writer);
+
+/* The driver was told hash is missing for (kind, id); its PUT follows */
+void asset_cache_expect(asset_kind_t kind, sid_t id, const uint8_t hash[SHA256_SIZE]);
+
+/* Take the hash announced for (kind, id), if any */
+bool asset_cache_take_expected(asset_kind_t kind, sid_t id, uint8_t hash[SHA256_SIZE]);
@@ -6,6 +6,16 @@
 #include <stdio.h>
 #include "comms.h"
 
+#if __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#endif
+
 static const unsigned char* g_stream_ptr = NULL;
 static int g_stream_remaining = 0;
 
@@ -29,6 +39,58 @@ bool read_bytes_down(void* p_buff, int bytes_to_read, int* p_bytes_remaining) {
     return true;
 }
 
+const void* read_bytes_ptr(int bytes_to_read, int* p_bytes_remaining) {
+    if (bytes_to_read < 0 || g_stream_ptr == NULL || g_stream_remaining < bytes_to_read) {
+        return NULL;
+    }
+
+    const void* p = g_stream_ptr;
+    g_stream_ptr += bytes_to_read;
+    g_stream_remaining -= bytes_to_read;
+    if (p_bytes_remaining) {
+        *p_bytes_remaining -= bytes_to_read;
+    }
+    return p;
+}
+
+void ntoh_ui32_array(uint32_t* p_dst, const void* p_src, size_t count) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    memcpy(p_dst, p_src, count * sizeof(uint32_t));
+#else
+    const uint8_t* p = p_src;
+    size_t i = 0;
+
+#if defined(__SSSE3__)
+    const __m128i shuffle = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+                                         4, 5, 6, 7, 0, 1, 2, 3);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i * 4));
+        _mm_storeu_si128((__m128i*)(p_dst + i), _mm_shuffle_epi8(v, shuffle));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i * 4));
+        /* Swap bytes within 16-bit lanes, then the lanes within each word */
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i*)(p_dst + i), v);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+        uint8x16_t v = vld1q_u8(p + i * 4);
+        vst1q_u8((uint8_t*)(p_dst + i), vrev32q_u8(v));
+    }
+#endif
+
+    for (; i < count; i++) {
+        uint32_t v;
+        memcpy(&v, p + i * 4, sizeof(v));
+        p_dst[i] = ntoh_ui32(v);
+    }
+#endif
+}
+
 /* Default logging implementation - can be overridden by platform */
 __attribute__((weak))
 void send_puts(const char* msg) {
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -39,9 +40,15 @@
   #define hton_f32(x) (ntoh_f32(x))
 #endif
 
+/* Bulk big-endian to native conversion of count 32-bit words; p_src may
+ * be unaligned. Uses SSE2/SSSE3 or NEON where available. */
+void ntoh_ui32_array(uint32_t* p_dst, const void* p_src, size_t count);
+
 /* Buffer management for reading command data */
 void comms_set_buffer(const void* data, int len);
 bool read_bytes_down(void* p_buff, int bytes_to_read, int* p_bytes_remaining);
+/* Zero-copy read: returns a pointer into the buffer, NULL if too short */
+const void* read_bytes_ptr(int bytes_to_read, int* p_bytes_remaining);
 
 /* Logging functions */
 void send_puts(const char* msg);
@@ -0,0 +1,147 @@
+/*
+ * Image decode pool
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "decode_pool.h"
+#include "nanovg/stb_image.h"
+
+#define DECODE_THREADS_MAX 8
+
+static struct {
+    pthread_t threads[DECODE_THREADS_MAX];
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_cond_t done_cond;   /* a job finished */
+    decode_job_t* p_queue;      /* waiting for a worker, oldest first */
+    decode_job_t* p_done;       /* decoded, oldest first */
+    uint32_t jobs;              /* queued or being decoded */
+    bool quit;
+    void (*wake)(void* p_arg);
+    void* p_wake_arg;
+} g_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER
+};
+
+static void append(decode_job_t** pp_list, decode_job_t* p_job) {
+    p_job->p_next = NULL;
+    while (*pp_list) pp_list = &(*pp_list)->p_next;
+    *pp_list = p_job;
+}
+
+static void* worker_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_pool.lock);
+    for (;;) {
+        while (!g_pool.p_queue && !g_pool.quit) {
+            pthread_cond_wait(&g_pool.cond, &g_pool.lock);
+        }
+        if (g_pool.quit) break;
+
+        decode_job_t* p_job = g_pool.p_queue;
+        g_pool.p_queue = p_job->p_next;
+        pthread_mutex_unlock(&g_pool.lock);
+
+        int comp;
+        p_job->p_pixels = stbi_load_from_memory(p_job->p_encoded, (int)p_job->encoded_size,
+                                                &p_job->width, &p_job->height, &comp, 4);
+        free(p_job->p_encoded);
+        p_job->p_encoded = NULL;
+
+        pthread_mutex_lock(&g_pool.lock);
+        g_pool.jobs--;
+        append(&g_pool.p_done, p_job);
+        pthread_cond_broadcast(&g_pool.done_cond);
+        if (g_pool.wake) g_pool.wake(g_pool.p_wake_arg);
+    }
+    pthread_mutex_unlock(&g_pool.lock);
+    return NULL;
+}
+
+bool decode_pool_start(int threads, void (*wake)(void* p_arg), void* p_arg) {
+    if (g_pool.thread_count > 0) return true;
+    if (threads > DECODE_THREADS_MAX) threads = DECODE_THREADS_MAX;
+
+    g_pool.quit = false;
+    g_pool.wake = wake;
+    g_pool.p_wake_arg = p_arg;
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&g_pool.threads[i], NULL, worker_main, NULL) != 0) break;
+        g_pool.thread_count++;
+    }
+    return g_pool.thread_count > 0;
+}
+
+static void free_list(decode_job_t* p_job) {
+    while (p_job) {
+        decode_job_t* p_next = p_job->p_next;
+        decode_job_free(p_job);
+        p_job = p_next;
+    }
+}
+
+void decode_pool_stop(void) {
+    pthread_mutex_lock(&g_pool.lock);
+    g_pool.quit = true;
+    pthread_cond_broadcast(&g_pool.cond);
+    pthread_mutex_unlock(&g_pool.lock);
+    for (int i = 0; i < g_pool.thread_count; i++) {
+        pthread_join(g_pool.threads[i], NULL);
+    }
+    g_pool.thread_count = 0;
+
+    free_list(g_pool.p_queue);
+    free_list(g_pool.p_done);
+    g_pool.p_queue = NULL;
+    g_pool.p_done = NULL;
+    g_pool.jobs = 0;
+    g_pool.wake = NULL;
+}
+
+bool decode_pool_running(void) {
+    return g_pool.thread_count > 0;
+}
+
+bool decode_pool_submit(decode_job_t* p_job) {
+    if (g_pool.thread_count == 0) return false;
+    pthread_mutex_lock(&g_pool.lock);
+    bool queued = g_pool.jobs < DECODE_QUEUE_MAX;
+    if (queued) {
+        g_pool.jobs++;
+        append(&g_pool.p_queue, p_job);
+        pthread_cond_signal(&g_pool.cond);
+    }
+    pthread_mutex_unlock(&g_pool.lock);
+    return queued;
+}
+
+decode_job_t* decode_pool_take_done(void) {
+    pthread_mutex_lock(&g_pool.lock);
+    decode_job_t* p_job = g_pool.p_done;
+    if (p_job) g_pool.p_done = p_job->p_next;
+    pthread_mutex_unlock(&g_pool.lock);
+    return p_job;
+}
+
+decode_job_t* decode_pool_wait_done(void) {
+    pthread_mutex_lock(&g_pool.lock);
+    while (!g_pool.p_done && g_pool.jobs > 0) {
+        pthread_cond_wait(&g_pool.done_cond, &g_pool.lock);
+    }
+    decode_job_t* p_job = g_pool.p_done;
+    if (p_job) g_pool.p_done = p_job->p_next;
+    pthread_mutex_unlock(&g_pool.lock);
+    return p_job;
+}
+
+void decode_job_free(decode_job_t* p_job) {
+    if (!p_job) return;
+    free(p_job->p_encoded);
+    stbi_image_free(p_job->p_pixels);
+    free(p_job);
+}
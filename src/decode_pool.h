@@ -0,0 +1,49 @@
+/*
+ * Image decode pool
+ *
+ * Encoded (PNG, JPEG, ...) images are decoded by a fixed set of worker
+ * threads instead of on the thread that owns the GL context. Jobs go in
+ * with their encoded bytes and come back, in completion order, with RGBA
+ * pixels for the GL thread to upload. The queue is bounded: when it is
+ * full, or no pool is running, callers decode inline as before.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DECODE_QUEUE_MAX 32     /* jobs queued or being decoded */
+
+typedef struct _decode_job_t {
+    struct _decode_job_t* p_next;
+    uint32_t handle;            /* image the pixels are for */
+    uint32_t seq;               /* the image's put count when queued */
+    uint8_t* p_encoded;         /* freed once decoded */
+    uint32_t encoded_size;
+    uint8_t* p_pixels;          /* RGBA, NULL if decoding failed */
+    int width;
+    int height;
+} decode_job_t;
+
+/* Starts threads workers. wake, if set, is called from a worker each time
+ * a job finishes, e.g. to end the GL thread's idle wait. */
+bool decode_pool_start(int threads, void (*wake)(void* p_arg), void* p_arg);
+
+/* Joins the workers and frees every job not yet taken */
+void decode_pool_stop(void);
+
+bool decode_pool_running(void);
+
+/* Queues a job, taking ownership; false if no pool is running or the
+ * queue is full, and the caller keeps the job */
+bool decode_pool_submit(decode_job_t* p_job);
+
+/* Finished jobs, oldest first, or NULL; free each with decode_job_free */
+decode_job_t* decode_pool_take_done(void);
+
+/* As decode_pool_take_done, but waits for a job still being decoded;
+ * NULL once none are left */
+decode_job_t* decode_pool_wait_done(void);
+
+void decode_job_free(decode_job_t* p_job);
@@ -12,39 +12,25 @@
 #include "utils.h"
 #include "comms.h"
 #include "font.h"
-
-#define HASH_ID(id) tommy_hash_u32(0, id.p_data, id.size)
+#include "asset_cache.h"
+#include "intern.h"
 
 typedef struct _font_t {
     int nvg_id;
     sid_t id;
     data_t blob;
-    tommy_hashlin_node node;
+    asset_map_t map;    /* blob lives in a cache mapping, not after the struct */
 } font_t;
 
-static tommy_hashlin fonts = {0};
-
-void init_fonts(void) {
-    tommy_hashlin_init(&fonts);
-}
-
-static int _comparator(const void* p_arg, const void* p_obj) {
-    const sid_t* p_id = p_arg;
-    const font_t* p_font = p_obj;
-    return (p_id->size != p_font->id.size)
-        || memcmp(p_id->p_data, p_font->id.p_data, p_id->size);
-}
+static id_table_t fonts = {0};
 
 static font_t* get_font_entry(sid_t id) {
-    return tommy_hashlin_search(
-        &fonts,
-        _comparator,
-        &id,
-        HASH_ID(id)
-    );
+    return id_table_get(&fonts, find_id(id));
 }
 
-void put_font(int* p_msg_length, NVGcontext* p_ctx) {
+/* p_hash is NULL for PUT_FONT; PUT_FONT_HASH carries it before the id,
+ * and no blob follows, so none is allocated */
+static font_t* alloc_font_hdr(int* p_msg_length, uint8_t* p_hash) {
     uint32_t id_length;
     read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
     id_length = ntoh_ui32(id_length);
@@ -53,57 +39,149 @@ void put_font(int* p_msg_length, NVGcontext* p_ctx) {
     read_bytes_down(&blob_size, sizeof(uint32_t), p_msg_length);
     blob_size = ntoh_ui32(blob_size);
 
+    if (p_hash) {
+        if (!read_bytes_down(p_hash, SHA256_SIZE, p_msg_length)) return NULL;
+    }
+    if (id_length > (uint32_t)*p_msg_length) {
+        send_puts("Truncated font id");
+        return NULL;
+    }
+
     int struct_size = ALIGN_UP(sizeof(font_t), 8);
     int id_size = ALIGN_UP(id_length + 1, 8);  /* +1 for null terminator */
-    int alloc_size = struct_size + id_size + blob_size;
+    size_t alloc_size = (size_t)struct_size + id_size + (p_hash ? 0 : blob_size);
     font_t* p_font = calloc(1, alloc_size);
     if (!p_font) {
         send_puts("Unable to allocate font");
-        return;
+        return NULL;
     }
 
     p_font->id.size = id_length;
     p_font->id.p_data = ((void*)p_font) + struct_size;
-    read_bytes_down(p_font->id.p_data, id_length, p_msg_length);
+    if (!read_bytes_down(p_font->id.p_data, id_length, p_msg_length)) {
+        free(p_font);
+        return NULL;
+    }
 
     p_font->blob.size = blob_size;
-    p_font->blob.p_data = ((void*)p_font) + struct_size + id_size;
-    read_bytes_down(p_font->blob.p_data, blob_size, p_msg_length);
+    p_font->blob.p_data = p_hash ? NULL : ((void*)p_font) + struct_size + id_size;
+    return p_font;
+}
+
+static font_t* alloc_font(int* p_msg_length) {
+    font_t* p_font = alloc_font_hdr(p_msg_length, NULL);
 
     /* Check if font already exists */
-    if (get_font_entry(p_font->id)) {
+    if (p_font && get_font_entry(p_font->id)) {
         free(p_font);
-        return;
+        return NULL;
+    }
+    return p_font;
+}
+
+static void font_free(void* p_obj) {
+    font_t* p_font = p_obj;
+    asset_cache_unmap(&p_font->map);
+    free(p_font);
+}
+
+static void font_free_arg(void* p_obj, void* p_arg) {
+    (void)p_arg;
+    font_free(p_obj);
+}
+
+/* Keep a copy of a blob the driver announced by hash for next time */
+static void cache_font_blob(font_t* p_font) {
+    uint8_t hash[SHA256_SIZE];
+    if (asset_cache_take_expected(ASSET_FONT, p_font->id, hash)) {
+        asset_cache_store(hash, p_font->blob.p_data, p_font->blob.size);
+    }
+}
+
+static bool store_font(font_t* p_font, NVGcontext* p_ctx) {
+    uint32_t handle = intern_id(p_font->id);
+    if (!id_table_set(&fonts, handle, p_font)) {
+        release_id(handle);
+        send_puts("Unable to allocate font table");
+        font_free(p_font);
+        return false;
     }
 
     /* Create NanoVG font */
     p_font->nvg_id = nvgCreateFontMem(
-        p_ctx, p_font->id.p_data, p_font->blob.p_data, blob_size,
+        p_ctx, p_font->id.p_data, p_font->blob.p_data, p_font->blob.size,
         false  /* Don't free blob data when releasing font */
     );
     if (p_font->nvg_id < 0) {
         send_puts("Unable to create NanoVG font");
-        free(p_font);
-        return;
+        id_table_set(&fonts, handle, NULL);
+        font_free(p_font);
+        return false;
     }
+    return true;
+}
 
-    tommy_hashlin_insert(&fonts, &p_font->node, p_font, HASH_ID(p_font->id));
+void put_font(int* p_msg_length, NVGcontext* p_ctx) {
+    font_t* p_font = alloc_font(p_msg_length);
+    if (!p_font) return;
+
+    read_bytes_down(p_font->blob.p_data, p_font->blob.size, p_msg_length);
+    cache_font_blob(p_font);
+    store_font(p_font, p_ctx);
 }
 
-void set_font(sid_t id, NVGcontext* p_ctx) {
-    font_t* p_font = get_font_entry(id);
-    if (p_font) {
-        nvgFontFaceId(p_ctx, p_font->nvg_id);
+int put_font_hash(int* p_msg_length, NVGcontext* p_ctx, uint8_t hash[SHA256_SIZE]) {
+    font_t* p_font = alloc_font_hdr(p_msg_length, hash);
+    if (!p_font) return -1;
+
+    /* Fonts are immutable per name, so one already loaded is current */
+    if (get_font_entry(p_font->id)) {
+        free(p_font);
+        return ASSET_HAVE;
+    }
+
+    /* Served straight from the mapping; NanoVG never copies font data */
+    if (p_ctx && asset_cache_map(hash, &p_font->map) &&
+        p_font->map.size == p_font->blob.size) {
+        p_font->blob.p_data = (void*)p_font->map.p_data;
+        return store_font(p_font, p_ctx) ? ASSET_HAVE : ASSET_MISSING;
     }
+
+    asset_cache_expect(ASSET_FONT, p_font->id, hash);
+    font_free(p_font);
+    return ASSET_MISSING;
 }
 
-static void font_free(void* p_obj) {
-    free(p_obj);
+static void font_stream_finish(stream_t* p_stream, NVGcontext* p_ctx) {
+    cache_font_blob(p_stream->p_obj);
+    store_font(p_stream->p_obj, p_ctx);
+}
+
+static void font_stream_abort(stream_t* p_stream, NVGcontext* p_ctx) {
+    (void)p_ctx;
+    free(p_stream->p_obj);
+}
+
+bool put_font_stream_begin(int* p_msg_length, stream_t* p_stream) {
+    font_t* p_font = alloc_font(p_msg_length);
+    if (!p_font) return false;
+
+    p_stream->p_obj = p_font;
+    p_stream->p_dest = p_font->blob.p_data;
+    p_stream->dest_left = p_font->blob.size;
+    p_stream->finish = font_stream_finish;
+    p_stream->abort = font_stream_abort;
+    return true;
+}
+
+int set_font(uint32_t handle, NVGcontext* p_ctx) {
+    font_t* p_font = id_table_get(&fonts, handle);
+    if (!p_font) return -1;
+    nvgFontFaceId(p_ctx, p_font->nvg_id);
+    return p_font->nvg_id;
 }
 
 void reset_fonts(NVGcontext* p_ctx) {
     (void)p_ctx;  /* NanoVG doesn't have a font delete API */
-    tommy_hashlin_foreach(&fonts, font_free);
-    tommy_hashlin_done(&fonts);
-    tommy_hashlin_init(&fonts);
+    id_table_clear(&fonts, font_free_arg, NULL);
 }
@@ -5,9 +5,14 @@
 #pragma once
 
 #include "types.h"
-#include "tommyds/tommyhashlin.h"
 
-void init_fonts(void);
 void put_font(int* p_msg_length, NVGcontext* p_ctx);
-void set_font(sid_t id, NVGcontext* p_ctx);
+bool put_font_stream_begin(int* p_msg_length, stream_t* p_stream);
+
+/* PUT_FONT_HASH: load from the asset cache if possible.
+ * Returns ASSET_HAVE, ASSET_MISSING, or -1 for a malformed message. */
+int put_font_hash(int* p_msg_length, NVGcontext* p_ctx, uint8_t hash[32]);
+/* handle is the font id's interned handle (intern.h). Returns the NanoVG
+ * face id now set, or -1 if there is no such font and nothing changed. */
+int set_font(uint32_t handle, NVGcontext* p_ctx);
 void reset_fonts(NVGcontext* p_ctx);
@@ -12,10 +12,17 @@
 #include "utils.h"
 #include "comms.h"
 #include "image.h"
+#include "asset_cache.h"
+#include "decode_pool.h"
+#include "intern.h"
+#include "pixels.h"
+#include "scenic_protocol.h"
 #include "nanovg/stb_image.h"
 
-#define HASH_ID(id) tommy_hash_u32(0, id.p_data, id.size)
 #define REPEAT_XY (NVG_IMAGE_REPEATX | NVG_IMAGE_REPEATY)
+/* Largest RGBA image accepted, 16384 x 16384; keeps its size in a
+ * stream's uint32_t dest_left */
+#define IMAGE_MAX_BYTES ((uint64_t)1 << 30)
 
 typedef struct _image_t {
     sid_t id;
@@ -23,197 +30,845 @@ typedef struct _image_t {
     uint32_t width;
     uint32_t height;
     uint32_t format;
-    void* p_pixels;
-    tommy_hashlin_node node;
+    void* p_pixels;             /* RGBA copy, only kept when retaining */
+    uint32_t put_seq;           /* the put its texture should show */
+    bool decoding;              /* that put is still on the decode pool */
+    bool has_hash;              /* content hash of the last upload is known */
+    uint8_t hash[SHA256_SIZE];
 } image_t;
 
-static tommy_hashlin images = {0};
+static id_table_t images = {0};
+static uint32_t g_put_seq = 0;  /* numbers every put, across all images */
+static int g_decodes_done = 0;  /* uploaded since finish_image_decodes */
 
-void init_images(void) {
-    tommy_hashlin_init(&images);
-}
+/* Once uploaded, pixels live only in the texture unless retained for
+ * re-uploading into a new GL context */
+static bool g_retain_pixels = false;
+static size_t g_retained_bytes = 0;
 
-static int _comparator(const void* p_arg, const void* p_obj) {
-    const sid_t* p_id = p_arg;
-    const image_t* p_img = p_obj;
-    return (p_id->size != p_img->id.size)
-        || memcmp(p_id->p_data, p_img->id.p_data, p_id->size);
+static image_t* get_image(sid_t id) {
+    return id_table_get(&images, find_id(id));
 }
 
-static image_t* get_image(sid_t id) {
-    return tommy_hashlin_search(
-        &images,
-        _comparator,
-        &id,
-        HASH_ID(id)
-    );
+static size_t image_bytes(const image_t* p_image) {
+    return (size_t)p_image->width * p_image->height * 4;
 }
 
-static void image_free(NVGcontext* p_ctx, image_t* p_image) {
-    if (p_image) {
-        tommy_hashlin_remove_existing(&images, &p_image->node);
-        nvgDeleteImage(p_ctx, p_image->nvg_id);
-        if (p_image->p_pixels) {
-            free(p_image->p_pixels);
-        }
-        free(p_image);
+static void free_image(image_t* p_image) {
+    if (p_image->p_pixels) {
+        g_retained_bytes -= image_bytes(p_image);
+        free(p_image->p_pixels);
     }
+    free(p_image);
+}
+
+static void image_free(void* p_obj, void* p_arg) {
+    image_t* p_image = p_obj;
+    nvgDeleteImage((NVGcontext*)p_arg, p_image->nvg_id);
+    free_image(p_image);
 }
 
 void reset_images(NVGcontext* p_ctx) {
-    tommy_hashlin_foreach_arg(&images, (tommy_foreach_arg_func*)image_free, p_ctx);
-    tommy_hashlin_done(&images);
-    tommy_hashlin_init(&images);
+    id_table_clear(&images, image_free, p_ctx);
+}
+
+void set_image_retain(bool retain) {
+    g_retain_pixels = retain;
+}
+
+size_t retained_image_bytes(void) {
+    return g_retained_bytes;
+}
+
+/* Record which content an image now holds; p_hash NULL for unknown */
+static void set_image_hash(image_t* p_image, const uint8_t* p_hash) {
+    p_image->has_hash = p_hash != NULL;
+    if (p_hash) {
+        memcpy(p_image->hash, p_hash, SHA256_SIZE);
+    }
+}
+
+/* A new GL context has none of the old textures: images with retained
+ * pixels get them back, the rest draw nothing until sent again */
+static void image_restore(void* p_obj, void* p_arg) {
+    image_t* p_image = p_obj;
+    p_image->nvg_id = 0;
+    if (p_image->p_pixels) {
+        p_image->nvg_id = nvgCreateImageRGBA((NVGcontext*)p_arg, p_image->width, p_image->height,
+                                             REPEAT_XY, p_image->p_pixels);
+    } else {
+        set_image_hash(p_image, NULL);
+    }
+}
+
+void restore_images(NVGcontext* p_ctx) {
+    id_table_each(&images, image_restore, p_ctx);
+}
+
+/* Where to expand pixels before upload: the retained copy, or a
+ * temporary for pixels_end to free */
+static void* pixels_begin(image_t* p_image) {
+    if (g_retain_pixels && !p_image->p_pixels) {
+        p_image->p_pixels = malloc(image_bytes(p_image));
+        if (p_image->p_pixels) g_retained_bytes += image_bytes(p_image);
+    }
+    void* p_rgba = g_retain_pixels ? p_image->p_pixels : malloc(image_bytes(p_image));
+    if (!p_rgba) {
+        send_puts("Unable to allocate image pixels");
+    }
+    return p_rgba;
+}
+
+static void pixels_end(image_t* p_image, void* p_rgba) {
+    if (p_rgba != p_image->p_pixels) free(p_rgba);
 }
 
-static int read_pixels(void* p_pixels, uint32_t width, uint32_t height,
-                       uint32_t format_in, int* p_msg_length) {
+/* RGBA pixels of an encoded payload, or NULL; free with stbi_image_free */
+static uint8_t* decode_pixels(uint32_t width, uint32_t height,
+                              const void* p_buffer, int buffer_size) {
+    int x, y, comp;
+    uint8_t* p_rgba = stbi_load_from_memory(p_buffer, buffer_size, &x, &y, &comp, 4);
+    if (!p_rgba) {
+        send_puts("Unable to decode image");
+        return NULL;
+    }
+    if (x != (int)width || y != (int)height) {
+        send_puts("Image size mismatch");
+        stbi_image_free(p_rgba);
+        return NULL;
+    }
+    return p_rgba;
+}
+
+/* The rest of the message, in place in the receive buffer. p_hash, when
+ * set, names a cache entry to store the raw payload under; *p_stored says
+ * whether the payload matched it and was kept. */
+static const void* read_payload(int* p_msg_length, const uint8_t* p_hash, uint32_t* p_size,
+                                bool* p_stored) {
     int buffer_size = *p_msg_length;
-    void* p_buffer = malloc(buffer_size);
+    const void* p_buffer = read_bytes_ptr(buffer_size, p_msg_length);
     if (!p_buffer) {
-        send_puts("Unable to alloc temporary pixel buffer");
-        return -1;
+        send_puts("Truncated image data");
+        return NULL;
     }
-    read_bytes_down(p_buffer, buffer_size, p_msg_length);
 
-    unsigned int pixel_count = width * height;
-    unsigned int src_i, dst_i;
-    int x, y, comp;
-    void* p_temp = NULL;
-
-    switch (format_in) {
-        case 0:  /* encoded file format */
-            p_temp = (void*)stbi_load_from_memory(p_buffer, buffer_size, &x, &y, &comp, 4);
-            if (p_temp && (x != (int)width || y != (int)height)) {
-                send_puts("Image size mismatch");
-                free(p_temp);
-                free(p_buffer);
-                return -1;
-            }
-            if (p_temp) {
-                memcpy(p_pixels, p_temp, pixel_count * 4);
-                free(p_temp);
-            }
-            break;
+    *p_stored = p_hash && asset_cache_store(p_hash, p_buffer, buffer_size);
+    *p_size = (uint32_t)buffer_size;
+    return p_buffer;
+}
 
-        case 1:  /* grayscale */
-            for (unsigned int i = 0; i < pixel_count; i++) {
-                dst_i = i * 4;
-                ((char*)p_pixels)[dst_i] = ((char*)p_buffer)[i];
-                ((char*)p_pixels)[dst_i + 1] = ((char*)p_buffer)[i];
-                ((char*)p_pixels)[dst_i + 2] = ((char*)p_buffer)[i];
-                ((char*)p_pixels)[dst_i + 3] = 0xff;
-            }
-            break;
+static image_t* alloc_image(uint32_t id_length, uint32_t width, uint32_t height,
+                            uint32_t format, const void* p_id) {
+    int struct_size = ALIGN_UP(sizeof(image_t), 8);
+    int id_size = ALIGN_UP(id_length + 1, 8);
+    size_t alloc_size = struct_size + id_size;
 
-        case 2:  /* gray + alpha */
-            for (unsigned int i = 0; i < pixel_count; i++) {
-                dst_i = i * 4;
-                src_i = i * 2;
-                ((char*)p_pixels)[dst_i] = ((char*)p_buffer)[src_i];
-                ((char*)p_pixels)[dst_i + 1] = ((char*)p_buffer)[src_i];
-                ((char*)p_pixels)[dst_i + 2] = ((char*)p_buffer)[src_i];
-                ((char*)p_pixels)[dst_i + 3] = ((char*)p_buffer)[src_i + 1];
-            }
-            break;
+    image_t* p_image = malloc(alloc_size);
+    if (!p_image) {
+        send_puts("Unable to allocate image struct");
+        return NULL;
+    }
 
-        case 3:  /* rgb */
-            for (unsigned int i = 0; i < pixel_count; i++) {
-                dst_i = i * 4;
-                src_i = i * 3;
-                ((char*)p_pixels)[dst_i] = ((char*)p_buffer)[src_i];
-                ((char*)p_pixels)[dst_i + 1] = ((char*)p_buffer)[src_i + 1];
-                ((char*)p_pixels)[dst_i + 2] = ((char*)p_buffer)[src_i + 2];
-                ((char*)p_pixels)[dst_i + 3] = 0xff;
-            }
-            break;
+    memset(p_image, 0, alloc_size);
+    p_image->width = width;
+    p_image->height = height;
+    p_image->format = format;
 
-        case 4:  /* rgba */
-            memcpy(p_pixels, p_buffer, pixel_count * 4);
-            break;
+    p_image->id.size = id_length;
+    p_image->id.p_data = ((void*)p_image) + struct_size;
+    memcpy(p_image->id.p_data, p_id, id_length);
+    return p_image;
+}
+
+/* Upload p_rgba, width x height, for a new (not yet inserted) or updated
+ * image; it may point into the receive buffer */
+static void commit_image(image_t* p_image, bool is_new, NVGcontext* p_ctx, const void* p_rgba) {
+    if (is_new) {
+        uint32_t handle = intern_id(p_image->id);
+        if (!id_table_set(&images, handle, p_image)) {
+            release_id(handle);
+            send_puts("Unable to allocate image table");
+            free_image(p_image);
+            return;
+        }
+    }
+    p_image->put_seq = ++g_put_seq;
+    p_image->decoding = false;
+
+    if (g_retain_pixels && p_rgba != p_image->p_pixels) {
+        void* p_copy = pixels_begin(p_image);
+        if (p_copy) memcpy(p_copy, p_rgba, image_bytes(p_image));
     }
 
-    free(p_buffer);
-    return 0;
+    /* Records still waiting on their first decode have no texture yet */
+    if (p_image->nvg_id == 0) {
+        p_image->nvg_id = nvgCreateImageRGBA(p_ctx, p_image->width, p_image->height,
+                                             REPEAT_XY, p_rgba);
+    } else {
+        nvgUpdateImage(p_ctx, p_image->nvg_id, p_rgba);
+    }
 }
 
-void put_image(int* p_msg_length, NVGcontext* p_ctx) {
+/* Expands a complete payload in any wire format and uploads it. Raw RGBA
+ * goes to the texture straight from p_buffer. */
+static bool commit_buffer(image_t* p_image, bool is_new, NVGcontext* p_ctx,
+                          uint32_t format, const void* p_buffer, size_t buffer_size) {
+    if (format == SCENIC_IMG_FMT_ENCODED) {
+        uint8_t* p_rgba = decode_pixels(p_image->width, p_image->height,
+                                        p_buffer, (int)buffer_size);
+        if (!p_rgba) return false;
+        commit_image(p_image, is_new, p_ctx, p_rgba);
+        stbi_image_free(p_rgba);
+        return true;
+    }
+    if (format > SCENIC_IMG_FMT_RGBA ||
+        buffer_size < (size_t)p_image->width * p_image->height * format) {
+        send_puts("Truncated image data");
+        return false;
+    }
+    if (format == SCENIC_IMG_FMT_RGBA) {
+        commit_image(p_image, is_new, p_ctx, p_buffer);
+        return true;
+    }
+
+    void* p_rgba = pixels_begin(p_image);
+    if (!p_rgba) return false;
+    pixels_to_rgba(p_rgba, p_buffer, (size_t)p_image->width * p_image->height, format);
+    commit_image(p_image, is_new, p_ctx, p_rgba);
+    pixels_end(p_image, p_rgba);
+    return true;
+}
+
+/*
+ * Encoded images decode on the pool when it is running. A new record is
+ * registered straight away without a texture, so it draws nothing until
+ * its pixels arrive; an existing one keeps showing its previous contents.
+ * Only the latest put of an image is applied.
+ */
+
+/* Takes p_encoded if it returns true; false for the caller to decode inline */
+static bool queue_decode(image_t* p_image, bool is_new, uint8_t* p_encoded, uint32_t size) {
+    if (!decode_pool_running()) return false;
+    decode_job_t* p_job = calloc(1, sizeof(decode_job_t));
+    if (!p_job) return false;
+
+    p_job->handle = intern_id(p_image->id);
+    p_job->seq = g_put_seq + 1;
+    p_job->p_encoded = p_encoded;
+    p_job->encoded_size = size;
+    if (p_job->handle == ID_NONE || !decode_pool_submit(p_job)) {
+        release_id(p_job->handle);
+        p_job->p_encoded = NULL;
+        decode_job_free(p_job);
+        return false;
+    }
+    p_image->put_seq = ++g_put_seq;
+    p_image->decoding = true;
+
+    /* The record holds the id; the job only looks it up */
+    if (!is_new) {
+        release_id(p_job->handle);
+    } else if (!id_table_set(&images, p_job->handle, p_image)) {
+        release_id(p_job->handle);
+        send_puts("Unable to allocate image table");
+        free_image(p_image);
+    }
+    return true;
+}
+
+/* queue_decode for a payload the caller does not own */
+static bool queue_decode_copy(image_t* p_image, bool is_new, const void* p_buffer, uint32_t size) {
+    if (!decode_pool_running()) return false;
+    uint8_t* p_copy = malloc(size ? size : 1);
+    if (!p_copy) return false;
+    memcpy(p_copy, p_buffer, size);
+    if (queue_decode(p_image, is_new, p_copy, size)) return true;
+    free(p_copy);
+    return false;
+}
+
+static void finish_decode(decode_job_t* p_job, NVGcontext* p_ctx) {
+    image_t* p_image = id_table_get(&images, p_job->handle);
+    if (!p_image || p_image->put_seq != p_job->seq) {
+        /* Reset, or replaced by a later put */
+    } else if (!p_job->p_pixels) {
+        send_puts("Unable to decode image");
+        p_image->decoding = false;
+        set_image_hash(p_image, NULL);
+    } else if (p_job->width != (int)p_image->width || p_job->height != (int)p_image->height) {
+        send_puts("Image size mismatch");
+        p_image->decoding = false;
+        set_image_hash(p_image, NULL);
+    } else {
+        commit_image(p_image, false, p_ctx, p_job->p_pixels);
+        g_decodes_done++;
+    }
+    decode_job_free(p_job);
+}
+
+int finish_image_decodes(NVGcontext* p_ctx) {
+    decode_job_t* p_job;
+    while ((p_job = decode_pool_take_done()) != NULL) {
+        finish_decode(p_job, p_ctx);
+    }
+    int count = g_decodes_done;
+    g_decodes_done = 0;
+    return count;
+}
+
+typedef struct {
+    sid_t id;                   /* points into the receive buffer */
+    uint32_t blob_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+} image_header_t;
+
+/* Reads the PUT_IMAGE header and id. PUT_IMAGE_HASH carries a hash
+ * between the header and the id; pass p_hash to read it. */
+static bool read_image_header(int* p_msg_length, image_header_t* p_hdr, uint8_t* p_hash) {
     uint32_t id_length, blob_size, width, height, format;
     read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
     read_bytes_down(&blob_size, sizeof(uint32_t), p_msg_length);
     read_bytes_down(&width, sizeof(uint32_t), p_msg_length);
     read_bytes_down(&height, sizeof(uint32_t), p_msg_length);
-    read_bytes_down(&format, sizeof(uint32_t), p_msg_length);
+    if (!read_bytes_down(&format, sizeof(uint32_t), p_msg_length)) {
+        send_puts("Truncated image header");
+        return false;
+    }
+    if (p_hash && !read_bytes_down(p_hash, SHA256_SIZE, p_msg_length)) {
+        send_puts("Truncated image hash");
+        return false;
+    }
 
     /* Convert from big-endian */
     id_length = ntoh_ui32(id_length);
-    blob_size = ntoh_ui32(blob_size);
-    width = ntoh_ui32(width);
-    height = ntoh_ui32(height);
-    format = ntoh_ui32(format);
-
-    void* p_temp_id = calloc(1, id_length + 1);
-    if (!p_temp_id) {
-        send_puts("Unable to allocate image id buffer");
-        return;
+    p_hdr->blob_size = ntoh_ui32(blob_size);
+    p_hdr->width = ntoh_ui32(width);
+    p_hdr->height = ntoh_ui32(height);
+    p_hdr->format = ntoh_ui32(format);
+    if ((uint64_t)p_hdr->width * p_hdr->height * 4 > IMAGE_MAX_BYTES) {
+        send_puts("Image too large");
+        return false;
     }
-    read_bytes_down(p_temp_id, id_length, p_msg_length);
 
-    sid_t id;
-    id.size = id_length;
-    id.p_data = p_temp_id;
+    /* The id is looked up in place, straight from the receive buffer */
+    p_hdr->id.size = id_length;
+    p_hdr->id.p_data = (void*)read_bytes_ptr(id_length, p_msg_length);
+    if (!p_hdr->id.p_data) {
+        send_puts("Truncated image id");
+        return false;
+    }
+    return true;
+}
 
-    image_t* p_image = get_image(id);
+/* Returns the target image (existing or freshly allocated), or NULL if
+ * the message should be dropped. */
+static image_t* image_for_header(const image_header_t* p_hdr, bool* p_is_new) {
+    image_t* p_image = get_image(p_hdr->id);
 
     /* Check if dimensions changed */
-    if (p_image && ((width != p_image->width) || (height != p_image->height))) {
+    if (p_image && ((p_hdr->width != p_image->width) || (p_hdr->height != p_image->height))) {
         log_error("Cannot change image size");
-        free(p_temp_id);
-        return;
+        return NULL;
     }
 
+    *p_is_new = (p_image == NULL);
     if (!p_image) {
         /* Create new image record */
-        int struct_size = ALIGN_UP(sizeof(image_t), 8);
-        int id_size = ALIGN_UP(id_length + 1, 8);
-        int pixel_size = width * height * 4;
-        int alloc_size = struct_size + id_size + pixel_size;
-
-        p_image = malloc(alloc_size);
-        if (!p_image) {
-            send_puts("Unable to allocate image struct");
-            free(p_temp_id);
+        p_image = alloc_image(p_hdr->id.size, p_hdr->width, p_hdr->height,
+                              p_hdr->format, p_hdr->id.p_data);
+    }
+    return p_image;
+}
+
+static image_t* begin_put_image(int* p_msg_length, uint32_t* p_format, bool* p_is_new) {
+    image_header_t hdr;
+    if (!read_image_header(p_msg_length, &hdr, NULL)) return NULL;
+    *p_format = hdr.format;
+    return image_for_header(&hdr, p_is_new);
+}
+
+void put_image(int* p_msg_length, NVGcontext* p_ctx) {
+    uint32_t format;
+    bool is_new;
+    image_t* p_image = begin_put_image(p_msg_length, &format, &is_new);
+    if (!p_image) return;
+
+    uint8_t hash[SHA256_SIZE];
+    bool expected = asset_cache_take_expected(ASSET_IMAGE, p_image->id, hash);
+    uint32_t size;
+    bool stored = false;
+    const void* p_buffer = read_payload(p_msg_length, expected ? hash : NULL, &size, &stored);
+    /* Bytes that do not match the announced hash must not answer for it */
+    set_image_hash(p_image, stored ? hash : NULL);
+    if (p_buffer && format == SCENIC_IMG_FMT_ENCODED &&
+        queue_decode_copy(p_image, is_new, p_buffer, size)) {
+        return;
+    }
+    if (!p_buffer || !commit_buffer(p_image, is_new, p_ctx, format, p_buffer, size)) {
+        if (is_new) {
+            free_image(p_image);
+        } else {
+            set_image_hash(p_image, NULL);
+        }
+    }
+}
+
+typedef struct {
+    image_t* p_image;
+    uint32_t x;
+    uint32_t y;
+    uint32_t w;
+    uint32_t h;
+    uint32_t format;
+} region_t;
+
+/* Reads and checks a PUT_IMAGE_REGION header and id, leaving the pixels.
+ * A region patches the image's latest put, so one still decoding is
+ * waited for and uploaded first. */
+static bool begin_region(int* p_msg_length, NVGcontext* p_ctx, region_t* p_region) {
+    uint32_t header[7];
+    if (!read_bytes_down(header, sizeof(header), p_msg_length)) {
+        send_puts("Truncated image region header");
+        return false;
+    }
+    sid_t id;
+    id.size = ntoh_ui32(header[0]);
+    uint32_t data_len = ntoh_ui32(header[1]);
+    p_region->x = ntoh_ui32(header[2]);
+    p_region->y = ntoh_ui32(header[3]);
+    p_region->w = ntoh_ui32(header[4]);
+    p_region->h = ntoh_ui32(header[5]);
+    p_region->format = ntoh_ui32(header[6]);
+    id.p_data = (void*)read_bytes_ptr(id.size, p_msg_length);
+    if (!id.p_data) {
+        send_puts("Truncated image id");
+        return false;
+    }
+
+    image_t* p_image = get_image(id);
+    while (p_image && p_image->decoding) {
+        decode_job_t* p_job = decode_pool_wait_done();
+        if (!p_job) break;
+        finish_decode(p_job, p_ctx);
+    }
+    if (!p_image || p_image->nvg_id == 0) {
+        log_error("Image region for an unknown image");
+        return false;
+    }
+    if ((uint64_t)p_region->x + p_region->w > p_image->width ||
+        (uint64_t)p_region->y + p_region->h > p_image->height) {
+        log_error("Image region out of bounds");
+        return false;
+    }
+    if (p_region->format < SCENIC_IMG_FMT_GRAY || p_region->format > SCENIC_IMG_FMT_RGBA) {
+        log_error("Image region must be raw pixels");
+        return false;
+    }
+    if ((uint64_t)p_region->w * p_region->h * p_region->format != data_len) {
+        log_error("Image region data length does not match its size");
+        return false;
+    }
+    if (data_len > (uint32_t)*p_msg_length) {
+        send_puts("Truncated image data");
+        return false;
+    }
+    p_region->p_image = p_image;
+    return true;
+}
+
+void put_image_region(int* p_msg_length, NVGcontext* p_ctx) {
+    region_t rg;
+    if (!begin_region(p_msg_length, p_ctx, &rg)) return;
+    image_t* p_image = rg.p_image;
+
+    size_t count = (size_t)rg.w * rg.h;
+    if (count == 0) return;
+    const void* p_buffer = read_bytes_ptr((int)(count * rg.format), p_msg_length);
+
+    /* Raw RGBA goes up straight from the receive buffer */
+    const uint8_t* p_rgba = p_buffer;
+    uint8_t* p_temp = NULL;
+    if (rg.format != SCENIC_IMG_FMT_RGBA) {
+        p_temp = malloc(count * 4);
+        if (!p_temp) {
+            send_puts("Unable to allocate image pixels");
             return;
         }
+        pixels_to_rgba(p_temp, p_buffer, count, rg.format);
+        p_rgba = p_temp;
+    }
+
+    if (p_image->p_pixels) {
+        for (uint32_t row = 0; row < rg.h; row++) {
+            memcpy((uint8_t*)p_image->p_pixels + (((size_t)rg.y + row) * p_image->width + rg.x) * 4,
+                   p_rgba + (size_t)row * rg.w * 4, (size_t)rg.w * 4);
+        }
+    }
+    if (!nvgUpdateImageRegion(p_ctx, p_image->nvg_id, rg.x, rg.y, rg.w, rg.h, p_rgba)) {
+        if (p_image->p_pixels) {
+            nvgUpdateImage(p_ctx, p_image->nvg_id, p_image->p_pixels);
+        } else {
+            send_puts("Image region updates not supported");
+        }
+    }
+    free(p_temp);
+    set_image_hash(p_image, NULL);
+}
+
+/*
+ * A region too large for the receive buffer is converted into a band of
+ * rows as it arrives and each full band is uploaded, so a large video
+ * frame needs neither the whole payload nor the whole region in memory.
+ */
+
+#define REGION_BAND_BYTES (64 * 1024)   /* RGBA staged per upload */
+
+typedef struct {
+    region_t rg;
+    NVGcontext* p_ctx;
+    uint8_t* p_band;            /* RGBA rows being filled */
+    uint32_t band_pixels;       /* capacity, whole rows */
+    uint32_t band_fill;         /* pixels in p_band */
+    uint32_t rows_done;         /* rows uploaded */
+    size_t pixels_left;         /* still to arrive */
+    bool failed;                /* no region uploads; fall back at the end */
+} region_stream_t;
+
+static void region_flush_band(region_stream_t* p_state) {
+    const region_t* p_rg = &p_state->rg;
+    image_t* p_image = p_rg->p_image;
+    uint32_t rows = p_state->band_fill / p_rg->w;
+    uint32_t y = p_rg->y + p_state->rows_done;
+    if (p_image->p_pixels) {
+        for (uint32_t row = 0; row < rows; row++) {
+            memcpy((uint8_t*)p_image->p_pixels + (((size_t)y + row) * p_image->width + p_rg->x) * 4,
+                   p_state->p_band + (size_t)row * p_rg->w * 4, (size_t)p_rg->w * 4);
+        }
+    }
+    if (!p_state->failed &&
+        !nvgUpdateImageRegion(p_state->p_ctx, p_image->nvg_id, p_rg->x, y, p_rg->w, rows,
+                              p_state->p_band)) {
+        p_state->failed = true;
+    }
+    p_state->rows_done += rows;
+    p_state->band_fill = 0;
+}
+
+/* Converts count whole pixels into the band, flushing it once full */
+static void region_take_pixels(region_stream_t* p_state, const uint8_t* p, uint32_t count) {
+    pixels_to_rgba(p_state->p_band + (size_t)p_state->band_fill * 4, p, count, p_state->rg.format);
+    p_state->band_fill += count;
+    p_state->pixels_left -= count;
+    if (p_state->band_fill == p_state->band_pixels || p_state->pixels_left == 0) {
+        region_flush_band(p_state);
+    }
+}
+
+static void region_stream_write(stream_t* p_stream, const uint8_t* p, uint32_t len) {
+    region_stream_t* p_state = p_stream->p_obj;
+    uint32_t bpp = p_state->rg.format;
+    while (len > 0 && p_state->pixels_left > 0) {
+        if (p_stream->carry_len > 0 || len < bpp) {
+            /* A pixel split across chunks */
+            uint32_t n = bpp - p_stream->carry_len;
+            if (n > len) n = len;
+            memcpy(p_stream->carry + p_stream->carry_len, p, n);
+            p_stream->carry_len += n;
+            p += n;
+            len -= n;
+            if (p_stream->carry_len == bpp) {
+                p_stream->carry_len = 0;
+                region_take_pixels(p_state, p_stream->carry, 1);
+            }
+            continue;
+        }
+        uint32_t count = len / bpp;
+        uint32_t room = p_state->band_pixels - p_state->band_fill;
+        if (count > room) count = room;
+        region_take_pixels(p_state, p, count);
+        p += count * bpp;
+        len -= count * bpp;
+    }
+}
+
+static void region_stream_finish(stream_t* p_stream, NVGcontext* p_ctx) {
+    region_stream_t* p_state = p_stream->p_obj;
+    image_t* p_image = p_state->rg.p_image;
+    if (p_state->failed) {
+        if (p_image->p_pixels) {
+            nvgUpdateImage(p_ctx, p_image->nvg_id, p_image->p_pixels);
+        } else {
+            send_puts("Image region updates not supported");
+        }
+    }
+    free(p_state->p_band);
+    free(p_state);
+}
 
-        memset(p_image, 0, struct_size + id_size);
-        p_image->width = width;
-        p_image->height = height;
-        p_image->format = format;
+/* Rows already uploaded stay; the texture no longer matches its hash,
+ * which begin already cleared */
+static void region_stream_abort(stream_t* p_stream, NVGcontext* p_ctx) {
+    (void)p_ctx;
+    region_stream_t* p_state = p_stream->p_obj;
+    free(p_state->p_band);
+    free(p_state);
+}
 
-        p_image->id.size = id_length;
-        p_image->id.p_data = ((void*)p_image) + struct_size;
-        memcpy(p_image->id.p_data, p_temp_id, id_length);
+bool put_image_region_stream_begin(int* p_msg_length, stream_t* p_stream, NVGcontext* p_ctx) {
+    region_t rg;
+    if (!begin_region(p_msg_length, p_ctx, &rg)) return false;
+    if (rg.w == 0 || rg.h == 0) return false;
+
+    region_stream_t* p_state = calloc(1, sizeof(region_stream_t));
+    if (!p_state) return false;
+    uint32_t rows = REGION_BAND_BYTES / 4 / rg.w;
+    if (rows == 0) rows = 1;
+    if (rows > rg.h) rows = rg.h;
+    p_state->rg = rg;
+    p_state->p_ctx = p_ctx;
+    p_state->band_pixels = rows * rg.w;
+    p_state->pixels_left = (size_t)rg.w * rg.h;
+    p_state->p_band = malloc((size_t)p_state->band_pixels * 4);
+    if (!p_state->p_band) {
+        send_puts("Unable to allocate image pixels");
+        free(p_state);
+        return false;
+    }
+    set_image_hash(rg.p_image, NULL);
+
+    p_stream->p_obj = p_state;
+    p_stream->format = rg.format;
+    p_stream->write = region_stream_write;
+    p_stream->finish = region_stream_finish;
+    p_stream->abort = region_stream_abort;
+    return true;
+}
 
-        p_image->p_pixels = ((void*)p_image) + struct_size + id_size;
+int put_image_hash(int* p_msg_length, NVGcontext* p_ctx, uint8_t hash[SHA256_SIZE]) {
+    image_header_t hdr;
+    if (!read_image_header(p_msg_length, &hdr, hash)) return -1;
 
-        read_pixels(p_image->p_pixels, width, height, format, p_msg_length);
+    /* Already showing exactly this content, e.g. after a reconnect */
+    image_t* p_image = get_image(hdr.id);
+    if (p_image && p_image->has_hash && memcmp(p_image->hash, hash, SHA256_SIZE) == 0) {
+        return ASSET_HAVE;
+    }
 
-        p_image->nvg_id = nvgCreateImageRGBA(p_ctx, width, height, REPEAT_XY, p_image->p_pixels);
+    asset_map_t map;
+    if (p_ctx && asset_cache_map(hash, &map)) {
+        bool is_new;
+        p_image = map.size == hdr.blob_size ? image_for_header(&hdr, &is_new) : NULL;
+        if (p_image) {
+            set_image_hash(p_image, hash);
+            bool ok = (hdr.format == SCENIC_IMG_FMT_ENCODED &&
+                       queue_decode_copy(p_image, is_new, map.p_data, map.size)) ||
+                      commit_buffer(p_image, is_new, p_ctx, hdr.format, map.p_data, map.size);
+            asset_cache_unmap(&map);
+            if (ok) {
+                return ASSET_HAVE;
+            }
+            if (is_new) {
+                free_image(p_image);
+            } else {
+                set_image_hash(p_image, NULL);
+            }
+        } else {
+            asset_cache_unmap(&map);
+        }
+    }
 
-        tommy_hashlin_insert(&images, &p_image->node, p_image, HASH_ID(p_image->id));
+    asset_cache_expect(ASSET_IMAGE, hdr.id, hash);
+    return ASSET_MISSING;
+}
+
+/*
+ * Streaming PUT_IMAGE: raw RGBA lands directly in a staging buffer (the
+ * retained copy, if kept), other raw formats are expanded into it chunk
+ * by chunk, and encoded images are staged in a blob of exactly the
+ * encoded size for decoding at the end.
+ */
+
+typedef struct {
+    image_t* p_image;
+    bool is_new;
+    void* p_rgba;               /* raw formats, from pixels_begin */
+    uint8_t* p_encoded;
+    uint32_t encoded_size;
+    asset_writer_t* p_writer;   /* announced by hash: keep a cache copy */
+} image_stream_t;
+
+static void image_stream_convert(stream_t* p_stream, const uint8_t* p, uint32_t len) {
+    uint32_t bpp = p_stream->format;  /* raw formats 1-3 are also their byte widths */
+    image_stream_t* p_state = p_stream->p_obj;
+    if (p_state->p_writer) {
+        /* The converted pixels are not what was hashed; keep the wire bytes */
+        asset_writer_write(p_state->p_writer, p, len);
+    }
+
+    /* Finish a pixel split across chunks */
+    while (p_stream->carry_len > 0 && len > 0) {
+        p_stream->carry[p_stream->carry_len++] = *p++;
+        len--;
+        if (p_stream->carry_len == bpp) {
+            if (p_stream->dest_left >= 4) {
+                pixels_to_rgba(p_stream->p_dest, p_stream->carry, 1, p_stream->format);
+                p_stream->p_dest += 4;
+                p_stream->dest_left -= 4;
+            }
+            p_stream->carry_len = 0;
+        }
+    }
+    if (p_stream->carry_len > 0) {
+        return;                 /* the chunk ended inside the pixel */
+    }
+
+    uint32_t count = len / bpp;
+    if (count > p_stream->dest_left / 4) {
+        count = p_stream->dest_left / 4;
+    }
+    pixels_to_rgba(p_stream->p_dest, p, count, p_stream->format);
+    p_stream->p_dest += count * 4;
+    p_stream->dest_left -= count * 4;
+
+    uint32_t rest = len - (len / bpp) * bpp;
+    memcpy(p_stream->carry, p + len - rest, rest);
+    p_stream->carry_len = rest;
+}
+
+static void image_stream_finish(stream_t* p_stream, NVGcontext* p_ctx) {
+    image_stream_t* p_state = p_stream->p_obj;
+    image_t* p_image = p_state->p_image;
+
+    asset_writer_t* p_writer = p_state->p_writer;
+    if (p_writer) {
+        if (p_state->p_encoded) {
+            asset_writer_write(p_writer, p_state->p_encoded, p_state->encoded_size);
+        } else if (p_stream->format == SCENIC_IMG_FMT_RGBA) {
+            asset_writer_write(p_writer, p_state->p_rgba, image_bytes(p_image));
+        }
+        set_image_hash(p_image, asset_writer_commit(p_writer) ? p_writer->hash : NULL);
+        free(p_writer);
+        p_state->p_writer = NULL;
     } else {
-        /* Update existing image pixels */
-        read_pixels(p_image->p_pixels, width, height, format, p_msg_length);
-        nvgUpdateImage(p_ctx, p_image->nvg_id, p_image->p_pixels);
+        set_image_hash(p_image, NULL);
     }
 
-    free(p_temp_id);
+    if (p_state->p_encoded &&
+        queue_decode(p_image, p_state->is_new, p_state->p_encoded, p_state->encoded_size)) {
+        free(p_state);
+        return;
+    }
+    if (p_state->p_encoded) {
+        uint8_t* p_rgba = decode_pixels(p_image->width, p_image->height,
+                                        p_state->p_encoded, p_state->encoded_size);
+        free(p_state->p_encoded);
+        if (p_rgba) {
+            commit_image(p_image, p_state->is_new, p_ctx, p_rgba);
+            stbi_image_free(p_rgba);
+        } else if (p_state->is_new) {
+            free_image(p_image);
+        }
+        free(p_state);
+        return;
+    }
+
+    commit_image(p_image, p_state->is_new, p_ctx, p_state->p_rgba);
+    pixels_end(p_image, p_state->p_rgba);
+    free(p_state);
 }
 
-void set_fill_image(NVGcontext* p_ctx, sid_t id) {
-    image_t* p_image = get_image(id);
-    if (!p_image) return;
+static void image_stream_abort(stream_t* p_stream, NVGcontext* p_ctx) {
+    (void)p_ctx;
+    image_stream_t* p_state = p_stream->p_obj;
+    if (p_state->p_writer) {
+        asset_writer_abort(p_state->p_writer);
+        free(p_state->p_writer);
+    }
+    free(p_state->p_encoded);
+    if (p_state->p_rgba) pixels_end(p_state->p_image, p_state->p_rgba);
+    if (p_state->is_new) free_image(p_state->p_image);
+    free(p_state);
+}
+
+bool put_image_stream_begin(int* p_msg_length, stream_t* p_stream) {
+    uint32_t format;
+    bool is_new;
+    image_t* p_image = begin_put_image(p_msg_length, &format, &is_new);
+    if (!p_image) return false;
+
+    /* As in commit_buffer: a short payload would upload whatever the
+     * staging buffer happened to hold */
+    if (format >= SCENIC_IMG_FMT_GRAY && format <= SCENIC_IMG_FMT_RGBA &&
+        (size_t)*p_msg_length < (size_t)p_image->width * p_image->height * format) {
+        send_puts("Truncated image data");
+        if (is_new) free_image(p_image);
+        return false;
+    }
+
+    image_stream_t* p_state = calloc(1, sizeof(image_stream_t));
+    if (!p_state) {
+        if (is_new) free_image(p_image);
+        return false;
+    }
+    p_state->p_image = p_image;
+    p_state->is_new = is_new;
+
+    uint8_t hash[SHA256_SIZE];
+    if (asset_cache_take_expected(ASSET_IMAGE, p_image->id, hash)) {
+        p_state->p_writer = malloc(sizeof(asset_writer_t));
+        if (p_state->p_writer && !asset_writer_begin(p_state->p_writer, hash)) {
+            free(p_state->p_writer);
+            p_state->p_writer = NULL;
+        }
+    }
+
+    p_stream->p_obj = p_state;
+    p_stream->format = format;
+    p_stream->dest_left = (uint32_t)image_bytes(p_image);
+    p_stream->finish = image_stream_finish;
+    p_stream->abort = image_stream_abort;
+
+    switch (format) {
+        case SCENIC_IMG_FMT_ENCODED:
+            p_state->encoded_size = *p_msg_length;
+            p_state->p_encoded = malloc(p_state->encoded_size);
+            if (!p_state->p_encoded) {
+                send_puts("Unable to alloc encoded image buffer");
+                image_stream_abort(p_stream, NULL);
+                return false;
+            }
+            p_stream->p_dest = p_state->p_encoded;
+            p_stream->dest_left = p_state->encoded_size;
+            break;
+
+        case SCENIC_IMG_FMT_GRAY:
+        case SCENIC_IMG_FMT_GRAY_A:
+        case SCENIC_IMG_FMT_RGB:
+            p_stream->write = image_stream_convert;
+            /* fall through */
+
+        case SCENIC_IMG_FMT_RGBA:
+            p_state->p_rgba = pixels_begin(p_image);
+            if (!p_state->p_rgba) {
+                image_stream_abort(p_stream, NULL);
+                return false;
+            }
+            p_stream->p_dest = p_state->p_rgba;
+            break;
+
+        default:
+            image_stream_abort(p_stream, NULL);
+            return false;
+    }
+
+    return true;
+}
+
+void set_fill_image(NVGcontext* p_ctx, uint32_t handle) {
+    image_t* p_image = id_table_get(&images, handle);
+    if (!p_image || p_image->nvg_id == 0) return;
 
     int w, h;
     nvgImageSize(p_ctx, p_image->nvg_id, &w, &h);
@@ -222,9 +877,9 @@ void set_fill_image(NVGcontext* p_ctx, sid_t id) {
         nvgImagePattern(p_ctx, 0, 0, w, h, 0, p_image->nvg_id, 1.0));
 }
 
-void set_stroke_image(NVGcontext* p_ctx, sid_t id) {
-    image_t* p_image = get_image(id);
-    if (!p_image) return;
+void set_stroke_image(NVGcontext* p_ctx, uint32_t handle) {
+    image_t* p_image = id_table_get(&images, handle);
+    if (!p_image || p_image->nvg_id == 0) return;
 
     int w, h;
     nvgImageSize(p_ctx, p_image->nvg_id, &w, &h);
@@ -233,11 +888,11 @@ void set_stroke_image(NVGcontext* p_ctx, sid_t id) {
         nvgImagePattern(p_ctx, 0, 0, w, h, 0, p_image->nvg_id, 1.0));
 }
 
-void draw_image(NVGcontext* p_ctx, sid_t id,
+void draw_image(NVGcontext* p_ctx, uint32_t handle,
                 float sx, float sy, float sw, float sh,
                 float dx, float dy, float dw, float dh) {
-    image_t* p_image = get_image(id);
-    if (!p_image) return;
+    image_t* p_image = id_table_get(&images, handle);
+    if (!p_image || p_image->nvg_id == 0) return;
 
     int iw, ih;
     nvgImageSize(p_ctx, p_image->nvg_id, &iw, &ih);
@@ -256,3 +911,9 @@ void draw_image(NVGcontext* p_ctx, sid_t id,
     nvgFillPaint(p_ctx, img_pattern);
     nvgFill(p_ctx);
 }
+
+void draw_sprites(NVGcontext* p_ctx, uint32_t handle, const float* p_sprites, uint32_t count) {
+    image_t* p_image = id_table_get(&images, handle);
+    if (!p_image || p_image->nvg_id == 0) return;
+    nvgImageSprites(p_ctx, p_image->nvg_id, p_sprites, (int)count);
+}
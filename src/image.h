@@ -4,18 +4,46 @@
 
 #pragma once
 
+#include <stddef.h>
+
 #include "types.h"
-#include "tommyds/tommyhashlin.h"
 
-void init_images(void);
 void put_image(int* p_msg_length, NVGcontext* p_ctx);
+bool put_image_stream_begin(int* p_msg_length, stream_t* p_stream);
+
+/* PUT_IMAGE_REGION: patch part of an image's texture. A decode of the
+ * whole image still in flight is finished first, so the region lands on
+ * top of it. The data length must be exactly w * h * format. */
+void put_image_region(int* p_msg_length, NVGcontext* p_ctx);
+bool put_image_region_stream_begin(int* p_msg_length, stream_t* p_stream, NVGcontext* p_ctx);
+
+/* PUT_IMAGE_HASH: load from the asset cache if possible.
+ * Returns ASSET_HAVE, ASSET_MISSING, or -1 for a malformed message. */
+int put_image_hash(int* p_msg_length, NVGcontext* p_ctx, uint8_t hash[32]);
 void reset_images(NVGcontext* p_ctx);
 
-void set_fill_image(NVGcontext* p_ctx, sid_t id);
-void set_stroke_image(NVGcontext* p_ctx, sid_t id);
+/* Keep each image's RGBA pixels after upload (off by default), so
+ * restore_images can rebuild textures after the GL context is lost */
+void set_image_retain(bool retain);
+size_t retained_image_bytes(void);
+
+/* Recreate textures in a new context that replaces a lost one */
+void restore_images(NVGcontext* p_ctx);
+
+/* Uploads the images the decode pool has finished; call on the GL thread.
+ * Returns how many changed. */
+int finish_image_decodes(NVGcontext* p_ctx);
+
+/* handle is the image id's interned handle (intern.h) */
+void set_fill_image(NVGcontext* p_ctx, uint32_t handle);
+void set_stroke_image(NVGcontext* p_ctx, uint32_t handle);
 
 void draw_image(
-    NVGcontext* p_ctx, sid_t id,
+    NVGcontext* p_ctx, uint32_t handle,
     float sx, float sy, float sw, float sh,
     float dx, float dy, float dw, float dh
 );
+
+/* count sprites of one image, 8 floats each (source then destination
+ * rect), as a single NanoVG draw call */
+void draw_sprites(NVGcontext* p_ctx, uint32_t handle, const float* p_sprites, uint32_t count);
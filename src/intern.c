@@ -0,0 +1,181 @@
+/*
+ * Interned ids
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "utils.h"
+#include "tommyds/tommyhashlin.h"
+
+typedef struct {
+    sid_t id;
+    uint32_t handle;
+    uint32_t refs;
+    tommy_hashlin_node node;
+} id_entry_t;
+
+/* One per index ever used. The generation outlives the entry, so a
+ * handle to a released or reset id stops matching once its index is
+ * reused. */
+typedef struct {
+    id_entry_t* p_entry;        /* NULL when free */
+    uint32_t next_free;
+    uint8_t generation;
+} index_slot_t;
+
+#define NO_FREE UINT32_MAX
+
+static tommy_hashlin ids = {0};
+static bool ids_ready = false;          /* ids initialized */
+static index_slot_t* p_index = NULL;
+static uint32_t index_used = 0;         /* high water */
+static uint32_t index_capacity = 0;
+static uint32_t free_head = NO_FREE;    /* released indices, last first */
+
+static void free_index(uint32_t i) {
+    free(p_index[i].p_entry);
+    p_index[i].p_entry = NULL;
+    p_index[i].next_free = free_head;
+    free_head = i;
+}
+
+void reset_ids(void) {
+    free_head = NO_FREE;
+    for (uint32_t i = index_used; i-- > 0;) free_index(i);
+    if (ids_ready) tommy_hashlin_done(&ids);
+    ids_ready = false;
+}
+
+static int _comparator(const void* p_arg, const void* p_obj) {
+    const sid_t* p_id = p_arg;
+    const id_entry_t* p_entry = p_obj;
+    return (p_id->size != p_entry->id.size)
+        || memcmp(p_id->p_data, p_entry->id.p_data, p_id->size);
+}
+
+uint32_t find_id(sid_t id) {
+    if (!ids_ready) return ID_NONE;
+    id_entry_t* p_entry = tommy_hashlin_search(&ids, _comparator, &id, sid_hash(id));
+    return p_entry ? p_entry->handle : ID_NONE;
+}
+
+/* An index for a new entry: a released one, or the next unused */
+static bool take_index(uint32_t* p_i) {
+    if (free_head != NO_FREE) {
+        *p_i = free_head;
+        free_head = p_index[free_head].next_free;
+        return true;
+    }
+    if (index_used >= (1u << ID_INDEX_BITS)) return false;
+    if (index_used == index_capacity) {
+        uint32_t capacity = index_capacity ? index_capacity * 2 : 256;
+        index_slot_t* p = realloc(p_index, capacity * sizeof(index_slot_t));
+        if (!p) return false;
+        memset(p + index_capacity, 0, (capacity - index_capacity) * sizeof(index_slot_t));
+        p_index = p;
+        index_capacity = capacity;
+    }
+    *p_i = index_used++;
+    return true;
+}
+
+uint32_t intern_id(sid_t id) {
+    if (!ids_ready) {
+        tommy_hashlin_init(&ids);
+        ids_ready = true;
+    }
+    uint32_t hash = sid_hash(id);
+    id_entry_t* p_entry = tommy_hashlin_search(&ids, _comparator, &id, hash);
+    if (p_entry) {
+        p_entry->refs++;
+        return p_entry->handle;
+    }
+
+    size_t struct_size = ALIGN_UP(sizeof(id_entry_t), 8);
+    p_entry = malloc(struct_size + id.size + 1);
+    if (!p_entry) return ID_NONE;
+    uint32_t i;
+    if (!take_index(&i)) {
+        free(p_entry);
+        return ID_NONE;
+    }
+    p_entry->id.size = id.size;
+    p_entry->id.p_data = ((void*)p_entry) + struct_size;
+    memcpy(p_entry->id.p_data, id.p_data, id.size);
+    ((char*)p_entry->id.p_data)[id.size] = '\0';
+    p_entry->refs = 1;
+
+    /* Never 0, so no handle is ID_NONE */
+    p_index[i].generation = p_index[i].generation % 255 + 1;
+    p_index[i].p_entry = p_entry;
+    p_entry->handle = ((uint32_t)p_index[i].generation << ID_INDEX_BITS) | i;
+
+    tommy_hashlin_insert(&ids, &p_entry->node, p_entry, hash);
+    return p_entry->handle;
+}
+
+static id_entry_t* get_entry(uint32_t handle) {
+    uint32_t i = id_index(handle);
+    if (i >= index_used || !p_index[i].p_entry) return NULL;
+    id_entry_t* p_entry = p_index[i].p_entry;
+    return p_entry->handle == handle ? p_entry : NULL;
+}
+
+void release_id(uint32_t handle) {
+    id_entry_t* p_entry = get_entry(handle);
+    if (!p_entry || --p_entry->refs > 0) return;
+    tommy_hashlin_remove_existing(&ids, &p_entry->node);
+    free_index(id_index(handle));
+}
+
+uint32_t interned_ids(void) {
+    return ids_ready ? (uint32_t)tommy_hashlin_count(&ids) : 0;
+}
+
+uint32_t id_indices(void) {
+    return index_used;
+}
+
+sid_t id_name(uint32_t handle) {
+    id_entry_t* p_entry = get_entry(handle);
+    if (p_entry) return p_entry->id;
+    sid_t none = { "", 0 };
+    return none;
+}
+
+bool id_table_set(id_table_t* p_table, uint32_t handle, void* p_obj) {
+    if (handle == ID_NONE) return false;
+    uint32_t i = id_index(handle);
+    if (i >= p_table->capacity) {
+        if (!p_obj) return true;
+        uint32_t capacity = p_table->capacity ? p_table->capacity : 64;
+        while (capacity <= i) capacity *= 2;
+        id_slot_t* p = realloc(p_table->p_slots, capacity * sizeof(id_slot_t));
+        if (!p) return false;
+        memset(p + p_table->capacity, 0, (capacity - p_table->capacity) * sizeof(id_slot_t));
+        p_table->p_slots = p;
+        p_table->capacity = capacity;
+    }
+    /* The table keeps the reference a new record was interned with */
+    if (!p_obj && p_table->p_slots[i].handle == handle) release_id(handle);
+    p_table->p_slots[i].handle = p_obj ? handle : ID_NONE;
+    p_table->p_slots[i].p_obj = p_obj;
+    return true;
+}
+
+void id_table_each(const id_table_t* p_table, void (*fn)(void* p_obj, void* p_arg), void* p_arg) {
+    for (uint32_t i = 0; i < p_table->capacity; i++) {
+        if (p_table->p_slots[i].p_obj) fn(p_table->p_slots[i].p_obj, p_arg);
+    }
+}
+
+void id_table_clear(id_table_t* p_table, void (*fn)(void* p_obj, void* p_arg), void* p_arg) {
+    for (uint32_t i = 0; i < p_table->capacity; i++) {
+        if (p_table->p_slots[i].p_obj) fn(p_table->p_slots[i].p_obj, p_arg);
+    }
+    free(p_table->p_slots);
+    p_table->p_slots = NULL;
+    p_table->capacity = 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Interned ids
+ *
+ * Script, font and image ids are interned once, at ingest, into dense
+ * 32-bit handles: a 24-bit index into the table and an 8-bit generation
+ * of that index. Stores keep their records in id_table_t arrays indexed
+ * by handle, and compiled scripts carry handles instead of id bytes, so
+ * nothing on the render path hashes or compares ids.
+ *
+ * Each record and each compiled reference holds a reference on its id.
+ * When the last is released the index is reused for the next new id with
+ * its generation bumped, so a stale handle stops matching (until the
+ * generation wraps after 255 reuses).
+ */
+
+#pragma once
+
+#include "types.h"
+
+#define ID_NONE 0
+#define ID_INDEX_BITS 24
+
+static inline uint32_t id_index(uint32_t handle) {
+    return handle & ((1u << ID_INDEX_BITS) - 1);
+}
+
+/* Forgets every id, whatever its references; stores must have dropped
+ * their records first */
+void reset_ids(void);
+
+/* The id's handle, adding it if new, with a reference the caller owns;
+ * ID_NONE if it cannot be added */
+uint32_t intern_id(sid_t id);
+
+/* Drops a reference from intern_id; the last one frees the handle.
+ * ID_NONE and stale handles are ignored. */
+void release_id(uint32_t handle);
+
+/* The id's handle, or ID_NONE if it was never interned */
+uint32_t find_id(sid_t id);
+
+/* The id bytes behind a handle (NUL terminated), or an empty id */
+sid_t id_name(uint32_t handle);
+
+/* Ids currently interned, and indices ever used for them */
+uint32_t interned_ids(void);
+uint32_t id_indices(void);
+
+/* Records indexed by handle */
+typedef struct {
+    uint32_t handle;
+    void* p_obj;
+} id_slot_t;
+
+typedef struct {
+    id_slot_t* p_slots;
+    uint32_t capacity;
+} id_table_t;
+
+static inline void* id_table_get(const id_table_t* p_table, uint32_t handle) {
+    uint32_t i = id_index(handle);
+    if (i >= p_table->capacity || p_table->p_slots[i].handle != handle) return NULL;
+    return p_table->p_slots[i].p_obj;
+}
+
+/* Filling an empty slot hands the table the caller's reference from
+ * intern_id; p_obj NULL clears the slot and releases it. Returns false
+ * for ID_NONE or if the table cannot grow, and the caller keeps its
+ * reference. */
+bool id_table_set(id_table_t* p_table, uint32_t handle, void* p_obj);
+
+/* Calls fn on every record */
+void id_table_each(const id_table_t* p_table, void (*fn)(void* p_obj, void* p_arg), void* p_arg);
+
+/* Calls fn on every record, then empties the table, leaving the ids to
+ * reset_ids */
+void id_table_clear(id_table_t* p_table, void (*fn)(void* p_obj, void* p_arg), void* p_arg);
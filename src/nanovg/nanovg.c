@@ -834,6 +834,12 @@ void nvgUpdateImage(NVGcontext* ctx, int image, const unsigned char* data)
 	ctx->params.renderUpdateTexture(ctx->params.userPtr, image, 0,0, w,h, data);
 }
 
+int nvgUpdateImageRegion(NVGcontext* ctx, int image, int x, int y, int w, int h, const unsigned char* data)
+{
+	if (ctx->params.renderUpdateTextureRegion == NULL) return 0;
+	return ctx->params.renderUpdateTextureRegion(ctx->params.userPtr, image, x,y, w,h, data);
+}
+
 void nvgImageSize(NVGcontext* ctx, int image, int* w, int* h)
 {
 	ctx->params.renderGetTextureSize(ctx->params.userPtr, image, w, h);
@@ -2221,43 +2227,113 @@ void nvgDebugDumpPathCache(NVGcontext* ctx)
 	}
 }
 
-void nvgFill(NVGcontext* ctx)
+static int nvg__geometryMatches(NVGcontext* ctx, const NVGgeometry* geom, const float* style)
+{
+	return geom->valid && geom->ncommands == ctx->ncommands &&
+		memcmp(geom->style, style, sizeof(geom->style)) == 0 &&
+		memcmp(geom->commands, ctx->commands, sizeof(float)*ctx->ncommands) == 0;
+}
+
+// Copies the expanded paths out of the path cache, before the next expand reuses its vertices.
+static void nvg__recordGeometry(NVGcontext* ctx, NVGgeometry* geom, const float* style)
+{
+	NVGpathCache* cache = ctx->cache;
+	int i, nverts = 0;
+
+	for (i = 0; i < cache->npaths; i++) {
+		const NVGpath* path = &cache->paths[i];
+		if (path->fill != NULL) nverts = nvg__maxi(nverts, (int)(path->fill - cache->verts) + path->nfill);
+		if (path->stroke != NULL) nverts = nvg__maxi(nverts, (int)(path->stroke - cache->verts) + path->nstroke);
+	}
+
+	geom->valid = 0;
+	if (ctx->ncommands > geom->ccommands) {
+		float* commands = (float*)realloc(geom->commands, sizeof(float)*ctx->ncommands);
+		if (commands == NULL) return;
+		geom->commands = commands;
+		geom->ccommands = ctx->ncommands;
+	}
+	if (cache->npaths > geom->cpaths) {
+		NVGpath* paths = (NVGpath*)realloc(geom->paths, sizeof(NVGpath)*cache->npaths);
+		if (paths == NULL) return;
+		geom->paths = paths;
+		geom->cpaths = cache->npaths;
+	}
+	if (nverts > geom->cverts) {
+		NVGvertex* verts = (NVGvertex*)realloc(geom->verts, sizeof(NVGvertex)*nverts);
+		if (verts == NULL) return;
+		geom->verts = verts;
+		geom->cverts = nverts;
+	}
+
+	memcpy(geom->commands, ctx->commands, sizeof(float)*ctx->ncommands);
+	geom->ncommands = ctx->ncommands;
+	memcpy(geom->style, style, sizeof(geom->style));
+	memcpy(geom->paths, cache->paths, sizeof(NVGpath)*cache->npaths);
+	geom->npaths = cache->npaths;
+	memcpy(geom->verts, cache->verts, sizeof(NVGvertex)*nverts);
+	for (i = 0; i < geom->npaths; i++) {
+		NVGpath* path = &geom->paths[i];
+		if (path->fill != NULL) path->fill = geom->verts + (path->fill - cache->verts);
+		if (path->stroke != NULL) path->stroke = geom->verts + (path->stroke - cache->verts);
+	}
+	memcpy(geom->bounds, cache->bounds, sizeof(geom->bounds));
+	geom->valid = 1;
+}
+
+static int nvg__fill(NVGcontext* ctx, NVGgeometry* geom)
 {
 	NVGstate* state = nvg__getState(ctx);
 	const NVGpath* path;
+	const NVGpath* paths;
+	const float* bounds;
 	NVGpaint fillPaint = state->fill;
-	int i;
-
-	nvg__flattenPaths(ctx);
-	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
-		nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
-	else
-		nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
+	float fringe = ctx->params.edgeAntiAlias && state->shapeAntiAlias ? ctx->fringeWidth : 0.0f;
+	float style[NVG_GEOMETRY_STYLE] = { fringe, ctx->tessTol, ctx->distTol };
+	int i, npaths;
+	int reused = geom != NULL && nvg__geometryMatches(ctx, geom, style);
+
+	if (reused) {
+		paths = geom->paths;
+		npaths = geom->npaths;
+		bounds = geom->bounds;
+	} else {
+		nvg__flattenPaths(ctx);
+		nvg__expandFill(ctx, fringe, NVG_MITER, 2.4f);
+		if (geom != NULL)
+			nvg__recordGeometry(ctx, geom, style);
+		paths = ctx->cache->paths;
+		npaths = ctx->cache->npaths;
+		bounds = ctx->cache->bounds;
+	}
 
 	// Apply global alpha
 	fillPaint.innerColor.a *= state->alpha;
 	fillPaint.outerColor.a *= state->alpha;
 
 	ctx->params.renderFill(ctx->params.userPtr, &fillPaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
-						   ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths);
+						   bounds, paths, npaths);
 
 	// Count triangles
-	for (i = 0; i < ctx->cache->npaths; i++) {
-		path = &ctx->cache->paths[i];
+	for (i = 0; i < npaths; i++) {
+		path = &paths[i];
 		ctx->fillTriCount += path->nfill-2;
 		ctx->fillTriCount += path->nstroke-2;
 		ctx->drawCallCount += 2;
 	}
+	return reused;
 }
 
-void nvgStroke(NVGcontext* ctx)
+static int nvg__stroke(NVGcontext* ctx, NVGgeometry* geom)
 {
 	NVGstate* state = nvg__getState(ctx);
 	float scale = nvg__getAverageScale(state->xform);
 	float strokeWidth = nvg__clampf(state->strokeWidth * scale, 0.0f, 200.0f);
+	float fringe = ctx->params.edgeAntiAlias && state->shapeAntiAlias ? ctx->fringeWidth : 0.0f;
 	NVGpaint strokePaint = state->stroke;
 	const NVGpath* path;
-	int i;
+	const NVGpath* paths;
+	int i, npaths, reused;
 
 
 	if (strokeWidth < ctx->fringeWidth) {
@@ -2273,22 +2349,61 @@ void nvgStroke(NVGcontext* ctx)
 	strokePaint.innerColor.a *= state->alpha;
 	strokePaint.outerColor.a *= state->alpha;
 
-	nvg__flattenPaths(ctx);
-
-	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
-		nvg__expandStroke(ctx, strokeWidth*0.5f, ctx->fringeWidth, state->lineCap, state->lineJoin, state->miterLimit);
-	else
-		nvg__expandStroke(ctx, strokeWidth*0.5f, 0.0f, state->lineCap, state->lineJoin, state->miterLimit);
+	{
+		float style[NVG_GEOMETRY_STYLE] = { strokeWidth, fringe, (float)state->lineCap, (float)state->lineJoin,
+											state->miterLimit, ctx->tessTol, ctx->distTol };
+		reused = geom != NULL && nvg__geometryMatches(ctx, geom, style);
+		if (reused) {
+			paths = geom->paths;
+			npaths = geom->npaths;
+		} else {
+			nvg__flattenPaths(ctx);
+			nvg__expandStroke(ctx, strokeWidth*0.5f, fringe, state->lineCap, state->lineJoin, state->miterLimit);
+			if (geom != NULL)
+				nvg__recordGeometry(ctx, geom, style);
+			paths = ctx->cache->paths;
+			npaths = ctx->cache->npaths;
+		}
+	}
 
 	ctx->params.renderStroke(ctx->params.userPtr, &strokePaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
-							 strokeWidth, ctx->cache->paths, ctx->cache->npaths);
+							 strokeWidth, paths, npaths);
 
 	// Count triangles
-	for (i = 0; i < ctx->cache->npaths; i++) {
-		path = &ctx->cache->paths[i];
+	for (i = 0; i < npaths; i++) {
+		path = &paths[i];
 		ctx->strokeTriCount += path->nstroke-2;
 		ctx->drawCallCount++;
 	}
+	return reused;
+}
+
+void nvgFill(NVGcontext* ctx)
+{
+	nvg__fill(ctx, NULL);
+}
+
+void nvgStroke(NVGcontext* ctx)
+{
+	nvg__stroke(ctx, NULL);
+}
+
+int nvgFillCached(NVGcontext* ctx, NVGgeometry* geom)
+{
+	return nvg__fill(ctx, geom);
+}
+
+int nvgStrokeCached(NVGcontext* ctx, NVGgeometry* geom)
+{
+	return nvg__stroke(ctx, geom);
+}
+
+void nvgFreeGeometry(NVGgeometry* geom)
+{
+	free(geom->commands);
+	free(geom->paths);
+	free(geom->verts);
+	memset(geom, 0, sizeof(*geom));
 }
 
 // Add fonts
@@ -2472,6 +2587,49 @@ static int nvg__isTransformFlipped(const float *xform)
 	return( det < 0);
 }
 
+void nvgImageSprites(NVGcontext* ctx, int image, const float* sprites, int count)
+{
+	// Corner order of the two triangles, and the same with each one's winding reversed
+	static const int order[2][6] = { { 0, 2, 1, 0, 3, 2 }, { 0, 1, 2, 0, 2, 3 } };
+	NVGstate* state = nvg__getState(ctx);
+	const float* t = state->xform;
+	int flipped = nvg__isTransformFlipped(t);
+	NVGpaint paint;
+	NVGvertex* verts;
+	float iu, iv;
+	int iw, ih, i, j;
+
+	if (count <= 0) return;
+	if (ctx->params.renderGetTextureSize(ctx->params.userPtr, image, &iw, &ih) == 0) return;
+	if (iw <= 0 || ih <= 0) return;
+	verts = nvg__allocTempVerts(ctx, count * 6);
+	if (verts == NULL) return;
+	iu = 1.0f / iw;
+	iv = 1.0f / ih;
+
+	for (i = 0; i < count; i++) {
+		const float* s = &sprites[i * 8];
+		float x0 = s[4], y0 = s[5], x1 = s[4] + s[6], y1 = s[5] + s[7];
+		float u0 = s[0] * iu, v0 = s[1] * iv, u1 = (s[0] + s[2]) * iu, v1 = (s[1] + s[3]) * iv;
+		// Top left, top right, bottom right, bottom left
+		NVGvertex c[4] = {
+			{ t[0]*x0 + t[2]*y0 + t[4], t[1]*x0 + t[3]*y0 + t[5], u0, v0 },
+			{ t[0]*x1 + t[2]*y0 + t[4], t[1]*x1 + t[3]*y0 + t[5], u1, v0 },
+			{ t[0]*x1 + t[2]*y1 + t[4], t[1]*x1 + t[3]*y1 + t[5], u1, v1 },
+			{ t[0]*x0 + t[2]*y1 + t[4], t[1]*x0 + t[3]*y1 + t[5], u0, v1 },
+		};
+		// Keep triangles facing the same way when a negative size mirrors the sprite
+		const int* o = order[flipped ^ (s[6] < 0) ^ (s[7] < 0)];
+		for (j = 0; j < 6; j++) verts[i * 6 + j] = c[o[j]];
+	}
+
+	paint = nvgImagePattern(ctx, 0, 0, (float)iw, (float)ih, 0, image, state->alpha);
+	ctx->params.renderTriangles(ctx->params.userPtr, &paint, state->compositeOperation, &state->scissor, verts, count * 6, ctx->fringeWidth);
+
+	ctx->drawCallCount++;
+	ctx->fillTriCount += count * 2;
+}
+
 float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char* end)
 {
 	NVGstate* state = nvg__getState(ctx);
@@ -2953,4 +3111,9 @@ void nvgTextMetrics(NVGcontext* ctx, float* ascender, float* descender, float* l
 	if (lineh != NULL)
 		*lineh *= invscale;
 }
+
+float nvgTextScale(NVGcontext* ctx)
+{
+	return nvg__getFontScale(nvg__getState(ctx)) * ctx->devicePxRatio;
+}
 // vim: ft=c nu noet ts=4
@@ -386,12 +386,21 @@ int nvgCreateImageRGBA(NVGcontext* ctx, int w, int h, int imageFlags, const unsi
 // Updates image data specified by image handle.
 void nvgUpdateImage(NVGcontext* ctx, int image, const unsigned char* data);
 
+// Updates the w x h rectangle at x,y of an image from data holding just that rectangle,
+// tightly packed. Returns 0 if the backend cannot upload regions.
+int nvgUpdateImageRegion(NVGcontext* ctx, int image, int x, int y, int w, int h, const unsigned char* data);
+
 // Returns the dimensions of a created image.
 void nvgImageSize(NVGcontext* ctx, int image, int* w, int* h);
 
 // Deletes created image.
 void nvgDeleteImage(NVGcontext* ctx, int image);
 
+// Draws count rectangles of an image as one batch of triangles, in the current transform,
+// scissor and global alpha. Each sprite is 8 floats: the source rect sx,sy,sw,sh in image
+// pixels, then the destination rect dx,dy,dw,dh. Edges are not anti-aliased.
+void nvgImageSprites(NVGcontext* ctx, int image, const float* sprites, int count);
+
 //
 // Paints
 //
@@ -512,6 +521,17 @@ void nvgFill(NVGcontext* ctx);
 // Fills the current path with current stroke style.
 void nvgStroke(NVGcontext* ctx);
 
+// Like nvgFill() and nvgStroke(), but the tessellated geometry is kept in geom, which the
+// caller owns. While the current path and the style that shapes it (stroke width, caps,
+// joins, miter limit, tolerances) match what geom was recorded from, the path is not
+// flattened or expanded again and the recorded vertices go straight to the renderer;
+// paint and scissor are always current. Otherwise the path is tessellated and recorded.
+// geom must start zeroed and be released with nvgFreeGeometry(). Returns 1 when reused.
+typedef struct NVGgeometry NVGgeometry;
+int nvgFillCached(NVGcontext* ctx, NVGgeometry* geom);
+int nvgStrokeCached(NVGcontext* ctx, NVGgeometry* geom);
+void nvgFreeGeometry(NVGgeometry* geom);
+
 
 //
 // Text
@@ -629,6 +649,10 @@ int nvgTextGlyphPositions(NVGcontext* ctx, float x, float y, const char* string,
 // Measured values are returned in local coordinate space.
 void nvgTextMetrics(NVGcontext* ctx, float* ascender, float* descender, float* lineh);
 
+// Returns the scale glyphs are rasterized at for the current transform and device pixel ratio.
+// Text measures the same while this, the font and the text style are unchanged.
+float nvgTextScale(NVGcontext* ctx);
+
 // Breaks the specified text into lines. If end is specified only the sub-string will be used.
 // White space is stripped at the beginning of the rows, the text is split at word boundaries or when new-line characters are encountered.
 // Words longer than the max width are slit at nearest character (i.e. no hyphenation).
@@ -667,6 +691,20 @@ struct NVGpath {
 };
 typedef struct NVGpath NVGpath;
 
+#define NVG_GEOMETRY_STYLE 8
+
+struct NVGgeometry {
+	float* commands;
+	int ncommands, ccommands;
+	float style[NVG_GEOMETRY_STYLE];
+	NVGpath* paths;
+	int npaths, cpaths;
+	NVGvertex* verts;
+	int cverts;
+	float bounds[4];
+	int valid;
+};
+
 struct NVGparams {
 	void* userPtr;
 	int edgeAntiAlias;
@@ -674,6 +712,8 @@ struct NVGparams {
 	int (*renderCreateTexture)(void* uptr, int type, int w, int h, int imageFlags, const unsigned char* data);
 	int (*renderDeleteTexture)(void* uptr, int image);
 	int (*renderUpdateTexture)(void* uptr, int image, int x, int y, int w, int h, const unsigned char* data);
+	// Optional. Like renderUpdateTexture, but data holds just the w x h region, tightly packed.
+	int (*renderUpdateTextureRegion)(void* uptr, int image, int x, int y, int w, int h, const unsigned char* data);
 	int (*renderGetTextureSize)(void* uptr, int image, int* w, int* h);
 	void (*renderViewport)(void* uptr, float width, float height, float devicePixelRatio);
 	void (*renderCancel)(void* uptr);
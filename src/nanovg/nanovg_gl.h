@@ -872,6 +872,33 @@ static int glnvg__renderUpdateTexture(void* uptr, int image, int x, int y, int w
 	return 1;
 }
 
+static int glnvg__renderUpdateTextureRegion(void* uptr, int image, int x, int y, int w, int h, const unsigned char* data)
+{
+	GLNVGcontext* gl = (GLNVGcontext*)uptr;
+	GLNVGtexture* tex = glnvg__findTexture(gl, image);
+
+	if (tex == NULL) return 0;
+	if (x < 0 || y < 0 || x + w > tex->width || y + h > tex->height) return 0;
+	glnvg__bindTexture(gl, tex->tex);
+
+	// Rows are packed, so the default row length and skips apply
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+
+	if (tex->type == NVG_TEXTURE_RGBA)
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x,y, w,h, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	else
+#if defined(NANOVG_GLES2) || defined(NANOVG_GL2)
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x,y, w,h, GL_LUMINANCE, GL_UNSIGNED_BYTE, data);
+#else
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x,y, w,h, GL_RED, GL_UNSIGNED_BYTE, data);
+#endif
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glnvg__bindTexture(gl, 0);
+
+	return 1;
+}
+
 static int glnvg__renderGetTextureSize(void* uptr, int image, int* w, int* h)
 {
 	GLNVGcontext* gl = (GLNVGcontext*)uptr;
@@ -1581,6 +1608,7 @@ NVGcontext* nvgCreateGLES3(int flags)
 	params.renderCreateTexture = glnvg__renderCreateTexture;
 	params.renderDeleteTexture = glnvg__renderDeleteTexture;
 	params.renderUpdateTexture = glnvg__renderUpdateTexture;
+	params.renderUpdateTextureRegion = glnvg__renderUpdateTextureRegion;
 	params.renderGetTextureSize = glnvg__renderGetTextureSize;
 	params.renderViewport = glnvg__renderViewport;
 	params.renderCancel = glnvg__renderCancel;
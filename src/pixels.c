@@ -0,0 +1,187 @@
+/*
+ * Pixel format conversion
+ */
+
+#include <string.h>
+
+#include "pixels.h"
+#include "scenic_protocol.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KERNEL_NAME "avx2"
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define KERNEL_NAME "ssse3"
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNEL_NAME "sse2"
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KERNEL_NAME "neon"
+#else
+#define KERNEL_NAME "scalar"
+#endif
+
+const char* pixels_kernel_name(void) {
+    return KERNEL_NAME;
+}
+
+/*
+ * Each kernel converts as many leading pixels as its vectors cover,
+ * without reading past count pixels of input, and returns how many.
+ */
+
+static size_t gray_vector(uint8_t* d, const uint8_t* s, size_t count) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+    for (; i + 8 <= count; i += 8) {
+        __m256i g = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + i)));
+        __m256i v = _mm256_or_si256(_mm256_or_si256(g, _mm256_slli_epi32(g, 8)),
+                                    _mm256_or_si256(_mm256_slli_epi32(g, 16), alpha));
+        _mm256_storeu_si256((__m256i*)(d + i * 4), v);
+    }
+#elif defined(__SSE2__)
+    const __m128i alpha = _mm_set1_epi8((char)0xff);
+    for (; i + 16 <= count; i += 16) {
+        __m128i g = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i gg_lo = _mm_unpacklo_epi8(g, g);
+        __m128i gg_hi = _mm_unpackhi_epi8(g, g);
+        __m128i ga_lo = _mm_unpacklo_epi8(g, alpha);
+        __m128i ga_hi = _mm_unpackhi_epi8(g, alpha);
+        __m128i* p = (__m128i*)(d + i * 4);
+        _mm_storeu_si128(p, _mm_unpacklo_epi16(gg_lo, ga_lo));
+        _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(gg_lo, ga_lo));
+        _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(gg_hi, ga_hi));
+        _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(gg_hi, ga_hi));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t v;
+        v.val[0] = v.val[1] = v.val[2] = vld1q_u8(s + i);
+        v.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8(d + i * 4, v);
+    }
+#endif
+    (void)d; (void)s; (void)count;
+    return i;
+}
+
+static size_t gray_alpha_vector(uint8_t* d, const uint8_t* s, size_t count) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i low = _mm256_set1_epi32(0xff);
+    for (; i + 8 <= count; i += 8) {
+        /* Each lane holds g | a << 8 */
+        __m256i ga = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(s + i * 2)));
+        __m256i g = _mm256_and_si256(ga, low);
+        __m256i v = _mm256_or_si256(_mm256_or_si256(g, _mm256_slli_epi32(g, 8)),
+                                    _mm256_slli_epi32(ga, 16));
+        _mm256_storeu_si256((__m256i*)(d + i * 4), v);
+    }
+#elif defined(__SSE2__)
+    const __m128i low = _mm_set1_epi16(0xff);
+    for (; i + 8 <= count; i += 8) {
+        __m128i ga = _mm_loadu_si128((const __m128i*)(s + i * 2));
+        __m128i g = _mm_and_si128(ga, low);
+        __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+        __m128i* p = (__m128i*)(d + i * 4);
+        _mm_storeu_si128(p, _mm_unpacklo_epi16(gg, ga));
+        _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(gg, ga));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t ga = vld2q_u8(s + i * 2);
+        uint8x16x4_t v;
+        v.val[0] = v.val[1] = v.val[2] = ga.val[0];
+        v.val[3] = ga.val[1];
+        vst4q_u8(d + i * 4, v);
+    }
+#endif
+    (void)d; (void)s; (void)count;
+    return i;
+}
+
+static size_t rgb_vector(uint8_t* d, const uint8_t* s, size_t count) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    /* Two 16 byte loads, 12 bytes apart, give 8 pixels; the last load
+     * reaches 4 bytes past them */
+    const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+    for (; i + 10 <= count; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(s + i * 3));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(s + i * 3 + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, spread), alpha);
+        _mm256_storeu_si256((__m256i*)(d + i * 4), v);
+    }
+#elif defined(__SSSE3__)
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    for (; i + 6 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i * 3));
+        v = _mm_or_si128(_mm_shuffle_epi8(v, spread), alpha);
+        _mm_storeu_si128((__m128i*)(d + i * 4), v);
+    }
+#elif defined(__SSE2__)
+    /* Shift pixels 1-3 down to the bottom of copies, gather the low words */
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    for (; i + 6 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i * 3));
+        __m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+        __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+        v = _mm_or_si128(_mm_unpacklo_epi64(p01, p23), alpha);
+        _mm_storeu_si128((__m128i*)(d + i * 4), v);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x3_t rgb = vld3q_u8(s + i * 3);
+        uint8x16x4_t v;
+        v.val[0] = rgb.val[0];
+        v.val[1] = rgb.val[1];
+        v.val[2] = rgb.val[2];
+        v.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8(d + i * 4, v);
+    }
+#endif
+    (void)d; (void)s; (void)count;
+    return i;
+}
+
+void pixels_to_rgba(void* p_dst, const void* p_src, size_t count, uint32_t format) {
+    uint8_t* d = p_dst;
+    const uint8_t* s = p_src;
+    size_t i;
+
+    switch (format) {
+        case SCENIC_IMG_FMT_GRAY:
+            for (i = gray_vector(d, s, count); i < count; i++) {
+                d[i * 4] = d[i * 4 + 1] = d[i * 4 + 2] = s[i];
+                d[i * 4 + 3] = 0xff;
+            }
+            break;
+
+        case SCENIC_IMG_FMT_GRAY_A:
+            for (i = gray_alpha_vector(d, s, count); i < count; i++) {
+                d[i * 4] = d[i * 4 + 1] = d[i * 4 + 2] = s[i * 2];
+                d[i * 4 + 3] = s[i * 2 + 1];
+            }
+            break;
+
+        case SCENIC_IMG_FMT_RGB:
+            for (i = rgb_vector(d, s, count); i < count; i++) {
+                d[i * 4] = s[i * 3];
+                d[i * 4 + 1] = s[i * 3 + 1];
+                d[i * 4 + 2] = s[i * 3 + 2];
+                d[i * 4 + 3] = 0xff;
+            }
+            break;
+
+        case SCENIC_IMG_FMT_RGBA:
+            memcpy(d, s, count * 4);
+            break;
+    }
+}
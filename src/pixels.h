@@ -0,0 +1,21 @@
+/*
+ * Pixel format conversion
+ *
+ * Raw PUT_IMAGE payloads arrive as GRAY, GRAY_A, RGB or RGBA and NanoVG
+ * takes RGBA. The kernels below expand them with whatever vector unit the
+ * build targets (AVX2, SSSE3 or SSE2 on x86, NEON on ARM) and finish the
+ * tail in scalar code. Configure with SCENIC_NATIVE_ARCH to build for the
+ * host CPU and pick up AVX2.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Expands count pixels of a raw wire format (SCENIC_IMG_FMT_GRAY..RGBA)
+ * into RGBA; p_src may be unaligned and point into the receive buffer */
+void pixels_to_rgba(void* p_dst, const void* p_src, size_t count, uint32_t format);
+
+/* Which kernels pixels_to_rgba was built with, for logs and benchmarks */
+const char* pixels_kernel_name(void);
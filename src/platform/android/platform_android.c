@@ -14,7 +14,7 @@
 #include "nanovg/nanovg.h"
 #include "nanovg/nanovg_gl.h"
 
-#include "scenic_renderer.h"
+#include "platform_android.h"
 
 #define LOG_TAG "ScenicPlatform"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
@@ -84,6 +84,16 @@ void scenic_platform_android_setup_renderer(scenic_renderer_t* renderer) {
     }
 }
 
+/*
+ * Draw a frame; call from onDrawFrame after processing commands.
+ * GLSurfaceView swaps after every onDrawFrame without keeping the buffer,
+ * so this always draws. To idle, use RENDERMODE_WHEN_DIRTY and call
+ * requestRender() when scenic_renderer_needs_render() is set.
+ */
+void scenic_platform_android_draw_frame(scenic_renderer_t* renderer) {
+    scenic_renderer_render(renderer);
+}
+
 /*
  * Cleanup NanoVG context
  * Call before EGL context is destroyed
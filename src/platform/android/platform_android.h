@@ -0,0 +1,44 @@
+/*
+ * Android platform backend for Scenic renderer
+ *
+ * Hosts drive these from their GLSurfaceView.Renderer through JNI:
+ * setup in onSurfaceCreated, process commands and then draw in
+ * onDrawFrame, shutdown before the EGL context goes away.
+ */
+
+#ifndef SCENIC_PLATFORM_ANDROID_H
+#define SCENIC_PLATFORM_ANDROID_H
+
+#include "scenic_renderer.h"
+#include "nanovg/nanovg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Create the NanoVG context; call after the EGL context is created */
+NVGcontext* scenic_platform_android_init_nvg(void);
+
+/* Platform callbacks for scenic_renderer_create */
+scenic_platform_t scenic_platform_android_get_platform(void);
+
+/* Give the renderer the NanoVG context, creating it if needed */
+void scenic_platform_android_setup_renderer(scenic_renderer_t* renderer);
+
+/*
+ * Draw a frame; call from onDrawFrame after scenic_renderer_process_commands.
+ * RENDER commands no longer draw by themselves, so hosts that only process
+ * commands show nothing until they call this.
+ */
+void scenic_platform_android_draw_frame(scenic_renderer_t* renderer);
+
+/* Delete the NanoVG context; call before the EGL context is destroyed */
+void scenic_platform_android_shutdown(void);
+
+void scenic_platform_android_set_clear_color(float r, float g, float b, float a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCENIC_PLATFORM_ANDROID_H */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #ifdef __APPLE__
 #define GL_SILENCE_DEPRECATION
@@ -18,6 +19,7 @@
 #define NANOVG_GL3_IMPLEMENTATION
 #include "nanovg/nanovg.h"
 #include "nanovg/nanovg_gl.h"
+#include "nanovg/nanovg_gl_utils.h"
 
 #include "platform/platform.h"
 #include "scenic_renderer.h"
@@ -28,9 +30,18 @@ extern void scenic_renderer_set_nvg_context(scenic_renderer_t* r, NVGcontext* ct
 static GLFWwindow* g_window = NULL;
 static NVGcontext* g_nvg = NULL;
 static scenic_renderer_t* g_renderer = NULL;
-static bool g_should_close = false;
+static volatile bool g_should_close = false;
+static bool g_exposed = false;      /* the window needs the canvas again */
 static float g_clear_color[4] = {0.0f, 0.0f, 0.0f, 1.0f};
 
+/* Frames are drawn into g_canvas, which keeps its pixels between frames,
+ * and copied to the window when presented. That lets the renderer redraw
+ * only what changed whatever the swap chain does with the window's own
+ * buffers. */
+static NVGLUframebuffer* g_canvas = NULL;
+static int g_canvas_w = 0;
+static int g_canvas_h = 0;
+
 /* GLFW callbacks */
 static void error_callback(int error, const char* description) {
     fprintf(stderr, "GLFW Error %d: %s\n", error, description);
@@ -97,24 +108,204 @@ static void cursor_enter_callback(GLFWwindow* window, int entered) {
     }
 }
 
+static void refresh_callback(GLFWwindow* window) {
+    (void)window;
+    g_exposed = true;
+}
+
+/*
+ * Transport watcher
+ *
+ * While the frame loop sleeps in glfwWaitEventsTimeout, a thread waits on
+ * the transport and posts an empty event once data arrives. The loop owns
+ * the transport the rest of the time: taking it back wakes the watcher
+ * and waits until it has let go. A server transport accepts its client
+ * inside data_available, so until one connects the watcher waits in
+ * wait_client instead and the accept happens on this thread. Transports
+ * without wake, or a server without wait_client, are polled.
+ */
+
+/* Seconds to sleep with nothing to do; the watcher ends it early */
+#define IDLE_TIMEOUT_S 1.0
+/* Polling interval for transports that cannot be watched */
+#define POLL_INTERVAL_S 0.01
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    scenic_transport_t* transport;
+    bool running;
+    bool armed;         /* the loop is asleep; the watcher may wait */
+    bool waiting;       /* the watcher is blocked in the transport */
+    bool accepting;     /* no client yet: wait in wait_client instead */
+    bool quit;
+    bool failed;        /* the transport stopped blocking; poll instead */
+} g_watch = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+static void* watch_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_watch.lock);
+    while (!g_watch.quit && !g_watch.failed) {
+        if (!g_watch.armed) {
+            pthread_cond_wait(&g_watch.cond, &g_watch.lock);
+            continue;
+        }
+        g_watch.waiting = true;
+        pthread_mutex_unlock(&g_watch.lock);
+
+        bool ready = g_watch.accepting
+            ? scenic_transport_wait_client(g_watch.transport, -1)
+            : scenic_transport_data_available(g_watch.transport, -1);
+
+        pthread_mutex_lock(&g_watch.lock);
+        g_watch.waiting = false;
+        if (g_watch.armed && (ready || g_watch.accepting || !g_watch.transport->connected)) {
+            /* A client transport that lost its peer returns at once, as
+             * does a failed wait_client */
+            g_watch.failed = !ready;
+            g_watch.armed = false;
+            glfwPostEmptyEvent();
+        }
+        pthread_cond_broadcast(&g_watch.cond);
+    }
+    pthread_mutex_unlock(&g_watch.lock);
+    return NULL;
+}
+
+static void watch_start(scenic_transport_t* t) {
+    if (!t || !t->ops->wake) return;
+    g_watch.transport = t;
+    g_watch.quit = false;
+    g_watch.failed = false;
+    g_watch.armed = false;
+    g_watch.running = pthread_create(&g_watch.thread, NULL, watch_main, NULL) == 0;
+}
+
+/* Take the transport back from the watcher */
+static void watch_disarm(void) {
+    pthread_mutex_lock(&g_watch.lock);
+    g_watch.armed = false;
+    if (g_watch.waiting) {
+        scenic_transport_wake(g_watch.transport);
+        while (g_watch.waiting) {
+            pthread_cond_wait(&g_watch.cond, &g_watch.lock);
+        }
+    }
+    pthread_mutex_unlock(&g_watch.lock);
+}
+
+static void watch_stop(void) {
+    if (!g_watch.running) return;
+    watch_disarm();
+    pthread_mutex_lock(&g_watch.lock);
+    g_watch.quit = true;
+    pthread_cond_broadcast(&g_watch.cond);
+    pthread_mutex_unlock(&g_watch.lock);
+    pthread_join(g_watch.thread, NULL);
+    g_watch.running = false;
+}
+
+/* Sleep until input, transport data, a resize or expose, or a close */
+static void wait_for_work(scenic_renderer_t* renderer) {
+    scenic_renderer_stats_t stats = {0};
+    if (renderer) {
+        scenic_renderer_get_stats(renderer, &stats);
+    }
+    if (stats.budget_exhausted) {
+        /* Commands are still queued: only pick up input */
+        glfwPollEvents();
+        return;
+    }
+
+    pthread_mutex_lock(&g_watch.lock);
+    bool watched = false;
+    if (g_watch.running && !g_watch.failed) {
+        g_watch.accepting = !g_watch.transport->connected;
+        watched = !g_watch.accepting || g_watch.transport->ops->wait_client;
+    }
+    if (watched) {
+        g_watch.armed = true;
+        pthread_cond_broadcast(&g_watch.cond);
+    }
+    pthread_mutex_unlock(&g_watch.lock);
+
+    glfwWaitEventsTimeout(watched ? IDLE_TIMEOUT_S : POLL_INTERVAL_S);
+    if (watched) {
+        watch_disarm();
+    }
+}
+
+/* Bind the canvas, (re)creating it at width x height; falls back to
+ * drawing straight to the window if that fails */
+static void bind_canvas(int width, int height) {
+    if (g_canvas && (g_canvas_w != width || g_canvas_h != height)) {
+        nvgluDeleteFramebuffer(g_canvas);
+        g_canvas = NULL;
+    }
+    if (!g_canvas) {
+        g_canvas = nvgluCreateFramebuffer(g_nvg, width, height, 0);
+        g_canvas_w = width;
+        g_canvas_h = height;
+    }
+    nvgluBindFramebuffer(g_canvas);
+    glViewport(0, 0, width, height);
+}
+
 /* Platform callbacks for renderer */
 static void platform_begin_frame(void* user_data, int width, int height, float ratio) {
     (void)user_data;
     (void)ratio;
-    glViewport(0, 0, width, height);
+    bind_canvas(width, height);
     glClearColor(g_clear_color[0], g_clear_color[1], g_clear_color[2], g_clear_color[3]);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 }
 
+static void platform_begin_region(void* user_data, int width, int height, float ratio,
+                                  int x, int y, int w, int h) {
+    (void)user_data;
+    (void)ratio;
+    bind_canvas(width, height);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x, height - y - h, w, h);
+    glClearColor(g_clear_color[0], g_clear_color[1], g_clear_color[2], g_clear_color[3]);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+/* The canvas is never handed to the swap chain, so it is always exactly
+ * one frame old */
+static int platform_buffer_age(void* user_data) {
+    (void)user_data;
+    return g_canvas ? 1 : 0;
+}
+
 static void platform_end_frame(void* user_data) {
     (void)user_data;
+    nvgluBindFramebuffer(NULL);
 }
 
 static void platform_swap_buffers(void* user_data) {
     (void)user_data;
-    if (g_window) {
-        glfwSwapBuffers(g_window);
+    if (!g_window) return;
+
+    if (g_canvas) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, g_canvas->fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, g_canvas_w, g_canvas_h, 0, 0, g_canvas_w, g_canvas_h,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
+    glfwSwapBuffers(g_window);
+}
+
+/* From a decode thread: an image is ready, end the idle wait */
+static void platform_wake(void* user_data) {
+    (void)user_data;
+    glfwPostEmptyEvent();
 }
 
 scenic_platform_t scenic_platform_init(int width, int height, const char* title) {
@@ -134,7 +325,8 @@ scenic_platform_t scenic_platform_init(int width, int height, const char* title)
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
-    glfwWindowHint(GLFW_SAMPLES, 4);  /* MSAA */
+    /* No MSAA: NanoVG antialiases itself, and the canvas could not be
+     * blitted into a multisampled window */
 
     g_window = glfwCreateWindow(width, height, title ? title : "Scenic Renderer", NULL, NULL);
     if (!g_window) {
@@ -163,11 +355,15 @@ scenic_platform_t scenic_platform_init(int width, int height, const char* title)
     glfwSetMouseButtonCallback(g_window, mouse_button_callback);
     glfwSetScrollCallback(g_window, scroll_callback);
     glfwSetCursorEnterCallback(g_window, cursor_enter_callback);
+    glfwSetWindowRefreshCallback(g_window, refresh_callback);
 
     platform.user_data = NULL;
     platform.begin_frame = platform_begin_frame;
     platform.end_frame = platform_end_frame;
     platform.swap_buffers = platform_swap_buffers;
+    platform.buffer_age = platform_buffer_age;
+    platform.begin_region = platform_begin_region;
+    platform.wake = platform_wake;
 
     g_should_close = false;
 
@@ -184,17 +380,33 @@ void scenic_platform_run(scenic_renderer_t* renderer,
         scenic_renderer_set_nvg_context(renderer, g_nvg);
     }
 
-    while (!glfwWindowShouldClose(g_window) && !g_should_close) {
-        glfwPollEvents();
+    /* Frames are drawn only when owed, so an unchanged scene costs
+     * nothing but the occasional idle timeout */
+    watch_start(scenic_renderer_get_transport(renderer));
+    g_exposed = true;
 
+    while (!glfwWindowShouldClose(g_window) && !g_should_close) {
         if (callback) {
             callback(renderer, user_data);
         }
 
-        /* Render and swap */
-        scenic_renderer_render(renderer);
-        glfwSwapBuffers(g_window);
+        if (scenic_renderer_needs_render(renderer)) {
+            scenic_renderer_render(renderer);
+            scenic_renderer_stats_t stats = {0};
+            scenic_renderer_get_stats(renderer, &stats);
+            if (stats.pixels_redrawn > 0) {
+                g_exposed = true;
+            }
+        }
+        if (g_exposed) {
+            g_exposed = false;
+            platform_swap_buffers(NULL);
+        }
+
+        wait_for_work(renderer);
     }
+
+    watch_stop();
 }
 
 bool scenic_platform_should_close(void) {
@@ -203,9 +415,16 @@ bool scenic_platform_should_close(void) {
 
 void scenic_platform_request_close(void) {
     g_should_close = true;
+    if (g_window) {
+        glfwPostEmptyEvent();
+    }
 }
 
 void scenic_platform_shutdown(void) {
+    if (g_canvas) {
+        nvgluDeleteFramebuffer(g_canvas);
+        g_canvas = NULL;
+    }
     if (g_nvg) {
         nvgDeleteGL3(g_nvg);
         g_nvg = NULL;
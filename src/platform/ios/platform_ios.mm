@@ -132,6 +132,10 @@ static void ios_end_frame(void* user_data) {
     if (g_renderer && g_callback) {
         g_callback(g_renderer, g_user_data);
     }
+    /* Ticks with nothing owed do no GL work at all */
+    if (g_renderer && scenic_renderer_needs_render(g_renderer)) {
+        scenic_renderer_render(g_renderer);
+    }
 }
 @end
 
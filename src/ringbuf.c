@@ -0,0 +1,136 @@
+/*
+ * Byte ring buffer for framed protocol data
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "ringbuf.h"
+#include "utils.h"
+
+#ifdef __linux__
+static int ring_memfd(void) {
+#ifdef SYS_memfd_create
+    return (int)syscall(SYS_memfd_create, "scenic-ring", 1 /* MFD_CLOEXEC */);
+#else
+    return -1;
+#endif
+}
+
+/* Map the same pages at [base, base + size) and [base + size, base + 2 * size) */
+static uint8_t* map_mirrored(uint32_t size) {
+    int fd = ring_memfd();
+    if (fd < 0) return NULL;
+
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t* p_base = mmap(NULL, (size_t)size * 2, PROT_NONE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p_base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    void* p_lo = mmap(p_base, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_FIXED, fd, 0);
+    void* p_hi = mmap(p_base + size, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_FIXED, fd, 0);
+    close(fd);
+
+    if (p_lo != p_base || p_hi != p_base + size) {
+        munmap(p_base, (size_t)size * 2);
+        return NULL;
+    }
+    return p_base;
+}
+#endif
+
+bool ringbuf_init(ringbuf_t* p_ring, uint32_t size) {
+    memset(p_ring, 0, sizeof(*p_ring));
+
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) page = 4096;
+    size = ALIGN_UP(size, (uint32_t)page);
+
+#ifdef __linux__
+    p_ring->p_base = map_mirrored(size);
+    if (p_ring->p_base) {
+        p_ring->size = size;
+        p_ring->mirrored = true;
+        return true;
+    }
+#endif
+
+    p_ring->p_base = malloc(size);
+    if (!p_ring->p_base) return false;
+    p_ring->size = size;
+    p_ring->mirrored = false;
+    return true;
+}
+
+void ringbuf_free(ringbuf_t* p_ring) {
+    if (!p_ring->p_base) return;
+#ifdef __linux__
+    if (p_ring->mirrored) {
+        munmap(p_ring->p_base, (size_t)p_ring->size * 2);
+    } else {
+        free(p_ring->p_base);
+    }
+#else
+    free(p_ring->p_base);
+#endif
+    memset(p_ring, 0, sizeof(*p_ring));
+}
+
+void ringbuf_clear(ringbuf_t* p_ring) {
+    p_ring->head = 0;
+    p_ring->tail = 0;
+}
+
+uint8_t* ringbuf_write_ptr(ringbuf_t* p_ring, uint32_t* p_space) {
+    uint32_t used = ringbuf_used(p_ring);
+
+    if (p_ring->mirrored) {
+        *p_space = p_ring->size - used;
+        return p_ring->p_base + (p_ring->head % p_ring->size);
+    }
+
+    /* Linear fallback: head and tail are offsets into the buffer. Compact
+     * once the space left at the end gets small. */
+    if (p_ring->tail > 0 && p_ring->size - p_ring->head < p_ring->size / 4) {
+        memmove(p_ring->p_base, p_ring->p_base + p_ring->tail, used);
+        p_ring->tail = 0;
+        p_ring->head = used;
+    }
+    *p_space = p_ring->size - (uint32_t)p_ring->head;
+    return p_ring->p_base + p_ring->head;
+}
+
+void ringbuf_commit(ringbuf_t* p_ring, uint32_t len) {
+    p_ring->head += len;
+}
+
+const uint8_t* ringbuf_read_ptr(const ringbuf_t* p_ring, uint32_t* p_len) {
+    *p_len = ringbuf_used(p_ring);
+    if (p_ring->mirrored) {
+        return p_ring->p_base + (p_ring->tail % p_ring->size);
+    }
+    return p_ring->p_base + p_ring->tail;
+}
+
+void ringbuf_consume(ringbuf_t* p_ring, uint32_t len) {
+    p_ring->tail += len;
+    if (!p_ring->mirrored && p_ring->tail == p_ring->head) {
+        p_ring->head = 0;
+        p_ring->tail = 0;
+    }
+}
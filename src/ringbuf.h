@@ -0,0 +1,38 @@
+/*
+ * Byte ring buffer for framed protocol data
+ *
+ * Where the OS allows it the ring's pages are mapped twice back to back,
+ * so the readable and writable regions are always contiguous no matter
+ * where they wrap. Elsewhere it falls back to a linear buffer that is
+ * compacted when space runs out at the end.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _ringbuf_t {
+    uint8_t* p_base;
+    uint32_t size;
+    uint64_t head;      /* total bytes committed */
+    uint64_t tail;      /* total bytes consumed */
+    bool mirrored;
+} ringbuf_t;
+
+/* Size is rounded up to a whole number of pages */
+bool ringbuf_init(ringbuf_t* p_ring, uint32_t size);
+void ringbuf_free(ringbuf_t* p_ring);
+void ringbuf_clear(ringbuf_t* p_ring);
+
+static inline uint32_t ringbuf_used(const ringbuf_t* p_ring) {
+    return (uint32_t)(p_ring->head - p_ring->tail);
+}
+
+/* Contiguous free space to receive into; commit what was written */
+uint8_t* ringbuf_write_ptr(ringbuf_t* p_ring, uint32_t* p_space);
+void ringbuf_commit(ringbuf_t* p_ring, uint32_t len);
+
+/* Contiguous unread bytes; consume what was processed */
+const uint8_t* ringbuf_read_ptr(const ringbuf_t* p_ring, uint32_t* p_len);
+void ringbuf_consume(ringbuf_t* p_ring, uint32_t len);
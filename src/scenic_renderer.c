@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "scenic_renderer.h"
 #include "scenic_renderer_internal.h"
@@ -12,14 +15,37 @@
 #include "protocol.h"
 #include "comms.h"
 #include "script.h"
+#include "intern.h"
 #include "font.h"
 #include "image.h"
+#include "decode_pool.h"
+#include "asset_cache.h"
+#include "utils.h"
 
 /* Forward declarations */
 static void process_command(scenic_renderer_t* r, uint8_t type,
                            const uint8_t* payload, uint32_t len);
 static int send_event(scenic_renderer_t* r, uint8_t type,
                       const void* payload, uint32_t len);
+static void stream_abort(scenic_renderer_t* r);
+static void commit_coalesced(scenic_renderer_t* r);
+static void send_asset_status(scenic_renderer_t* r, uint8_t status,
+                              const uint8_t hash[SHA256_SIZE]);
+static void report_script_reject(scenic_renderer_t* r);
+
+/* Random-enough start so a restarted renderer never repeats a token */
+static uint64_t seed_generation(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t x = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    x ^= (uint64_t)getpid() << 40;
+
+    /* splitmix64 finalizer */
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
 
 scenic_renderer_t* scenic_renderer_create(const scenic_renderer_config_t* config) {
     scenic_renderer_t* r = calloc(1, sizeof(scenic_renderer_t));
@@ -29,7 +55,12 @@ scenic_renderer_t* scenic_renderer_create(const scenic_renderer_config_t* config
     r->height = config->height;
     r->pixel_ratio = config->pixel_ratio > 0 ? config->pixel_ratio : 1.0f;
     r->transport = config->transport;
+    r->was_connected = r->transport && r->transport->connected;
+    r->generation = seed_generation();
     r->platform = config->platform;
+    r->recv_budget_us = config->recv_budget_us;
+    r->damage_all = true;
+    r->render_pending = true;
 
     /* Initialize clear color to black */
     r->clear_color[0] = 0.0f;
@@ -46,24 +77,28 @@ scenic_renderer_t* scenic_renderer_create(const scenic_renderer_config_t* config
     r->global_tx[5] = 0.0f;
 
     /* Allocate buffers */
-    r->recv_buf_size = DEFAULT_RECV_BUF_SIZE;
-    r->recv_buf = malloc(r->recv_buf_size);
-    r->recv_buf_len = 0;
+    bool ring_ok = ringbuf_init(&r->recv_ring, DEFAULT_RECV_BUF_SIZE);
 
-    r->send_buf_size = DEFAULT_SEND_BUF_SIZE;
-    r->send_buf = malloc(r->send_buf_size);
+    r->event_flush_us = config->event_flush_us;
+    r->coalesce_input = config->coalesce_input;
+    ring_ok = ringbuf_init(&r->send_ring, DEFAULT_SEND_BUF_SIZE) && ring_ok;
 
-    if (!r->recv_buf || !r->send_buf) {
-        free(r->recv_buf);
-        free(r->send_buf);
+    if (!ring_ok) {
+        ringbuf_free(&r->recv_ring);
+        ringbuf_free(&r->send_ring);
         free(r);
         return NULL;
     }
 
     /* Initialize subsystems */
     init_scripts();
-    init_fonts();
-    init_images();
+    if (config->asset_cache_dir) {
+        asset_cache_init(config->asset_cache_dir);
+    }
+    set_image_retain(config->retain_image_pixels);
+    if (config->decode_threads > 0) {
+        decode_pool_start(config->decode_threads, r->platform.wake, r->platform.user_data);
+    }
 
     /* NanoVG context will be created lazily when GL is ready */
     r->nvg_ctx = NULL;
@@ -76,15 +111,19 @@ void scenic_renderer_destroy(scenic_renderer_t* r) {
     if (!r) return;
 
     /* Cleanup subsystems */
+    decode_pool_stop();
+    stream_abort(r);
     reset_scripts();
     if (r->nvg_ctx) {
         reset_fonts(r->nvg_ctx);
         reset_images(r->nvg_ctx);
         /* NanoVG context cleanup depends on backend, handled by platform */
     }
+    reset_ids();
+    asset_cache_done();
 
-    free(r->recv_buf);
-    free(r->send_buf);
+    ringbuf_free(&r->recv_ring);
+    ringbuf_free(&r->send_ring);
     free(r);
 }
 
@@ -95,6 +134,8 @@ void scenic_renderer_resize(scenic_renderer_t* r, int w, int h, float ratio) {
     if (ratio > 0) {
         r->pixel_ratio = ratio;
     }
+    r->damage_all = true;
+    r->render_pending = true;
 }
 
 /* Ensure NanoVG context is initialized */
@@ -105,21 +146,140 @@ static void ensure_nvg_context(scenic_renderer_t* r) {
      * For now, we expect it to be set externally or created in platform init */
 }
 
-int scenic_renderer_process_commands(scenic_renderer_t* r, int timeout_ms) {
-    if (!r || !r->transport) return -1;
+/* Finish or drop the streamed command once its last byte has arrived */
+static void stream_complete(scenic_renderer_t* r) {
+    stream_t* s = &r->stream;
+    r->streaming = false;
+    if (s->finish) {
+        s->finish(s, r->nvg_ctx);
+        /* Scripts track their own damage; a font or image may be in use
+         * anywhere */
+        if (r->stream_type != SCENIC_CMD_PUT_SCRIPT) {
+            r->damage_all = true;
+        }
+    }
+    memset(s, 0, sizeof(*s));
+    report_script_reject(r);
+}
+
+static void stream_abort(scenic_renderer_t* r) {
+    stream_t* s = &r->stream;
+    if (r->streaming && s->abort) {
+        s->abort(s, r->nvg_ctx);
+    }
+    r->streaming = false;
+    r->stream_remaining = 0;
+    memset(s, 0, sizeof(*s));
+}
+
+/* Hand streamed payload bytes to the active sink */
+static void stream_feed(scenic_renderer_t* r, const uint8_t* p, uint32_t len) {
+    stream_t* s = &r->stream;
+    if (s->write) {
+        s->write(s, p, len);
+    } else if (s->p_dest) {
+        uint32_t n = len < s->dest_left ? len : s->dest_left;
+        memcpy(s->p_dest, p, n);
+        s->p_dest += n;
+        s->dest_left -= n;
+    }
+
+    r->stream_remaining -= len;
+    if (r->stream_remaining == 0) {
+        stream_complete(r);
+    }
+}
+
+/*
+ * Start streaming a command whose payload can never fit in recv_ring.
+ * p_prefix holds the first prefix_len payload bytes, which must cover the
+ * command's sub-header and id. Returns how many of them were consumed.
+ */
+static uint32_t stream_begin(scenic_renderer_t* r, uint8_t type, const uint8_t* p_prefix,
+                             uint32_t prefix_len, uint32_t payload_len) {
+    stream_t* s = &r->stream;
+    memset(s, 0, sizeof(*s));
+    r->stream_type = type;
+
+    int remaining = (int)payload_len;
+    bool ok = false;
+    if (payload_len <= INT32_MAX) {
+        comms_set_buffer(p_prefix, prefix_len);
+        switch (type) {
+            case SCENIC_CMD_PUT_SCRIPT:
+                ok = put_script_stream_begin(&remaining, s);
+                break;
+            case SCENIC_CMD_PUT_FONT:
+                ok = r->nvg_ctx && put_font_stream_begin(&remaining, s);
+                break;
+            case SCENIC_CMD_PUT_IMAGE:
+                ok = r->nvg_ctx && put_image_stream_begin(&remaining, s);
+                break;
+            case SCENIC_CMD_PUT_IMAGE_REGION:
+                ok = r->nvg_ctx && put_image_region_stream_begin(&remaining, s, r->nvg_ctx);
+                break;
+        }
+    }
+
+    if (!ok) {
+        /* Drop the rest of the payload */
+        char msg[80];
+        snprintf(msg, sizeof(msg), "Dropping oversized command 0x%02x (%u bytes)",
+                 type, payload_len);
+        log_warn(msg);
+        memset(s, 0, sizeof(*s));
+        if (payload_len > INT32_MAX) {
+            remaining = 0;
+        }
+    }
 
+    uint32_t consumed = ok ? payload_len - (uint32_t)remaining : 0;
+    r->streaming = true;
+    r->stream_remaining = payload_len - consumed;
+    if (r->stream_remaining == 0) {
+        stream_complete(r);
+    }
+    return consumed;
+}
+
+/* One read from the transport plus dispatch of every complete command.
+ * Sets *p_bytes to the number of bytes read (0 when nothing was pending). */
+static int receive_batch(scenic_renderer_t* r, int timeout_ms, int* p_bytes) {
     int commands_processed = 0;
+    *p_bytes = 0;
 
     /* Check if data is available */
     if (!scenic_transport_data_available(r->transport, timeout_ms)) {
         return 0;
     }
 
-    /* Read available data into buffer */
+    stream_t* s = &r->stream;
+    if (r->streaming && ringbuf_used(&r->recv_ring) == 0 && !s->write && s->p_dest && s->dest_left > 0) {
+        /* Raw streamed payload: receive straight into its destination */
+        uint32_t want = s->dest_left < r->stream_remaining ? s->dest_left : r->stream_remaining;
+        int bytes_read = scenic_transport_recv(r->transport, s->p_dest, want, 0);
+        if (bytes_read < 0) {
+            return -1;
+        }
+
+        *p_bytes = bytes_read;
+        s->p_dest += bytes_read;
+        s->dest_left -= bytes_read;
+        r->stream_remaining -= bytes_read;
+        if (r->stream_remaining == 0) {
+            stream_complete(r);
+            commands_processed++;
+        }
+        return commands_processed;
+    }
+
+    /* Read available data into the ring */
+    uint32_t space;
+    uint8_t* p_write = ringbuf_write_ptr(&r->recv_ring, &space);
     int bytes_read = scenic_transport_recv(
         r->transport,
-        r->recv_buf + r->recv_buf_len,
-        r->recv_buf_size - r->recv_buf_len,
+        p_write,
+        space,
         0  /* Non-blocking since we know data is available */
     );
 
@@ -127,42 +287,159 @@ int scenic_renderer_process_commands(scenic_renderer_t* r, int timeout_ms) {
         return -1;
     }
 
-    r->recv_buf_len += bytes_read;
+    *p_bytes = bytes_read;
+    ringbuf_commit(&r->recv_ring, bytes_read);
+
+    /* Process complete commands in place; the ring keeps them contiguous */
+    uint32_t buf_len;
+    const uint8_t* buf = ringbuf_read_ptr(&r->recv_ring, &buf_len);
+    uint32_t offset = 0;
+    while (offset < buf_len) {
+        uint32_t avail = buf_len - offset;
+
+        if (r->streaming) {
+            uint32_t n = avail < r->stream_remaining ? avail : r->stream_remaining;
+            stream_feed(r, buf + offset, n);
+            offset += n;
+            if (!r->streaming) {
+                commands_processed++;
+            }
+            continue;
+        }
 
-    /* Process complete commands */
-    int offset = 0;
-    while (offset < r->recv_buf_len) {
         uint8_t type;
         uint32_t payload_len;
 
-        if (!protocol_parse_header(r->recv_buf + offset, r->recv_buf_len - offset,
+        if (!protocol_parse_header(buf + offset, avail,
                                    &type, &payload_len)) {
             break;  /* Need more data for header */
         }
 
-        int total_msg_len = SCENIC_MSG_HEADER_SIZE + payload_len;
-        if (r->recv_buf_len - offset < total_msg_len) {
+        if (payload_len > r->recv_ring.size - SCENIC_MSG_HEADER_SIZE) {
+            /* Too large to ever frame in the ring; stream it instead */
+            uint32_t prefix_len = avail - SCENIC_MSG_HEADER_SIZE;
+            if (prefix_len < STREAM_PREFIX_SIZE) {
+                break;  /* Need more data for the sub-header */
+            }
+            offset += SCENIC_MSG_HEADER_SIZE;
+            offset += stream_begin(r, type, buf + offset, prefix_len, payload_len);
+            if (!r->streaming) {
+                commands_processed++;
+            }
+            continue;
+        }
+
+        uint32_t total_msg_len = SCENIC_MSG_HEADER_SIZE + payload_len;
+        if (avail < total_msg_len) {
             break;  /* Need more data for payload */
         }
 
         /* Process this command */
         process_command(r, type,
-                       r->recv_buf + offset + SCENIC_MSG_HEADER_SIZE,
+                       buf + offset + SCENIC_MSG_HEADER_SIZE,
                        payload_len);
         commands_processed++;
 
         offset += total_msg_len;
     }
 
-    /* Move remaining data to start of buffer */
-    if (offset > 0 && offset < r->recv_buf_len) {
-        memmove(r->recv_buf, r->recv_buf + offset, r->recv_buf_len - offset);
-    }
-    r->recv_buf_len -= offset;
+    ringbuf_consume(&r->recv_ring, offset);
 
     return commands_processed;
 }
 
+/* Greet a driver that connected since the last call. When one goes
+ * away, only per-connection state is dropped: scripts, fonts and images
+ * stay, and READY tells the next driver whether they are still valid. */
+static void track_connection(scenic_renderer_t* r) {
+    bool connected = r->transport->connected;
+    if (connected == r->was_connected) return;
+    r->was_connected = connected;
+
+    /* Half-received commands and unsent events belong to the old driver;
+     * events raised while nobody was listening are stale */
+    stream_abort(r);
+    ringbuf_clear(&r->recv_ring);
+    ringbuf_clear(&r->send_ring);
+    r->cursor_pending = false;
+    r->scroll_pending = false;
+
+    if (!connected) {
+        log_info("Driver disconnected; keeping scene for reconnect");
+        return;
+    }
+    scenic_renderer_send_ready(r);
+    scenic_renderer_send_reshape(r, r->width, r->height);
+}
+
+/* Upload what the decode pool has finished; the frame that shows it is owed */
+static void finish_decodes(scenic_renderer_t* r) {
+    if (!r->nvg_ctx) return;
+    int decoded = finish_image_decodes(r->nvg_ctx);
+    if (decoded > 0) {
+        r->stats.images_decoded += decoded;
+        r->damage_all = true;
+        r->render_pending = true;
+    }
+}
+
+int scenic_renderer_process_commands(scenic_renderer_t* r, int timeout_ms) {
+    if (!r || !r->transport) return -1;
+
+    /* Events raised since the last frame go out in one batch */
+    track_connection(r);
+    scenic_renderer_flush_events(r);
+
+    scenic_renderer_stats_t* stats = &r->stats;
+    uint64_t start = monotonic_us();
+    uint64_t elapsed = 0;
+
+    stats->bytes_received = 0;
+    stats->commands_processed = 0;
+    stats->reads = 0;
+    stats->budget_exhausted = false;
+
+    for (;;) {
+        int bytes_read;
+        int processed = receive_batch(r, timeout_ms, &bytes_read);
+        track_connection(r);
+        if (processed < 0) {
+            /* A server transport that dropped its driver listens again */
+            if (r->transport->connected) {
+                return -1;
+            }
+            break;
+        }
+
+        stats->commands_processed += processed;
+        if (bytes_read > 0) {
+            stats->bytes_received += bytes_read;
+            stats->reads++;
+        }
+
+        /* Only the first read may block; the rest drain what is queued */
+        timeout_ms = 0;
+        elapsed = monotonic_us() - start;
+        if (r->recv_budget_us == 0 || bytes_read == 0) {
+            break;
+        }
+        if (elapsed >= r->recv_budget_us) {
+            stats->budget_exhausted = true;
+            break;
+        }
+    }
+
+    stats->elapsed_us = (uint32_t)elapsed;
+    finish_decodes(r);
+    return (int)stats->commands_processed;
+}
+
+void scenic_renderer_set_recv_budget(scenic_renderer_t* r, uint32_t budget_us) {
+    if (r) {
+        r->recv_budget_us = budget_us;
+    }
+}
+
 static void process_command(scenic_renderer_t* r, uint8_t type,
                            const uint8_t* payload, uint32_t len) {
     ensure_nvg_context(r);
@@ -198,8 +475,27 @@ static void process_command(scenic_renderer_t* r, uint8_t type,
             scenic_renderer_cmd_put_image(r, payload, len);
             break;
 
+        case SCENIC_CMD_PUT_IMAGE_REGION:
+            scenic_renderer_cmd_put_image_region(r, payload, len);
+            break;
+
+        case SCENIC_CMD_PUT_FONT_HASH:
+        case SCENIC_CMD_PUT_IMAGE_HASH: {
+            int status = type == SCENIC_CMD_PUT_FONT_HASH
+                ? scenic_renderer_cmd_put_font_hash(r, payload, len)
+                : scenic_renderer_cmd_put_image_hash(r, payload, len);
+            if (status >= 0) {
+                send_asset_status(r, (uint8_t)status, r->asset_hash);
+            }
+            break;
+        }
+
         case SCENIC_CMD_RENDER:
-            scenic_renderer_render(r);
+            /* Drawn by the platform loop, once however many arrive */
+            if (r->render_pending) {
+                r->stats.renders_coalesced++;
+            }
+            r->render_pending = true;
             break;
 
         case SCENIC_CMD_GLOBAL_TX:
@@ -232,10 +528,11 @@ static void process_command(scenic_renderer_t* r, uint8_t type,
 void scenic_renderer_cmd_clear_color(scenic_renderer_t* r, float red, float green,
                                      float blue, float alpha) {
     if (!r) return;
-    r->clear_color[0] = red;
-    r->clear_color[1] = green;
-    r->clear_color[2] = blue;
-    r->clear_color[3] = alpha;
+    float color[4] = { red, green, blue, alpha };
+    if (memcmp(r->clear_color, color, sizeof(color)) != 0) {
+        memcpy(r->clear_color, color, sizeof(color));
+        r->damage_all = true;
+    }
 }
 
 void scenic_renderer_cmd_put_script(scenic_renderer_t* r, const uint8_t* data, uint32_t len) {
@@ -243,6 +540,7 @@ void scenic_renderer_cmd_put_script(scenic_renderer_t* r, const uint8_t* data, u
     int remaining = (int)len;
     comms_set_buffer(data, remaining);
     put_script(&remaining);
+    report_script_reject(r);
 }
 
 void scenic_renderer_cmd_del_script(scenic_renderer_t* r, const uint8_t* data, uint32_t len) {
@@ -254,11 +552,14 @@ void scenic_renderer_cmd_del_script(scenic_renderer_t* r, const uint8_t* data, u
 
 void scenic_renderer_cmd_reset(scenic_renderer_t* r) {
     if (!r) return;
+    r->generation++;
+    r->damage_all = true;
     reset_scripts();
     if (r->nvg_ctx) {
         reset_fonts(r->nvg_ctx);
         reset_images(r->nvg_ctx);
     }
+    reset_ids();
 }
 
 void scenic_renderer_cmd_put_font(scenic_renderer_t* r, const uint8_t* data, uint32_t len) {
@@ -266,6 +567,7 @@ void scenic_renderer_cmd_put_font(scenic_renderer_t* r, const uint8_t* data, uin
     int remaining = (int)len;
     comms_set_buffer(data, remaining);
     put_font(&remaining, r->nvg_ctx);
+    r->damage_all = true;
 }
 
 void scenic_renderer_cmd_put_image(scenic_renderer_t* r, const uint8_t* data, uint32_t len) {
@@ -273,35 +575,171 @@ void scenic_renderer_cmd_put_image(scenic_renderer_t* r, const uint8_t* data, ui
     int remaining = (int)len;
     comms_set_buffer(data, remaining);
     put_image(&remaining, r->nvg_ctx);
+    r->damage_all = true;
+}
+
+void scenic_renderer_cmd_put_image_region(scenic_renderer_t* r, const uint8_t* data, uint32_t len) {
+    if (!r || !r->nvg_ctx || !data || len == 0) return;
+    int remaining = (int)len;
+    comms_set_buffer(data, remaining);
+    put_image_region(&remaining, r->nvg_ctx);
+    r->damage_all = true;
+}
+
+static int count_asset_status(scenic_renderer_t* r, int status) {
+    if (status == ASSET_HAVE) {
+        r->stats.assets_have++;
+        r->damage_all = true;
+    } else if (status == ASSET_MISSING) {
+        r->stats.assets_missing++;
+    }
+    return status;
+}
+
+int scenic_renderer_cmd_put_font_hash(scenic_renderer_t* r, const uint8_t* data, uint32_t len) {
+    if (!r || !data || len == 0) return -1;
+    int remaining = (int)len;
+    comms_set_buffer(data, remaining);
+    return count_asset_status(r, put_font_hash(&remaining, r->nvg_ctx, r->asset_hash));
+}
+
+int scenic_renderer_cmd_put_image_hash(scenic_renderer_t* r, const uint8_t* data, uint32_t len) {
+    if (!r || !data || len == 0) return -1;
+    int remaining = (int)len;
+    comms_set_buffer(data, remaining);
+    return count_asset_status(r, put_image_hash(&remaining, r->nvg_ctx, r->asset_hash));
 }
 
 void scenic_renderer_cmd_global_tx(scenic_renderer_t* r, const float tx[6]) {
     if (!r) return;
-    memcpy(r->global_tx, tx, sizeof(r->global_tx));
+    if (memcmp(r->global_tx, tx, sizeof(r->global_tx)) != 0) {
+        memcpy(r->global_tx, tx, sizeof(r->global_tx));
+        r->damage_all = true;
+    }
+}
+
+/*
+ * Work out which part of the window this frame redraws (x0 y0 x1 y1, in
+ * the units of width and height). Returns false for the whole window.
+ */
+static bool frame_region(scenic_renderer_t* r, int region[4]) {
+    float changed[4];
+    bool bounded = take_damage(changed) && !r->damage_all;
+    r->damage_all = false;
+
+    int now[4] = { 0, 0, r->width, r->height };
+    if (bounded && changed[0] > changed[2]) {
+        memset(now, 0, sizeof(now));
+    } else if (bounded) {
+        /* Round outward, allowing for the antialiasing fringe */
+        now[0] = (int)fmaxf(0.0f, floorf(changed[0]) - 1);
+        now[1] = (int)fmaxf(0.0f, floorf(changed[1]) - 1);
+        now[2] = (int)fminf((float)r->width, ceilf(changed[2]) + 1);
+        now[3] = (int)fminf((float)r->height, ceilf(changed[3]) + 1);
+        if (now[0] >= now[2] || now[1] >= now[3]) {
+            memset(now, 0, sizeof(now));
+        }
+    }
+
+    int age = 0;
+    if (r->platform.buffer_age && r->platform.begin_region) {
+        age = r->platform.buffer_age(r->platform.user_data);
+    }
+
+    /* The back buffer also lacks whatever the frames since it changed */
+    bool partial = bounded && age >= 1 && age <= DAMAGE_HISTORY + 1;
+    if (partial) {
+        memcpy(region, now, sizeof(now));
+    } else {
+        region[0] = region[1] = 0;
+        region[2] = r->width;
+        region[3] = r->height;
+    }
+    for (int i = 0; partial && i < age - 1; i++) {
+        const int* p_old = r->damage_history[i];
+        if (p_old[0] >= p_old[2]) continue;
+        if (region[0] >= region[2]) {
+            memcpy(region, p_old, sizeof(now));
+            continue;
+        }
+        if (p_old[0] < region[0]) region[0] = p_old[0];
+        if (p_old[1] < region[1]) region[1] = p_old[1];
+        if (p_old[2] > region[2]) region[2] = p_old[2];
+        if (p_old[3] > region[3]) region[3] = p_old[3];
+    }
+
+    /* A skipped frame is not presented, so it takes no history slot */
+    if (!partial || region[0] < region[2]) {
+        memmove(r->damage_history[1], r->damage_history[0],
+                sizeof(r->damage_history) - sizeof(r->damage_history[0]));
+        memcpy(r->damage_history[0], now, sizeof(now));
+    }
+    return partial;
+}
+
+bool scenic_renderer_needs_render(const scenic_renderer_t* r) {
+    return r && r->render_pending;
+}
+
+void scenic_renderer_request_render(scenic_renderer_t* r) {
+    if (r) {
+        r->render_pending = true;
+    }
 }
 
 void scenic_renderer_render(scenic_renderer_t* r) {
     if (!r || !r->nvg_ctx || r->width <= 0 || r->height <= 0) return;
+    finish_decodes(r);
+    r->render_pending = false;
+
+    int region[4];
+    bool partial = frame_region(r, region);
+    if (partial && region[0] >= region[2]) {
+        /* Nothing changed since the back buffer was drawn */
+        r->stats.scripts_drawn = 0;
+        r->stats.scripts_culled = 0;
+        r->stats.ops_drawn = 0;
+        r->stats.ops_culled = 0;
+        r->stats.shapes_reused = 0;
+        r->stats.texts_reused = 0;
+        r->stats.pixels_redrawn = 0;
+        return;
+    }
+    r->stats.pixels_redrawn = (uint32_t)(region[2] - region[0]) * (uint32_t)(region[3] - region[1]);
 
     /* Begin frame - platform handles GL state */
-    if (r->platform.begin_frame) {
+    if (partial) {
+        r->platform.begin_region(r->platform.user_data, r->width, r->height, r->pixel_ratio,
+                                 region[0], region[1],
+                                 region[2] - region[0], region[3] - region[1]);
+    } else if (r->platform.begin_frame) {
         r->platform.begin_frame(r->platform.user_data, r->width, r->height, r->pixel_ratio);
     }
 
     /* Begin NanoVG frame */
     nvgBeginFrame(r->nvg_ctx, r->width, r->height, r->pixel_ratio);
 
+    /* Keep a partial frame inside its region */
+    float clip[4] = { region[0], region[1], region[2], region[3] };
+    if (partial) {
+        nvgScissor(r->nvg_ctx, clip[0], clip[1], clip[2] - clip[0], clip[3] - clip[1]);
+    }
+
     /* Apply global transform */
     nvgTransform(r->nvg_ctx,
                  r->global_tx[0], r->global_tx[1],
                  r->global_tx[2], r->global_tx[3],
                  r->global_tx[4], r->global_tx[5]);
 
-    /* Render root script */
-    sid_t root_id;
-    root_id.p_data = "_root_";
-    root_id.size = 6;
-    render_script(root_id, r->nvg_ctx);
+    /* Render the scene from _root_ down */
+    render_counts_t counts;
+    render_root(r->nvg_ctx, r->width, r->height, partial ? clip : NULL, &counts);
+    r->stats.scripts_drawn = counts.scripts_drawn;
+    r->stats.scripts_culled = counts.scripts_culled;
+    r->stats.ops_drawn = counts.ops_drawn;
+    r->stats.ops_culled = counts.ops_culled;
+    r->stats.shapes_reused = counts.shapes_reused;
+    r->stats.texts_reused = counts.texts_reused;
 
     /* End NanoVG frame */
     nvgEndFrame(r->nvg_ctx);
@@ -314,19 +752,105 @@ void scenic_renderer_render(scenic_renderer_t* r) {
 
 /* Event sending */
 
+static void emit_cursor_pos(scenic_renderer_t* r, float x, float y) {
+    uint8_t payload[8];
+    float fx = hton_f32(x);
+    float fy = hton_f32(y);
+    memcpy(payload, &fx, 4);
+    memcpy(payload + 4, &fy, 4);
+    send_event(r, SCENIC_EVT_CURSOR_POS, payload, 8);
+}
+
+static void emit_scroll(scenic_renderer_t* r, float xoff, float yoff, float x, float y) {
+    uint8_t payload[16];
+    float fxoff = hton_f32(xoff);
+    float fyoff = hton_f32(yoff);
+    float fx = hton_f32(x);
+    float fy = hton_f32(y);
+    memcpy(payload, &fxoff, 4);
+    memcpy(payload + 4, &fyoff, 4);
+    memcpy(payload + 8, &fx, 4);
+    memcpy(payload + 12, &fy, 4);
+    send_event(r, SCENIC_EVT_SCROLL, payload, 16);
+}
+
+/* Queue the held-back CURSOR_POS and SCROLL, in that order */
+static void commit_coalesced(scenic_renderer_t* r) {
+    if (r->cursor_pending) {
+        r->cursor_pending = false;
+        emit_cursor_pos(r, r->cursor_x, r->cursor_y);
+    }
+    if (r->scroll_pending) {
+        r->scroll_pending = false;
+        emit_scroll(r, r->scroll_dx, r->scroll_dy, r->scroll_x, r->scroll_y);
+    }
+}
+
+void scenic_renderer_flush_events(scenic_renderer_t* r) {
+    if (!r || !r->transport || !r->transport->connected) return;
+
+    commit_coalesced(r);
+
+    uint32_t len;
+    const uint8_t* p = ringbuf_read_ptr(&r->send_ring, &len);
+    if (len == 0) return;
+
+    /* The ring keeps queued events contiguous, so one send covers them all */
+    int sent = scenic_transport_send(r->transport, p, len);
+    r->stats.event_flushes++;
+    if (sent <= 0) return;
+
+    /* A short write leaves the tail queued for the next flush */
+    ringbuf_consume(&r->send_ring, (uint32_t)sent);
+    r->stats.bytes_sent += sent;
+    r->send_oldest_us = monotonic_us();
+}
+
 static int send_event(scenic_renderer_t* r, uint8_t type,
                       const void* payload, uint32_t len) {
     if (!r || !r->transport) return -1;
 
-    int msg_len = protocol_encode_event(r->send_buf, r->send_buf_size,
-                                        type, payload, len);
-    if (msg_len < 0) return -1;
+    /* Held-back motion must go out before anything it used to precede */
+    if (type != SCENIC_EVT_CURSOR_POS && type != SCENIC_EVT_SCROLL) {
+        commit_coalesced(r);
+    }
+
+    uint32_t space;
+    uint8_t* p = ringbuf_write_ptr(&r->send_ring, &space);
+    if (space < SCENIC_MSG_HEADER_SIZE + len) {
+        scenic_renderer_flush_events(r);
+        p = ringbuf_write_ptr(&r->send_ring, &space);
+    }
+
+    int msg_len = protocol_encode_event(p, space, type, payload, len);
+    if (msg_len < 0) {
+        /* Bounded queue: drop rather than grow while the driver is stalled */
+        r->stats.events_dropped++;
+        return -1;
+    }
 
-    return scenic_transport_send(r->transport, r->send_buf, msg_len);
+    uint64_t now = monotonic_us();
+    if (ringbuf_used(&r->send_ring) == 0) {
+        r->send_oldest_us = now;
+    }
+    ringbuf_commit(&r->send_ring, msg_len);
+    r->stats.events_queued++;
+
+    if (now - r->send_oldest_us >= r->event_flush_us) {
+        scenic_renderer_flush_events(r);
+    }
+    return 0;
 }
 
 void scenic_renderer_send_ready(scenic_renderer_t* r) {
-    send_event(r, SCENIC_EVT_READY, NULL, 0);
+    if (!r) return;
+    uint8_t payload[8];
+    uint32_t hi = hton_ui32((uint32_t)(r->generation >> 32));
+    uint32_t lo = hton_ui32((uint32_t)r->generation);
+    memcpy(payload, &hi, 4);
+    memcpy(payload + 4, &lo, 4);
+    send_event(r, SCENIC_EVT_READY, payload, 8);
+    scenic_renderer_flush_events(r);
 }
 
 void scenic_renderer_send_reshape(scenic_renderer_t* r, int width, int height) {
@@ -336,6 +860,23 @@ void scenic_renderer_send_reshape(scenic_renderer_t* r, int width, int height) {
     memcpy(payload, &w, 4);
     memcpy(payload + 4, &h, 4);
     send_event(r, SCENIC_EVT_RESHAPE, payload, 8);
+    scenic_renderer_flush_events(r);
+}
+
+static void send_asset_status(scenic_renderer_t* r, uint8_t status,
+                              const uint8_t hash[SHA256_SIZE]) {
+    uint8_t payload[1 + SHA256_SIZE];
+    payload[0] = status;
+    memcpy(payload + 1, hash, SHA256_SIZE);
+    send_event(r, SCENIC_EVT_ASSET_STATUS, payload, sizeof(payload));
+}
+
+/* Tell the driver a script failed verification; it was not stored */
+static void report_script_reject(scenic_renderer_t* r) {
+    char msg[160];
+    if (!take_script_reject(msg, sizeof(msg))) return;
+    r->stats.scripts_rejected++;
+    send_event(r, SCENIC_EVT_LOG_ERROR, msg, (uint32_t)strlen(msg));
 }
 
 void scenic_renderer_send_touch(scenic_renderer_t* r, int action, float x, float y) {
@@ -388,25 +929,36 @@ void scenic_renderer_send_mouse_button(scenic_renderer_t* r, uint32_t button, ui
 }
 
 void scenic_renderer_send_cursor_pos(scenic_renderer_t* r, float x, float y) {
-    uint8_t payload[8];
-    float fx = hton_f32(x);
-    float fy = hton_f32(y);
-    memcpy(payload, &fx, 4);
-    memcpy(payload + 4, &fy, 4);
-    send_event(r, SCENIC_EVT_CURSOR_POS, payload, 8);
+    if (r && r->coalesce_input) {
+        /* Only the latest position matters */
+        if (r->cursor_pending) {
+            r->stats.events_coalesced++;
+        }
+        r->cursor_pending = true;
+        r->cursor_x = x;
+        r->cursor_y = y;
+        return;
+    }
+    emit_cursor_pos(r, x, y);
 }
 
 void scenic_renderer_send_scroll(scenic_renderer_t* r, float xoff, float yoff, float x, float y) {
-    uint8_t payload[16];
-    float fxoff = hton_f32(xoff);
-    float fyoff = hton_f32(yoff);
-    float fx = hton_f32(x);
-    float fy = hton_f32(y);
-    memcpy(payload, &fxoff, 4);
-    memcpy(payload + 4, &fyoff, 4);
-    memcpy(payload + 8, &fx, 4);
-    memcpy(payload + 12, &fy, 4);
-    send_event(r, SCENIC_EVT_SCROLL, payload, 16);
+    if (r && r->coalesce_input) {
+        /* Deltas add up; the position is the latest one */
+        if (r->scroll_pending) {
+            r->stats.events_coalesced++;
+            r->scroll_dx += xoff;
+            r->scroll_dy += yoff;
+        } else {
+            r->scroll_dx = xoff;
+            r->scroll_dy = yoff;
+        }
+        r->scroll_pending = true;
+        r->scroll_x = x;
+        r->scroll_y = y;
+        return;
+    }
+    emit_scroll(r, xoff, yoff, x, y);
 }
 
 void scenic_renderer_send_cursor_enter(scenic_renderer_t* r, bool entered) {
@@ -420,6 +972,10 @@ void* scenic_renderer_get_nvg_context(scenic_renderer_t* r) {
     return r ? r->nvg_ctx : NULL;
 }
 
+scenic_transport_t* scenic_renderer_get_transport(scenic_renderer_t* r) {
+    return r ? r->transport : NULL;
+}
+
 void scenic_renderer_get_size(scenic_renderer_t* r, int* width, int* height, float* ratio) {
     if (!r) return;
     if (width) *width = r->width;
@@ -427,10 +983,39 @@ void scenic_renderer_get_size(scenic_renderer_t* r, int* width, int* height, flo
     if (ratio) *ratio = r->pixel_ratio;
 }
 
+void scenic_renderer_set_input_coalescing(scenic_renderer_t* r, bool enabled) {
+    if (!r) return;
+    if (!enabled) {
+        commit_coalesced(r);
+    }
+    r->coalesce_input = enabled;
+}
+
+uint64_t scenic_renderer_get_generation(const scenic_renderer_t* r) {
+    return r ? r->generation : 0;
+}
+
+void scenic_renderer_get_stats(scenic_renderer_t* r, scenic_renderer_stats_t* stats) {
+    if (!r || !stats) return;
+    *stats = r->stats;
+
+    script_store_stats_t store;
+    get_script_store_stats(&store);
+    stats->scripts_replaced_in_place = store.replaced_in_place;
+    stats->script_allocs = store.sys_allocs;
+    stats->image_bytes_retained = retained_image_bytes();
+}
+
 /* Allow platform to set NanoVG context after GL initialization */
 void scenic_renderer_set_nvg_context(scenic_renderer_t* r, NVGcontext* ctx) {
     if (r) {
+        /* Replacing a lost context: its textures went with it */
+        if (r->nvg_ctx && ctx && ctx != r->nvg_ctx) {
+            restore_images(ctx);
+        }
         r->nvg_ctx = ctx;
         r->initialized = true;
+        r->damage_all = true;
+        r->render_pending = true;
     }
 }
@@ -6,8 +6,12 @@
 
 #include "scenic_renderer.h"
 #include "types.h"
+#include "ringbuf.h"
 #include "nanovg/nanovg.h"
 
+/* Frames of redraw regions kept for back buffers with an age above 1 */
+#define DAMAGE_HISTORY 4
+
 /* Internal renderer state */
 struct scenic_renderer {
     int width;
@@ -21,18 +25,60 @@ struct scenic_renderer {
     float clear_color[4];
     float global_tx[6];
 
-    /* Receive buffer for commands */
-    uint8_t* recv_buf;
-    int recv_buf_size;
-    int recv_buf_len;
+    /* Redraw regions (x0 y0 x1 y1) of recent frames, newest first, so a
+     * back buffer that is several frames old can be brought up to date */
+    int damage_history[DAMAGE_HISTORY][4];
+    bool damage_all;            /* something outside the scripts changed */
+
+    /* A frame is owed: RENDER arrived, or the window changed. Any number
+     * of RENDERs before the next scenic_renderer_render fold into it. */
+    bool render_pending;
+
+    /* Receive ring for commands; frames are always contiguous in it */
+    ringbuf_t recv_ring;
+
+    /* Drain budget for process_commands, 0 for a single read */
+    uint32_t recv_budget_us;
+
+    /* Command whose payload does not fit recv_ring; streamed into place */
+    stream_t stream;
+    uint32_t stream_remaining;
+    uint8_t stream_type;
+    bool streaming;
+
+    /* Outbound event queue, flushed once per frame or at the deadline */
+    ringbuf_t send_ring;
+    uint32_t event_flush_us;
+    uint64_t send_oldest_us;    /* enqueue time of the oldest unsent event */
 
-    /* Send buffer for events */
-    uint8_t* send_buf;
-    int send_buf_size;
+    /* Input coalescing: latest cursor position and summed scroll deltas
+     * are held back until the next flush or an order-sensitive event */
+    bool coalesce_input;
+    bool cursor_pending;
+    float cursor_x, cursor_y;
+    bool scroll_pending;
+    float scroll_dx, scroll_dy;
+    float scroll_x, scroll_y;
+
+    scenic_renderer_stats_t stats;
+
+    /* Transport state seen last call; a rising edge greets the driver */
+    bool was_connected;
+
+    /* Scene generation advertised in READY. Tables survive reconnects, so
+     * it only changes when they are cleared (RESET) or on a new process. */
+    uint64_t generation;
+
+    /* Hash named by the last PUT_*_HASH, echoed in ASSET_STATUS */
+    uint8_t asset_hash[32];
 
     bool initialized;
 };
 
 /* Default buffer sizes */
 #define DEFAULT_RECV_BUF_SIZE (256 * 1024)  /* 256KB */
-#define DEFAULT_SEND_BUF_SIZE (4 * 1024)    /* 4KB */
+#define DEFAULT_SEND_BUF_SIZE (64 * 1024)   /* 64KB of queued events */
+
+/* Payload bytes buffered before an oversized command starts streaming;
+ * enough to hold its sub-header and id */
+#define STREAM_PREFIX_SIZE (4 * 1024)
@@ -3,95 +3,1176 @@
  *
  * Based on original code by Boyd Multerer
  * Copyright 2021 Kry10 Limited. All rights reserved.
+ *
+ * Scripts arrive as big-endian wire ops and are compiled once, at put
+ * time, into an array of native 32-bit words: a (op << 16) | param header
+ * followed by byte-swapped float operands, raw color words, and, for ops
+ * that name a font, image or child script, the id's interned handle (see
+ * intern.h). Scripts are verified before compiling, so render_script
+ * walks that array without any checks; a rejected script keeps the
+ * previous version of its id.
+ *
+ * Records live in a size-class slab and are found by handle. A
+ * replacement that fits in the block of the version it replaces is
+ * compiled over it in place, so the handle table is not touched and
+ * re-putting animated scripts every frame allocates nothing.
  */
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "types.h"
 #include "utils.h"
 #include "comms.h"
 #include "script.h"
+#include "slab.h"
+#include "intern.h"
 #include "image.h"
 #include "font.h"
+#include "text_layout.h"
+
+/* One compiled word: op header, native float, or raw bytes (colors, ids) */
+typedef union {
+    uint32_t u;
+    float f;
+    uint8_t b[4];
+} script_word_t;
 
 typedef struct _script_t {
-    sid_t id;
-    data_t script;
-    tommy_hashlin_node node;
+    uint32_t handle;
+    script_word_t* p_code;
+    uint32_t code_words;
+    uint32_t capacity;      /* bytes in the record's slab block */
+    uint32_t link_epoch;    /* draw list build it was last linked into */
+    bool linking;           /* on the path being flattened */
 } script_t;
 
-#define HASH_ID(id) tommy_hash_u32(0, id.p_data, id.size)
+/* Wire bytes staged while a streamed put is in flight */
+typedef struct {
+    sid_t id;
+    data_t wire;
+} script_src_t;
+
+static id_table_t scripts = {0};
+static slab_t script_slab = {0};
+static script_store_stats_t store_stats = {0};
 
-static tommy_hashlin scripts = {0};
+/* Why the last put was rejected, until take_script_reject */
+static char reject_msg[160];
 
 void init_scripts(void) {
-    tommy_hashlin_init(&scripts);
+    slab_init(&script_slab);
 }
 
-static int _comparator(const void* p_arg, const void* p_obj) {
-    const sid_t* p_id = p_arg;
-    const script_t* p_script = p_obj;
-    return (p_id->size != p_script->id.size)
-        || memcmp(p_id->p_data, p_script->id.p_data, p_id->size);
+static inline script_t* get_script(uint32_t handle) {
+    return id_table_get(&scripts, handle);
 }
 
-static script_t* get_script(sid_t id) {
-    return tommy_hashlin_search(
-        &scripts,
-        _comparator,
-        &id,
-        HASH_ID(id)
-    );
-}
+static void relink(script_t* p_old, script_t* p_new);
+static void release_refs(const script_word_t* p_code);
 
 static void do_delete_script(sid_t id) {
-    script_t* p_script = get_script(id);
+    script_t* p_script = get_script(find_id(id));
     if (p_script) {
-        tommy_hashlin_remove_existing(&scripts, &p_script->node);
-        free(p_script);
+        relink(p_script, NULL);
+        release_refs(p_script->p_code);
+        id_table_set(&scripts, p_script->handle, NULL);
+        slab_free(&script_slab, p_script, p_script->capacity);
     }
 }
 
-void put_script(int* p_msg_length) {
-    uint32_t id_length;
-    read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length);
-    id_length = ntoh_ui32(id_length);
+/*
+ * Compilation
+ */
+
+/* Compiled-only op that terminates every script */
+#define SCRIPT_OP_END 0x0000
+
+enum {
+    OP_UNKNOWN = 0,
+    OP_PLAIN,       /* floats, then raw words */
+    OP_TEXT,        /* param bytes of text, padded */
+    OP_REF,         /* param bytes of id, padded; compiled to a handle */
+    OP_SPRITES      /* count, id, then count * 8 floats */
+};
+
+typedef struct {
+    uint8_t kind;
+    uint8_t floats;
+    uint8_t raw;
+} op_info_t;
+
+static const op_info_t op_table[256] = {
+    [0x01] = { OP_PLAIN, 4, 0 },    /* draw_line */
+    [0x02] = { OP_PLAIN, 6, 0 },    /* draw_triangle */
+    [0x03] = { OP_PLAIN, 8, 0 },    /* draw_quad */
+    [0x04] = { OP_PLAIN, 2, 0 },    /* draw_rect */
+    [0x05] = { OP_PLAIN, 3, 0 },    /* draw_rrect */
+    [0x06] = { OP_PLAIN, 2, 0 },    /* draw_arc */
+    [0x07] = { OP_PLAIN, 2, 0 },    /* draw_sector */
+    [0x08] = { OP_PLAIN, 1, 0 },    /* draw_circle */
+    [0x09] = { OP_PLAIN, 2, 0 },    /* draw_ellipse */
+    [0x0A] = { OP_TEXT, 0, 0 },     /* draw_text */
+    [0x0B] = { OP_SPRITES, 0, 0 },  /* draw_sprites */
+    [0x0F] = { OP_REF, 0, 0 },      /* render_script */
+    [0x20] = { OP_PLAIN, 0, 0 },    /* begin_path */
+    [0x21] = { OP_PLAIN, 0, 0 },    /* close_path */
+    [0x22] = { OP_PLAIN, 0, 0 },    /* fill */
+    [0x23] = { OP_PLAIN, 0, 0 },    /* stroke */
+    [0x26] = { OP_PLAIN, 2, 0 },    /* move_to */
+    [0x27] = { OP_PLAIN, 2, 0 },    /* line_to */
+    [0x28] = { OP_PLAIN, 5, 0 },    /* arc_to */
+    [0x29] = { OP_PLAIN, 6, 0 },    /* bezier_to */
+    [0x2A] = { OP_PLAIN, 4, 0 },    /* quadratic_to */
+    [0x40] = { OP_PLAIN, 0, 0 },    /* push_state */
+    [0x41] = { OP_PLAIN, 0, 0 },    /* pop_state */
+    [0x42] = { OP_PLAIN, 0, 0 },    /* pop_push_state */
+    [0x44] = { OP_PLAIN, 2, 0 },    /* scissor */
+    [0x50] = { OP_PLAIN, 6, 0 },    /* transform */
+    [0x51] = { OP_PLAIN, 2, 0 },    /* scale */
+    [0x52] = { OP_PLAIN, 1, 0 },    /* rotate */
+    [0x53] = { OP_PLAIN, 2, 0 },    /* translate */
+    [0x60] = { OP_PLAIN, 0, 1 },    /* fill_color */
+    [0x61] = { OP_PLAIN, 4, 2 },    /* fill_linear */
+    [0x62] = { OP_PLAIN, 4, 2 },    /* fill_radial */
+    [0x63] = { OP_REF, 0, 0 },      /* fill_image */
+    [0x64] = { OP_REF, 0, 0 },      /* fill_stream */
+    [0x70] = { OP_PLAIN, 0, 0 },    /* stroke_width */
+    [0x71] = { OP_PLAIN, 0, 1 },    /* stroke_color */
+    [0x72] = { OP_PLAIN, 4, 2 },    /* stroke_linear */
+    [0x73] = { OP_PLAIN, 4, 2 },    /* stroke_radial */
+    [0x74] = { OP_REF, 0, 0 },      /* stroke_image */
+    [0x75] = { OP_REF, 0, 0 },      /* stroke_stream */
+    [0x80] = { OP_PLAIN, 0, 0 },    /* line_cap */
+    [0x81] = { OP_PLAIN, 0, 0 },    /* line_join */
+    [0x82] = { OP_PLAIN, 0, 0 },    /* miter_limit */
+    [0x90] = { OP_REF, 0, 0 },      /* font */
+    [0x91] = { OP_PLAIN, 0, 0 },    /* font_size */
+    [0x92] = { OP_PLAIN, 0, 0 },    /* text_align */
+    [0x93] = { OP_PLAIN, 0, 0 },    /* text_base */
+};
+
+static inline uint32_t pad_words(uint32_t bytes) {
+    return (bytes + 3) / 4;
+}
+
+static inline uint16_t wire_u16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
 
-    char id_debug[64];
-    snprintf(id_debug, sizeof(id_debug), "put_script: id_length=%u", id_length);
-    log_info(id_debug);
+static inline uint32_t wire_u32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Copy bytes into whole words, zeroing the padding */
+static void emit_bytes(script_word_t* p_out, const uint8_t* p, uint32_t size) {
+    uint32_t words = pad_words(size);
+    if (words) p_out[words - 1].u = 0;
+    memcpy(p_out, p, size);
+}
 
-    int struct_size = ALIGN_UP(sizeof(script_t), 8);
-    int id_size = ALIGN_UP(id_length, 8);
-    int alloc_size = struct_size + id_size + *p_msg_length;
-    script_t* p_script = malloc(alloc_size);
+/* Wire bytes following an op header, or 0 with *p_ok false if they run
+ * past left. Also returns the compiled word count in *p_words. */
+static uint32_t op_extent(const op_info_t* p_info, uint16_t param, const uint8_t* p_arg,
+                          uint32_t left, uint32_t* p_words, bool* p_ok) {
+    uint32_t wire_len = 0;
+    *p_ok = true;
+
+    switch (p_info->kind) {
+        case OP_PLAIN:
+            wire_len = (p_info->floats + p_info->raw) * 4u;
+            *p_words = 1 + p_info->floats + p_info->raw;
+            break;
+
+        case OP_TEXT:
+            wire_len = pad_words(param) * 4;
+            *p_words = 1 + pad_words(param);
+            break;
+
+        case OP_REF:
+            wire_len = pad_words(param) * 4;
+            *p_words = 2;
+            break;
+
+        case OP_SPRITES: {
+            uint32_t id_len = pad_words(param) * 4;
+            if (left < 4 || id_len > left - 4 ||
+                wire_u32(p_arg) > (left - 4 - id_len) / 32) {
+                *p_ok = false;
+                return 0;
+            }
+            uint32_t count = wire_u32(p_arg);
+            wire_len = 4 + id_len + count * 32;
+            *p_words = 3 + count * 8;
+            break;
+        }
+    }
+
+    if (wire_len > left) {
+        *p_ok = false;
+        return 0;
+    }
+    return wire_len;
+}
+
+/*
+ * Verify a wire script and count its compiled words (not including the
+ * END word). On failure writes the reason to p_err and returns false.
+ */
+static bool verify_ops(const uint8_t* p, uint32_t size, uint32_t* p_words,
+                       char* p_err, size_t err_size) {
+    uint32_t i = 0;
+    uint32_t w = 0;
+
+    if (size % 4) {
+        snprintf(p_err, err_size, "length %u is not a multiple of 4", size);
+        return false;
+    }
+
+    while (i < size) {
+        uint16_t op = wire_u16(p + i);
+        uint16_t param = wire_u16(p + i + 2);
+        const op_info_t* p_info = op < 256 ? &op_table[op] : &op_table[0];
+
+        if (p_info->kind == OP_UNKNOWN) {
+            snprintf(p_err, err_size, "unknown op 0x%02x at byte %u", op, i);
+            return false;
+        }
+        if ((p_info->kind == OP_REF || p_info->kind == OP_SPRITES) && param == 0) {
+            snprintf(p_err, err_size, "op 0x%02x at byte %u has an empty id", op, i);
+            return false;
+        }
+
+        uint32_t words;
+        bool ok;
+        uint32_t wire_len = op_extent(p_info, param, p + i + 4, size - i - 4, &words, &ok);
+        if (!ok) {
+            snprintf(p_err, err_size, "op 0x%02x at byte %u is truncated", op, i);
+            return false;
+        }
+
+        w += words;
+        i += 4 + wire_len;
+    }
+
+    *p_words = w;
+    return true;
+}
+
+/* Translate a verified wire script to compiled words, ending with END */
+static void emit_ops(const uint8_t* p, uint32_t size, script_word_t* p_out) {
+    uint32_t i = 0;
+    uint32_t w = 0;
+
+    while (i < size) {
+        uint16_t op = wire_u16(p + i);
+        uint16_t param = wire_u16(p + i + 2);
+        const op_info_t* p_info = &op_table[op];
+        const uint8_t* p_arg = p + i + 4;
+        uint32_t words;
+        bool ok;
+        uint32_t wire_len = op_extent(p_info, param, p_arg, size - i - 4, &words, &ok);
+
+        p_out[w].u = ((uint32_t)op << 16) | param;
+        switch (p_info->kind) {
+            case OP_PLAIN:
+                ntoh_ui32_array(&p_out[w + 1].u, p_arg, p_info->floats);
+                memcpy(&p_out[w + 1 + p_info->floats], p_arg + p_info->floats * 4,
+                       p_info->raw * 4u);
+                break;
+
+            case OP_TEXT:
+                emit_bytes(&p_out[w + 1], p_arg, param);
+                break;
+
+            case OP_REF: {
+                sid_t ref = { (void*)p_arg, param };
+                p_out[w + 1].u = intern_id(ref);
+                break;
+            }
+
+            case OP_SPRITES: {
+                uint32_t count = wire_u32(p_arg);
+                sid_t ref = { (void*)(p_arg + 4), param };
+                p_out[w + 1].u = count;
+                p_out[w + 2].u = intern_id(ref);
+                ntoh_ui32_array(&p_out[w + 3].u, p_arg + 4 + pad_words(param) * 4, count * 8);
+                break;
+            }
+        }
+
+        w += words;
+        i += 4 + wire_len;
+    }
+
+    p_out[w].u = (uint32_t)SCRIPT_OP_END << 16;
+}
+
+/* Compile and store one script. A rejected script leaves any previous
+ * version of the id in place; one that fits the previous version's block
+ * is compiled over it. */
+static void compile_script(sid_t id, const uint8_t* p_wire, uint32_t wire_size) {
+    uint32_t words;
+    char reason[96];
+    if (!verify_ops(p_wire, wire_size, &words, reason, sizeof(reason))) {
+        char id_str[33];
+        int copy_len = id.size < 32 ? id.size : 32;
+        memcpy(id_str, id.p_data, copy_len);
+        id_str[copy_len] = '\0';
+        snprintf(reject_msg, sizeof(reject_msg), "put_script '%s' rejected: %s", id_str, reason);
+        log_error(reject_msg);
+        return;
+    }
+    words++;    /* END */
+
+    uint32_t handle = intern_id(id);
+    if (handle == ID_NONE) {
+        send_puts("Unable to intern script id");
+        return;
+    }
+
+    size_t struct_size = ALIGN_UP(sizeof(script_t), 8);
+    size_t size = struct_size + (size_t)words * sizeof(script_word_t);
+
+    script_t* p_old = get_script(handle);
+    if (p_old) {
+        release_id(handle);     /* the stored version holds the id */
+    }
+    if (p_old && size <= p_old->capacity) {
+        release_refs(p_old->p_code);
+        p_old->code_words = words;
+        emit_ops(p_wire, wire_size, p_old->p_code);
+        relink(p_old, p_old);
+        store_stats.replaced_in_place++;
+        return;
+    }
+
+    size_t capacity;
+    script_t* p_script = slab_alloc(&script_slab, size, &capacity);
     if (!p_script) {
+        if (!p_old) release_id(handle);
         send_puts("Unable to allocate script");
         return;
     }
+    if (!p_old && !id_table_set(&scripts, handle, p_script)) {
+        release_id(handle);
+        slab_free(&script_slab, p_script, capacity);
+        send_puts("Unable to allocate script table");
+        return;
+    }
+    p_script->capacity = (uint32_t)capacity;
+    p_script->handle = handle;
+    p_script->p_code = ((void*)p_script) + struct_size;
+    p_script->code_words = words;
+    p_script->link_epoch = 0;
+    p_script->linking = false;
+    emit_ops(p_wire, wire_size, p_script->p_code);
+
+    relink(p_old, p_script);
+    if (p_old) {
+        id_table_set(&scripts, handle, p_script);
+        release_refs(p_old->p_code);
+        slab_free(&script_slab, p_old, p_old->capacity);
+    }
+}
+
+void get_script_store_stats(script_store_stats_t* p_stats) {
+    *p_stats = store_stats;
+    p_stats->sys_allocs = script_slab.sys_allocs;
+    p_stats->sys_bytes = script_slab.sys_bytes;
+}
+
+bool take_script_reject(char* p_buf, size_t size) {
+    if (!reject_msg[0]) return false;
+    snprintf(p_buf, size, "%s", reject_msg);
+    reject_msg[0] = '\0';
+    return true;
+}
+
+/*
+ * Draw list
+ *
+ * The scene reachable from _root_ is kept flattened: each entry resumes
+ * one script at the start of its code or just past one of its 0x0F ops,
+ * and runs to its next 0x0F or END. Child scripts are looked up once,
+ * when linking, and a put or delete of a linked script splices only its
+ * own occurrences. A script that references a missing id marks the list
+ * for a rebuild when more scripts arrive.
+ */
+
+#define SCRIPT_MAX_DEPTH 64
+
+/* State a script changes outside its own pushes, leaking to its parent */
+#define LEAK_XFORM 1    /* transform */
+#define LEAK_STYLE 2    /* stroke width, miter limit or font size */
+#define LEAK_STATE 4    /* any other paint, scissor or text state */
+
+typedef struct {
+    float rect[4];          /* x0 y0 x1 y1, empty when x0 > x1 */
+    float inherit_scale;    /* > 0: strokes with inherited style, at this scale */
+    float inherit_w;        /* largest known width among those, or -1 */
+    float inherit_miter;    /* largest known miter limit among those, or -1 */
+    uint8_t leaks;
+    bool unbounded;
+} bounds_t;
+
+typedef struct {
+    const script_word_t* p_code;    /* where to resume */
+    script_t* p_script;
+    uint16_t depth;
+    bool enter;                     /* first entry of an occurrence */
+    bool stale;                     /* bounds need recomputing */
+    bool cullable;                  /* enter only: skipping it changes no state */
+    uint32_t end;                   /* enter only: index past the occurrence */
+    bounds_t bounds;                /* enter only */
+
+    /* Enter only: where the occurrence was last drawn or culled, for
+     * damage tracking. A replacement takes over its predecessor's. */
+    bool dirty;                     /* contents changed since then */
+    uint32_t placed;                /* place_epoch when placed, 0 never */
+    float screen[4];                /* screen-space area it could cover */
+    float screen_xform[6];          /* transform it started with */
+    float screen_style[2];          /* inherited stroke width, miter limit */
+
+    /* Tessellation of the segment's shapes, by shape index */
+    struct _shape_geom_t* p_geom;
+    uint32_t geom_count;
+} draw_entry_t;
+
+typedef struct {
+    draw_entry_t* p_entries;
+    uint32_t count;
+    uint32_t capacity;
+} draw_list_t;
+
+static draw_list_t draw_list = {0};
+static draw_list_t draw_scratch = {0};
+static uint32_t link_epoch = 1;
+static bool list_dirty = true;      /* rebuild before the next frame */
+static bool list_missing = false;   /* some linked 0x0F names no script */
+
+static const sid_t root_id = { "_root_", 6 };
+
+/* Screen area changed since the last take_damage, or damage_full when
+ * that cannot be bounded. Placements older than place_epoch predate the
+ * last full frame and may no longer be where the occurrence is. */
+static float damage[4] = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+static bool damage_full = true;
+static uint32_t place_epoch = 1;
+
+static bool list_push(draw_list_t* p_list, const draw_entry_t* p_entry) {
+    if (p_list->count == p_list->capacity) {
+        uint32_t capacity = p_list->capacity ? p_list->capacity * 2 : 64;
+        draw_entry_t* p = realloc(p_list->p_entries, capacity * sizeof(draw_entry_t));
+        if (!p) return false;
+        p_list->p_entries = p;
+        p_list->capacity = capacity;
+    }
+    p_list->p_entries[p_list->count++] = *p_entry;
+    return true;
+}
 
-    p_script->id.size = id_length;
-    p_script->id.p_data = ((void*)p_script) + struct_size;
-    read_bytes_down(p_script->id.p_data, id_length, p_msg_length);
+/*
+ * Tessellation cache
+ *
+ * Each draw entry keeps the NanoVG geometry of the shapes in its segment:
+ * one slot per 0x01-0x09 shape op and 0x22 fill / 0x23 stroke, in order.
+ * NanoVG replays a slot while the path and stroke style are unchanged, so
+ * a static scene is not tessellated again every frame. An entry dropped
+ * from the draw list, as when its script is replaced, drops its geometry.
+ */
 
-    /* Log script ID (first 32 chars max) */
-    char id_str[64];
-    int copy_len = id_length < 32 ? id_length : 32;
-    memcpy(id_str, p_script->id.p_data, copy_len);
+typedef struct _shape_geom_t {
+    NVGgeometry fill;
+    NVGgeometry stroke;
+} shape_geom_t;
+
+static void free_geometry(draw_entry_t* p_entry) {
+    for (uint32_t i = 0; i < p_entry->geom_count; i++) {
+        nvgFreeGeometry(&p_entry->p_geom[i].fill);
+        nvgFreeGeometry(&p_entry->p_geom[i].stroke);
+    }
+    free(p_entry->p_geom);
+    p_entry->p_geom = NULL;
+    p_entry->geom_count = 0;
+}
+
+static void free_list_geometry(draw_list_t* p_list) {
+    for (uint32_t i = 0; i < p_list->count; i++) free_geometry(&p_list->p_entries[i]);
+}
+
+/* NULL if the slot cannot be allocated; the shape is then drawn uncached */
+static shape_geom_t* shape_slot(draw_entry_t* p_entry, uint32_t slot) {
+    if (slot >= p_entry->geom_count) {
+        uint32_t count = ALIGN_UP(slot + 1, 4);
+        shape_geom_t* p = realloc(p_entry->p_geom, count * sizeof(shape_geom_t));
+        if (!p) return NULL;
+        memset(p + p_entry->geom_count, 0, (count - p_entry->geom_count) * sizeof(shape_geom_t));
+        p_entry->p_geom = p;
+        p_entry->geom_count = count;
+    }
+    return &p_entry->p_geom[slot];
+}
+
+/* Word count of the compiled op at w, which is not END */
+static uint32_t op_words(const script_word_t* w) {
+    uint16_t op = w->u >> 16;
+    uint16_t param = w->u & 0xffff;
+    const op_info_t* p_info = &op_table[op];
+    switch (p_info->kind) {
+        case OP_PLAIN: return 1 + p_info->floats + p_info->raw;
+        case OP_TEXT: return 1 + pad_words(param);
+        case OP_REF: return 2;
+        case OP_SPRITES: return 3 + w[1].u * 8;
+    }
+    return 1;
+}
+
+/* Drops the references compiled REF and sprite ops hold on their ids */
+static void release_refs(const script_word_t* p_code) {
+    const script_word_t* w = p_code;
+    for (uint16_t op; (op = w->u >> 16) != SCRIPT_OP_END; w += op_words(w)) {
+        switch (op_table[op].kind) {
+            case OP_REF: release_id(w[1].u); break;
+            case OP_SPRITES: release_id(w[2].u); break;
+        }
+    }
+}
+
+static void warn_link(const char* what, uint32_t handle) {
+    sid_t id = id_name(handle);
+    char id_str[33];
+    int copy_len = id.size < 32 ? id.size : 32;
+    memcpy(id_str, id.p_data, copy_len);
     id_str[copy_len] = '\0';
-    char log_msg[128];
-    snprintf(log_msg, sizeof(log_msg), "put_script: id='%s' (%u bytes)", id_str, id_length);
-    log_info(log_msg);
+    char msg[96];
+    snprintf(msg, sizeof(msg), "render_script: %s '%s'", what, id_str);
+    log_warn(msg);
+}
+
+/*
+ * Bounds
+ *
+ * Each linked occurrence carries conservative bounds in the space its
+ * script starts in, covering everything it and its children can draw.
+ * Strokes whose width or miter limit is inherited are padded at render
+ * time from the inherited style instead (inherit_scale > 0).
+ */
+
+#define STATE_STACK_MAX 32  /* NanoVG's NVG_MAX_STATES */
+
+/* Style known at a point in a script; < 0 when inherited */
+typedef struct {
+    float xform[6];
+    float stroke_w;
+    float miter;
+    float font_size;
+} walk_state_t;
+
+static inline void rect_empty(float r[4]) {
+    r[0] = r[1] = INFINITY;
+    r[2] = r[3] = -INFINITY;
+}
 
-    p_script->script.size = *p_msg_length;
-    p_script->script.p_data = ((void*)p_script) + struct_size + id_size;
-    read_bytes_down(p_script->script.p_data, *p_msg_length, p_msg_length);
+static inline bool rect_is_empty(const float r[4]) {
+    return r[0] > r[2];
+}
+
+static inline void rect_add_point(float r[4], float x, float y) {
+    if (x < r[0]) r[0] = x;
+    if (y < r[1]) r[1] = y;
+    if (x > r[2]) r[2] = x;
+    if (y > r[3]) r[3] = y;
+}
+
+static inline void rect_pad(float r[4], float pad) {
+    r[0] -= pad;
+    r[1] -= pad;
+    r[2] += pad;
+    r[3] += pad;
+}
 
-    do_delete_script(p_script->id);
+/* Axis-aligned bounds of r mapped through xform, added to p_out */
+static void rect_add_xformed(float p_out[4], const float xform[6], const float r[4]) {
+    if (rect_is_empty(r)) return;
+    float x, y;
+    nvgTransformPoint(&x, &y, xform, r[0], r[1]); rect_add_point(p_out, x, y);
+    nvgTransformPoint(&x, &y, xform, r[2], r[1]); rect_add_point(p_out, x, y);
+    nvgTransformPoint(&x, &y, xform, r[0], r[3]); rect_add_point(p_out, x, y);
+    nvgTransformPoint(&x, &y, xform, r[2], r[3]); rect_add_point(p_out, x, y);
+}
+
+/* Upper bound on how much xform can stretch a length */
+static inline float xform_scale(const float xform[6]) {
+    return sqrtf(xform[0] * xform[0] + xform[1] * xform[1] +
+                 xform[2] * xform[2] + xform[3] * xform[3]);
+}
+
+static inline bool rects_overlap(const float a[4], const float b[4]) {
+    return a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3];
+}
 
-    tommy_hashlin_insert(&scripts, &p_script->node, p_script, HASH_ID(p_script->id));
+static inline void rect_union(float r[4], const float add[4]) {
+    if (rect_is_empty(add)) return;
+    rect_add_point(r, add[0], add[1]);
+    rect_add_point(r, add[2], add[3]);
+}
+
+static inline float stroke_pad(float width, float miter) {
+    return width * 0.5f * fmaxf(1.0f, miter);
+}
+
+/* Local bounds of a shape op (0x01-0x09) and whether it strokes */
+static bool shape_rect(const script_word_t* w, float r[4], bool* p_stroke) {
+    uint16_t op = w->u >> 16;
+    uint16_t param = w->u & 0xffff;
+    const script_word_t* f = w + 1;
+    *p_stroke = (param & 2) != 0;
+    rect_empty(r);
+
+    switch (op) {
+        case 0x01:
+        case 0x02:
+        case 0x03: {
+            int points = op + 1;
+            for (int i = 0; i < points; i++) rect_add_point(r, f[i * 2].f, f[i * 2 + 1].f);
+            return true;
+        }
+        case 0x04:
+        case 0x05:
+            rect_add_point(r, 0, 0);
+            rect_add_point(r, f[0].f, f[1].f);
+            return true;
+        case 0x06:
+        case 0x07:
+        case 0x08: {
+            float radius = fabsf(f[0].f);
+            r[0] = r[1] = -radius;
+            r[2] = r[3] = radius;
+            return true;
+        }
+        case 0x09:
+            r[0] = -fabsf(f[0].f);
+            r[1] = -fabsf(f[1].f);
+            r[2] = fabsf(f[0].f);
+            r[3] = fabsf(f[1].f);
+            return true;
+    }
+    return false;
+}
+
+/* Account for a stroke of local rect r (or, with local false, of rect r
+ * already in occurrence space) under walk state s */
+static void add_stroke(bounds_t* p_b, const walk_state_t* s, const float r[4], bool local) {
+    float padded[4] = { r[0], r[1], r[2], r[3] };
+    if (s->stroke_w >= 0 && s->miter >= 0) {
+        float pad = s->stroke_w * 0.5f * fmaxf(1.0f, s->miter);
+        rect_pad(padded, local ? pad : pad * xform_scale(s->xform));
+    } else {
+        float scale = xform_scale(s->xform);
+        if (scale > p_b->inherit_scale) p_b->inherit_scale = scale;
+        if (s->stroke_w > p_b->inherit_w) p_b->inherit_w = s->stroke_w;
+        if (s->miter > p_b->inherit_miter) p_b->inherit_miter = s->miter;
+    }
+    if (local) {
+        rect_add_xformed(p_b->rect, s->xform, padded);
+    } else {
+        rect_add_point(p_b->rect, padded[0], padded[1]);
+        rect_add_point(p_b->rect, padded[2], padded[3]);
+    }
+}
+
+static void path_point(float path[4], const walk_state_t* s, float x, float y) {
+    float tx, ty;
+    nvgTransformPoint(&tx, &ty, s->xform, x, y);
+    rect_add_point(path, tx, ty);
+}
+
+/* Fold a child occurrence's bounds into its parent's at walk state s */
+static void add_child(bounds_t* p_b, walk_state_t* s, const bounds_t* p_child) {
+    if (p_child->unbounded) p_b->unbounded = true;
+    rect_add_xformed(p_b->rect, s->xform, p_child->rect);
+
+    float scale = p_child->inherit_scale * xform_scale(s->xform);
+    if (scale > p_b->inherit_scale) p_b->inherit_scale = scale;
+    if (p_child->inherit_w > p_b->inherit_w) p_b->inherit_w = p_child->inherit_w;
+    if (p_child->inherit_miter > p_b->inherit_miter) p_b->inherit_miter = p_child->inherit_miter;
+
+    /* State the child changed outside its own pushes now applies here */
+    if (p_child->leaks & LEAK_XFORM) p_b->unbounded = true;
+    if (p_child->leaks & LEAK_STYLE) {
+        s->stroke_w = -1;
+        s->miter = -1;
+        s->font_size = -1;
+    }
+}
+
+/*
+ * Compute the bounds of the occurrence entered at list index i. Children
+ * are read from their own entries, which must already be current.
+ */
+static void bound_occurrence(draw_list_t* p_list, uint32_t i) {
+    draw_entry_t* p_entry = &p_list->p_entries[i];
+    bounds_t b = { .inherit_scale = 0, .inherit_w = -1, .inherit_miter = -1 };
+    rect_empty(b.rect);
+
+    walk_state_t stack[STATE_STACK_MAX];
+    int top = 0;
+    walk_state_t s = { { 1, 0, 0, 1, 0, 0 }, -1, -1, -1 };
+    float path[4];
+    rect_empty(path);
+
+    uint32_t j = i + 1;
+    const script_word_t* w = p_entry->p_script->p_code;
+    for (uint16_t op; (op = w->u >> 16) != SCRIPT_OP_END; w += op_words(w)) {
+        uint16_t param = w->u & 0xffff;
+        const script_word_t* f = w + 1;
+        float r[4];
+        bool stroke;
+        float t[6];
+
+        if (shape_rect(w, r, &stroke)) {
+            rect_empty(path);
+            if (stroke) add_stroke(&b, &s, r, true);
+            else rect_add_xformed(b.rect, s.xform, r);
+            continue;
+        }
+
+        switch (op) {
+            case 0x0A:  /* draw_text: within the 1000px break width */
+                if (s.font_size < 0) {
+                    b.unbounded = true;
+                } else {
+                    float rows = param ? param : 1;
+                    float text[4] = { -1000, -2 * s.font_size, 1000, 2 * s.font_size * rows };
+                    rect_add_xformed(b.rect, s.xform, text);
+                }
+                break;
+
+            case 0x0B: {    /* draw_sprites */
+                uint32_t count = f[0].u;
+                const script_word_t* p_sprite = f + 2;
+                for (uint32_t n = 0; n < count; n++, p_sprite += 8) {
+                    float dest[4];
+                    rect_empty(dest);
+                    rect_add_point(dest, p_sprite[4].f, p_sprite[5].f);
+                    rect_add_point(dest, p_sprite[4].f + p_sprite[6].f,
+                                   p_sprite[5].f + p_sprite[7].f);
+                    rect_add_xformed(b.rect, s.xform, dest);
+                }
+                break;
+            }
+
+            case 0x0F:  /* render_script: the child occurrence, if linked */
+                if (j < p_list->count && p_list->p_entries[j].enter) {
+                    draw_entry_t* p_child = &p_list->p_entries[j];
+                    uint16_t next = w[op_words(w)].u >> 16;
+                    bool contained = top > 0 && (next == 0x41 || next == 0x42);
+                    p_child->cullable = contained || !p_child->bounds.leaks;
+                    add_child(&b, &s, &p_child->bounds);
+                    if (top == 0) b.leaks |= p_child->bounds.leaks;
+                    j = p_child->end;
+                }
+                j++;    /* our resume entry */
+                break;
+
+            case 0x20: rect_empty(path); break;
+            case 0x22:
+                rect_add_point(b.rect, path[0], path[1]);
+                rect_add_point(b.rect, path[2], path[3]);
+                break;
+            case 0x23:
+                if (!rect_is_empty(path)) add_stroke(&b, &s, path, false);
+                break;
+            case 0x26:
+            case 0x27: path_point(path, &s, f[0].f, f[1].f); break;
+            case 0x28:
+            case 0x2A:
+                path_point(path, &s, f[0].f, f[1].f);
+                path_point(path, &s, f[2].f, f[3].f);
+                break;
+            case 0x29:
+                path_point(path, &s, f[0].f, f[1].f);
+                path_point(path, &s, f[2].f, f[3].f);
+                path_point(path, &s, f[4].f, f[5].f);
+                break;
+
+            case 0x40:
+                if (top == STATE_STACK_MAX) b.unbounded = true;
+                else stack[top++] = s;
+                break;
+            case 0x41:
+                if (top > 0) s = stack[--top];
+                break;
+            case 0x42:
+                if (top > 0) s = stack[top - 1];
+                else stack[top++] = s;
+                break;
+
+            case 0x50:
+                for (int k = 0; k < 6; k++) t[k] = f[k].f;
+                nvgTransformPremultiply(s.xform, t);
+                if (top == 0) b.leaks |= LEAK_XFORM;
+                break;
+            case 0x51:
+                nvgTransformScale(t, f[0].f, f[1].f);
+                nvgTransformPremultiply(s.xform, t);
+                if (top == 0) b.leaks |= LEAK_XFORM;
+                break;
+            case 0x52:
+                nvgTransformRotate(t, f[0].f);
+                nvgTransformPremultiply(s.xform, t);
+                if (top == 0) b.leaks |= LEAK_XFORM;
+                break;
+            case 0x53:
+                nvgTransformTranslate(t, f[0].f, f[1].f);
+                nvgTransformPremultiply(s.xform, t);
+                if (top == 0) b.leaks |= LEAK_XFORM;
+                break;
+
+            case 0x70:
+                s.stroke_w = param / 4.0f;
+                if (top == 0) b.leaks |= LEAK_STYLE;
+                break;
+            case 0x82:
+                s.miter = param;
+                if (top == 0) b.leaks |= LEAK_STYLE;
+                break;
+            case 0x91:
+                s.font_size = param / 4.0f;
+                if (top == 0) b.leaks |= LEAK_STYLE;
+                break;
+
+            case 0x44:
+            case 0x60: case 0x61: case 0x62: case 0x63: case 0x64:
+            case 0x71: case 0x72: case 0x73: case 0x74: case 0x75:
+            case 0x80: case 0x81: case 0x90: case 0x92: case 0x93:
+                if (top == 0) b.leaks |= LEAK_STATE;
+                break;
+        }
+    }
+
+    p_entry->bounds = b;
+}
+
+/* Recompute span ends, then the bounds of every stale occurrence, deepest
+ * first so each parent sees its children's current bounds */
+static void finish_links(draw_list_t* p_list) {
+    uint32_t open[SCRIPT_MAX_DEPTH];
+    int n_open = 0;
+    for (uint32_t i = 0; i < p_list->count; i++) {
+        draw_entry_t* p_entry = &p_list->p_entries[i];
+        /* An entry closes every open occurrence at or below its own level */
+        uint16_t closes = p_entry->enter ? p_entry->depth : p_entry->depth + 1;
+        while (n_open > 0 && p_list->p_entries[open[n_open - 1]].depth >= closes) {
+            p_list->p_entries[open[--n_open]].end = i;
+        }
+        if (p_entry->enter) open[n_open++] = i;
+    }
+    while (n_open > 0) p_list->p_entries[open[--n_open]].end = p_list->count;
+
+    for (uint32_t i = p_list->count; i-- > 0;) {
+        draw_entry_t* p_entry = &p_list->p_entries[i];
+        if (p_entry->enter && p_entry->stale) {
+            bound_occurrence(p_list, i);
+            p_entry->stale = false;
+        }
+    }
+}
+
+/*
+ * Damage
+ *
+ * Rendering places every occurrence it reaches, recording the screen area
+ * it could cover. Replacing an occurrence damages that area and, once the
+ * new bounds are known, the area they cover from the same place. Changes
+ * that leak state into the parent damage the parent instead.
+ */
+
+/* Screen area of bounds started at xform with the inherited stroke style */
+static void occurrence_rect(const bounds_t* p_b, const float xform[6],
+                            const float style[2], float p_out[4]) {
+    rect_empty(p_out);
+    if (p_b->unbounded) {
+        p_out[0] = p_out[1] = -INFINITY;
+        p_out[2] = p_out[3] = INFINITY;
+        return;
+    }
+    float r[4] = { p_b->rect[0], p_b->rect[1], p_b->rect[2], p_b->rect[3] };
+    if (p_b->inherit_scale > 0 && !rect_is_empty(r)) {
+        rect_pad(r, p_b->inherit_scale * stroke_pad(fmaxf(style[0], p_b->inherit_w),
+                                                    fmaxf(style[1], p_b->inherit_miter)));
+    }
+    rect_add_xformed(p_out, xform, r);
+}
+
+bool take_damage(float p_rect[4]) {
+    link_draw_list();
+
+    uint32_t path[SCRIPT_MAX_DEPTH];
+    for (uint32_t i = 0; i < draw_list.count; i++) {
+        draw_entry_t* p_entry = &draw_list.p_entries[i];
+        if (!p_entry->enter) continue;
+        path[p_entry->depth] = i;
+        if (!p_entry->dirty) continue;
+        p_entry->dirty = false;
+
+        /* Climb to an occurrence placed since the last full frame whose
+         * state changes stay inside it */
+        uint32_t k = i;
+        while (!damage_full) {
+            const draw_entry_t* p_at = &draw_list.p_entries[k];
+            if (p_at->placed == place_epoch && (p_at->depth == 0 || p_at->cullable)) break;
+            if (p_at->depth == 0) damage_full = true;
+            else k = path[p_at->depth - 1];
+        }
+        if (damage_full) continue;
+
+        draw_entry_t* p_at = &draw_list.p_entries[k];
+        float now[4];
+        occurrence_rect(&p_at->bounds, p_at->screen_xform, p_at->screen_style, now);
+        rect_union(damage, p_at->screen);
+        rect_union(damage, now);
+
+        /* Whatever it contains may have moved along with it */
+        for (uint32_t j = k + 1; j < p_at->end; j++) draw_list.p_entries[j].placed = 0;
+    }
+
+    bool bounded = !damage_full;
+    memcpy(p_rect, damage, sizeof(damage));
+    rect_empty(damage);
+    damage_full = false;
+    return bounded;
+}
+
+/* Append one occurrence of p_script and everything below it. Scripts on
+ * the current path have linking set, which is how cycles are caught. */
+static bool flatten(draw_list_t* p_list, script_t* p_script, uint16_t depth) {
+    draw_entry_t entry = {
+        .p_code = p_script->p_code, .p_script = p_script,
+        .depth = depth, .enter = true, .stale = true
+    };
+    if (!list_push(p_list, &entry)) return false;
+    p_script->link_epoch = link_epoch;
+    p_script->linking = true;
+
+    bool ok = true;
+    const script_word_t* w = p_script->p_code;
+    while (ok && (w->u >> 16) != SCRIPT_OP_END) {
+        const script_word_t* p_op = w;
+        w += op_words(w);
+        if ((p_op->u >> 16) != 0x0F) continue;
+
+        uint32_t ref = p_op[1].u;
+        script_t* p_child = get_script(ref);
+        if (!p_child) {
+            list_missing = true;
+            warn_link("script not found", ref);
+        } else if (p_child->linking) {
+            warn_link("skipping cycle through", ref);
+        } else if (depth + 1 >= SCRIPT_MAX_DEPTH) {
+            warn_link("too deep, skipping", ref);
+        } else {
+            ok = flatten(p_list, p_child, depth + 1);
+        }
+
+        draw_entry_t resume = { .p_code = w, .p_script = p_script, .depth = depth };
+        ok = ok && list_push(p_list, &resume);
+    }
+
+    p_script->linking = false;
+    return ok;
+}
+
+static void rebuild_draw_list(void) {
+    free_list_geometry(&draw_list);
+    draw_list.count = 0;
+    link_epoch++;
+    list_missing = false;
+    list_dirty = false;
+    damage_full = true;
+
+    /* Looked up each time: a deleted root comes back under a new handle */
+    script_t* p_root = get_script(find_id(root_id));
+    if (!p_root) {
+        list_missing = true;
+        return;
+    }
+    if (!flatten(&draw_list, p_root, 0)) {
+        send_puts("Unable to allocate draw list");
+        draw_list.count = 0;
+        list_dirty = true;
+        return;
+    }
+    finish_links(&draw_list);
+}
+
+/*
+ * Replace every occurrence of p_old with p_new (NULL when deleted) while
+ * copying the list into draw_scratch. Called before p_old is freed.
+ */
+static void splice(script_t* p_old, script_t* p_new) {
+    script_t* path[SCRIPT_MAX_DEPTH];
+    uint32_t path_index[SCRIPT_MAX_DEPTH];
+    draw_list_t* p_out = &draw_scratch;
+    p_out->count = 0;
+
+    uint32_t i = 0;
+    bool ok = true;
+    while (ok && i < draw_list.count) {
+        const draw_entry_t* p_entry = &draw_list.p_entries[i];
+        path[p_entry->depth] = p_entry->p_script;
+        if (p_entry->enter) path_index[p_entry->depth] = p_out->count;
+        if (!(p_entry->enter && p_entry->p_script == p_old)) {
+            ok = list_push(p_out, p_entry);
+            i++;
+            continue;
+        }
+
+        /* Skip the old occurrence: deeper entries and its own resumes */
+        uint16_t depth = p_entry->depth;
+        free_geometry(&draw_list.p_entries[i]);
+        for (i++; i < draw_list.count; i++) {
+            draw_entry_t* p_next = &draw_list.p_entries[i];
+            if (p_next->depth < depth) break;
+            if (p_next->depth == depth && (p_next->enter || p_next->p_script != p_old)) break;
+            free_geometry(p_next);
+        }
+
+        /* Every enclosing occurrence's bounds may change */
+        for (uint16_t d = 0; d < depth; d++) p_out->p_entries[path_index[d]].stale = true;
+
+        if (depth > 0 && (!p_entry->cullable || p_entry->placed != place_epoch)) {
+            p_out->p_entries[path_index[depth - 1]].dirty = true;
+        } else if (!p_new && depth == 0) {
+            damage_full = true;
+        } else if (!p_new) {
+            rect_union(damage, p_entry->screen);
+        }
+
+        if (p_new) {
+            uint32_t at = p_out->count;
+            for (uint16_t d = 0; d < depth; d++) path[d]->linking = true;
+            ok = flatten(p_out, p_new, depth);
+            for (uint16_t d = 0; d < depth; d++) path[d]->linking = false;
+
+            /* Damaged where the old one was placed */
+            if (ok) {
+                draw_entry_t* p_placed = &p_out->p_entries[at];
+                p_placed->dirty = true;
+                p_placed->placed = p_entry->placed;
+                memcpy(p_placed->screen, p_entry->screen, sizeof(p_placed->screen));
+                memcpy(p_placed->screen_xform, p_entry->screen_xform,
+                       sizeof(p_placed->screen_xform));
+                memcpy(p_placed->screen_style, p_entry->screen_style,
+                       sizeof(p_placed->screen_style));
+            }
+        }
+    }
+
+    if (!ok) {
+        send_puts("Unable to allocate draw list");
+        list_dirty = true;
+        return;
+    }
+
+    draw_list_t tmp = draw_list;
+    draw_list = draw_scratch;
+    draw_scratch = tmp;
+    finish_links(&draw_list);
+}
+
+/* Keep the draw list in step with a script being stored or removed */
+static void relink(script_t* p_old, script_t* p_new) {
+    if (list_dirty) return;
+    if (p_old && p_old->link_epoch == link_epoch) {
+        splice(p_old, p_new);
+        if (!p_new) list_missing = true;
+    } else if (p_new && list_missing) {
+        list_dirty = true;
+    }
+}
+
+uint32_t link_draw_list(void) {
+    if (list_dirty) rebuild_draw_list();
+    return draw_list.count;
+}
+
+/* Reads the id in place; it stays valid until the next comms buffer */
+static bool read_script_id(int* p_msg_length, sid_t* p_id) {
+    uint32_t id_length;
+    if (!read_bytes_down(&id_length, sizeof(uint32_t), p_msg_length)) {
+        return false;
+    }
+    id_length = ntoh_ui32(id_length);
+
+    if (id_length > (uint32_t)*p_msg_length) {
+        log_error("put_script: id longer than payload");
+        return false;
+    }
+
+    p_id->size = id_length;
+    p_id->p_data = (void*)read_bytes_ptr(id_length, p_msg_length);
+    if (!p_id->p_data) {
+        log_error("put_script: truncated id");
+        return false;
+    }
+    return true;
+}
+
+void put_script(int* p_msg_length) {
+    sid_t id;
+    if (!read_script_id(p_msg_length, &id)) return;
+
+    /* Compile straight out of the receive buffer */
+    uint32_t wire_size = *p_msg_length;
+    const uint8_t* p_wire = read_bytes_ptr(wire_size, p_msg_length);
+    if (!p_wire) {
+        send_puts("Truncated put_script");
+        return;
+    }
+
+    compile_script(id, p_wire, wire_size);
+}
+
+static void script_stream_finish(stream_t* p_stream, NVGcontext* p_ctx) {
+    (void)p_ctx;
+    script_src_t* p_src = p_stream->p_obj;
+    compile_script(p_src->id, p_src->wire.p_data, p_src->wire.size);
+    free(p_src);
+}
+
+static void script_stream_abort(stream_t* p_stream, NVGcontext* p_ctx) {
+    (void)p_ctx;
+    free(p_stream->p_obj);
+}
+
+bool put_script_stream_begin(int* p_msg_length, stream_t* p_stream) {
+    sid_t id;
+    if (!read_script_id(p_msg_length, &id)) return false;
+
+    int struct_size = ALIGN_UP(sizeof(script_src_t), 8);
+    int id_size = ALIGN_UP(id.size, 8);
+    script_src_t* p_src = malloc(struct_size + id_size + *p_msg_length);
+    if (!p_src) {
+        send_puts("Unable to allocate script");
+        return false;
+    }
+
+    p_src->id.size = id.size;
+    p_src->id.p_data = ((void*)p_src) + struct_size;
+    memcpy(p_src->id.p_data, id.p_data, id.size);
+    p_src->wire.size = *p_msg_length;
+    p_src->wire.p_data = ((void*)p_src) + struct_size + id_size;
+
+    p_stream->p_obj = p_src;
+    p_stream->p_dest = p_src->wire.p_data;
+    p_stream->dest_left = p_src->wire.size;
+    p_stream->finish = script_stream_finish;
+    p_stream->abort = script_stream_abort;
+    return true;
 }
 
 void delete_script(int* p_msg_length) {
@@ -100,219 +1181,367 @@ void delete_script(int* p_msg_length) {
     read_bytes_down(&id.size, sizeof(uint32_t), p_msg_length);
     id.size = ntoh_ui32(id.size);
 
-    id.p_data = malloc(id.size);
+    id.p_data = (void*)read_bytes_ptr(id.size, p_msg_length);
     if (!id.p_data) {
-        send_puts("Unable to allocate buffer for the id");
+        send_puts("Truncated delete_script id");
         return;
     }
 
-    read_bytes_down(id.p_data, id.size, p_msg_length);
     do_delete_script(id);
-    free(id.p_data);
 }
 
+/* Records above the slab's largest class are not reclaimed by slab_done */
+static void free_large(void* p_obj, void* p_arg) {
+    (void)p_arg;
+    script_t* p_script = p_obj;
+    if (p_script->capacity > (1u << SLAB_MAX_SHIFT)) {
+        slab_free(&script_slab, p_script, p_script->capacity);
+    }
+}
+
+/* Visible sprites of a draw_sprites op, gathered for one draw call */
+static float* p_sprite_batch = NULL;
+static uint32_t sprite_batch_capacity = 0;     /* in sprites */
+
 void reset_scripts(void) {
-    tommy_hashlin_foreach(&scripts, free);
-    tommy_hashlin_done(&scripts);
-    tommy_hashlin_init(&scripts);
+    free_list_geometry(&draw_list);
+    draw_list.count = 0;
+    list_dirty = true;
+    id_table_clear(&scripts, free_large, NULL);
+    slab_done(&script_slab);
+    reset_text_layouts();
+    free(p_sprite_batch);
+    p_sprite_batch = NULL;
+    sprite_batch_capacity = 0;
 }
 
-/* Helper functions for reading script data */
-static inline byte get_byte(void* p, uint32_t offset) {
-    return *((byte*)(p + offset));
+/*
+ * Rendering
+ */
+
+static inline NVGcolor word_color(script_word_t w) {
+    return nvgRGBA(w.b[0], w.b[1], w.b[2], w.b[3]);
 }
 
-static inline unsigned short get_uint16(void* p, uint32_t offset) {
-    return ntoh_ui16(*((unsigned short*)(p + offset)));
+/* Clip, stroke and text style as rendering left them, kept in step with
+ * nvgSave/nvgRestore so culling and the text layout cache can use them */
+typedef struct {
+    float clip[4];      /* screen-space rect that can still be drawn to */
+    float stroke_w;
+    float miter;
+    int font;           /* NanoVG face id, -1 for none */
+    float font_size;
+} render_state_t;
+
+static render_state_t render_stack[STATE_STACK_MAX];
+static int render_top;
+static float viewport[4];           /* area being redrawn */
+static bool partial_frame;          /* viewport is less than the window */
+static render_counts_t counts;
+
+static void state_save(NVGcontext* p_ctx) {
+    nvgSave(p_ctx);
+    /* NanoVG ignores saves past its limit, and so do we */
+    if (render_top + 1 < STATE_STACK_MAX) {
+        render_stack[render_top + 1] = render_stack[render_top];
+        render_top++;
+    }
 }
 
-static inline unsigned int get_uint32(void* p, uint32_t offset) {
-    return ntoh_ui32(*((unsigned int*)(p + offset)));
+static void state_restore(NVGcontext* p_ctx) {
+    nvgRestore(p_ctx);
+    if (render_top > 0) render_top--;
 }
 
-static inline float get_float(void* p, uint32_t offset) {
-    return ntoh_f32(*((float*)(p + offset)));
+static void set_clip(NVGcontext* p_ctx, float w, float h) {
+    float xform[6];
+    nvgCurrentTransform(p_ctx, xform);
+    float r[4] = { 0, 0, fmaxf(0.0f, w), fmaxf(0.0f, h) };
+    float* p_clip = render_stack[render_top].clip;
+    rect_empty(p_clip);
+    rect_add_xformed(p_clip, xform, r);
+
+    p_clip[0] = fmaxf(p_clip[0], viewport[0]);
+    p_clip[1] = fmaxf(p_clip[1], viewport[1]);
+    p_clip[2] = fminf(p_clip[2], viewport[2]);
+    p_clip[3] = fminf(p_clip[3], viewport[3]);
 }
 
-static int padded_advance(int size) {
-    switch (size % 4) {
-        case 0: return size;
-        case 1: return size + 3;
-        case 2: return size + 2;
-        case 3: return size + 1;
-        default: return size;
-    }
+/* Whether local rect r, grown by pad, can reach the current clip */
+static bool rect_visible(NVGcontext* p_ctx, const float r[4], float pad) {
+    float xform[6];
+    nvgCurrentTransform(p_ctx, xform);
+    float padded[4] = { r[0], r[1], r[2], r[3] };
+    rect_pad(padded, pad);
+    float screen[4];
+    rect_empty(screen);
+    rect_add_xformed(screen, xform, padded);
+    return rects_overlap(screen, render_stack[render_top].clip);
 }
 
-static void render_text(char* p_text, unsigned int size, NVGcontext* p_ctx) {
-    float x = 0;
-    float y = 0;
+/* Record where an occurrence starts this frame */
+static void place(NVGcontext* p_ctx, draw_entry_t* p_entry) {
+    const render_state_t* p_state = &render_stack[render_top];
+    nvgCurrentTransform(p_ctx, p_entry->screen_xform);
+    p_entry->screen_style[0] = p_state->stroke_w;
+    p_entry->screen_style[1] = p_state->miter;
+    occurrence_rect(&p_entry->bounds, p_entry->screen_xform, p_entry->screen_style,
+                    p_entry->screen);
+    p_entry->placed = place_epoch;
+}
+
+/* A script's scissor replaces the frame's; keep it within the redraw area */
+static void limit_scissor(NVGcontext* p_ctx) {
+    if (!partial_frame) return;
+    float xform[6];
+    nvgCurrentTransform(p_ctx, xform);
+    nvgResetTransform(p_ctx);
+    nvgIntersectScissor(p_ctx, viewport[0], viewport[1],
+                        viewport[2] - viewport[0], viewport[3] - viewport[1]);
+    nvgTransform(p_ctx, xform[0], xform[1], xform[2], xform[3], xform[4], xform[5]);
+}
+
+/* Text as NanoVG would lay it out, breaking rows at TEXT_WRAP_WIDTH, from
+ * the layout cache when it can be */
+static void render_text(const char* p_text, unsigned int size, NVGcontext* p_ctx) {
+    const render_state_t* p_state = &render_stack[render_top];
+    if (p_state->font < 0) return;
+
+    text_style_t style = { p_state->font, p_state->font_size, nvgTextScale(p_ctx) };
+    bool reused;
+    const text_layout_t* p_layout = text_layout(p_ctx, p_text, size, &style, &reused);
+    if (p_layout) {
+        if (reused) counts.texts_reused++;
+        float y = 0;
+        for (uint32_t i = 0; i < p_layout->row_count; i++) {
+            const text_row_t* p_row = &p_layout->p_rows[i];
+            nvgText(p_ctx, 0, y, p_text + p_row->start, p_text + p_row->end);
+            y += p_layout->line_height;
+        }
+        return;
+    }
+
+    float lineh = 0;
+    nvgTextMetrics(p_ctx, NULL, NULL, &lineh);
     const char* start = p_text;
     const char* end = start + size;
-    float lineh;
-    nvgTextMetrics(p_ctx, NULL, NULL, &lineh);
+    float y = 0;
     NVGtextRow rows[3];
-    int nrows, i;
-
-    while ((nrows = nvgTextBreakLines(p_ctx, start, end, 1000, rows, 3))) {
-        for (i = 0; i < nrows; i++) {
-            NVGtextRow* row = &rows[i];
-            nvgText(p_ctx, x, y, row->start, row->end);
+    int nrows;
+    while ((nrows = nvgTextBreakLines(p_ctx, start, end, TEXT_WRAP_WIDTH, rows, 3))) {
+        for (int i = 0; i < nrows; i++) {
+            nvgText(p_ctx, 0, y, rows[i].start, rows[i].end);
             y += lineh;
         }
         start = rows[nrows - 1].next;
     }
 }
 
-static int render_sprites(NVGcontext* p_ctx, void* p, int i, uint16_t param) {
-    uint32_t count = get_uint32(p, i);
-    i += sizeof(uint32_t);
+#define F(n) (w[n].f)
 
-    sid_t id;
-    id.size = param;
-    id.p_data = p + i;
-    i += padded_advance(param);
-
-    for (uint32_t n = 0; n < count; n++) {
-        float sx = get_float(p, i);
-        float sy = get_float(p, i + 4);
-        float sw = get_float(p, i + 8);
-        float sh = get_float(p, i + 12);
-        float dx = get_float(p, i + 16);
-        float dy = get_float(p, i + 20);
-        float dw = get_float(p, i + 24);
-        float dh = get_float(p, i + 28);
+/* Draws the op's visible sprites as one batch. Sprite words are plain
+ * floats: source x y w h, then destination x y w h. */
+static const script_word_t* render_sprites(NVGcontext* p_ctx, const script_word_t* w) {
+    uint32_t count = w[0].u;
+    uint32_t image = w[1].u;
+    const float* p_sprites = &w[2].f;
 
-        draw_image(p_ctx, id, sx, sy, sw, sh, dx, dy, dw, dh);
+    if (count > sprite_batch_capacity) {
+        float* p = realloc(p_sprite_batch, (size_t)count * 8 * sizeof(float));
+        if (p) {
+            p_sprite_batch = p;
+            sprite_batch_capacity = count;
+        }
+    }
+    bool batched = count <= sprite_batch_capacity;
 
-        i += 32;
+    float xform[6];
+    nvgCurrentTransform(p_ctx, xform);
+    const float* p_clip = render_stack[render_top].clip;
+    uint32_t visible = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        const float* s = &p_sprites[n * 8];
+        float dest[4];
+        rect_empty(dest);
+        rect_add_point(dest, s[4], s[5]);
+        rect_add_point(dest, s[4] + s[6], s[5] + s[7]);
+        float screen[4];
+        rect_empty(screen);
+        rect_add_xformed(screen, xform, dest);
+        if (!rects_overlap(screen, p_clip)) {
+            counts.ops_culled++;
+            continue;
+        }
+        counts.ops_drawn++;
+        if (batched) {
+            memcpy(&p_sprite_batch[visible++ * 8], s, 8 * sizeof(float));
+        } else {
+            draw_image(p_ctx, image, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+        }
     }
+    if (visible) draw_sprites(p_ctx, image, p_sprite_batch, visible);
 
-    return i;
+    return w + 2 + count * 8;
 }
 
-void render_script(sid_t id, NVGcontext* p_ctx) {
-    script_t* p_script = get_script(id);
-    if (!p_script) {
-        char msg[128];
-        char id_str[64];
-        int copy_len = id.size < 32 ? id.size : 32;
-        memcpy(id_str, id.p_data, copy_len);
-        id_str[copy_len] = '\0';
-        snprintf(msg, sizeof(msg), "render_script: script '%s' not found!", id_str);
-        log_warn(msg);
-        return;
+static void fill_shape(NVGcontext* p_ctx, draw_entry_t* p_entry, uint32_t slot) {
+    shape_geom_t* p_geom = shape_slot(p_entry, slot);
+    if (!p_geom) {
+        nvgFill(p_ctx);
+    } else if (nvgFillCached(p_ctx, &p_geom->fill)) {
+        counts.shapes_reused++;
     }
+}
 
-    int push_count = 0;
-    void* p = p_script->script.p_data;
-    int i = 0;
+static void stroke_shape(NVGcontext* p_ctx, draw_entry_t* p_entry, uint32_t slot) {
+    shape_geom_t* p_geom = shape_slot(p_entry, slot);
+    if (!p_geom) {
+        nvgStroke(p_ctx);
+    } else if (nvgStrokeCached(p_ctx, &p_geom->stroke)) {
+        counts.shapes_reused++;
+    }
+}
 
-    while ((uint32_t)i < p_script->script.size) {
-        int op = get_uint16(p, i);
-        int param = get_uint16(p, i + 2);
-        i += 4;
+/* Run the entry's compiled ops up to the next 0x0F, which the draw list
+ * continues from, or to END, where unbalanced pushes are restored */
+static void run_ops(draw_entry_t* p_entry, NVGcontext* p_ctx, int* p_push_count) {
+    /* Verified at put time: no bounds checks */
+    const script_word_t* w = p_entry->p_code;
+    int push_count = *p_push_count;
+    uint32_t shapes = 0;
+    /* The current path is a culled shape's: skip bare fill and stroke
+     * until the next path starts */
+    bool path_culled = false;
+
+    for (;;) {
+        uint16_t op = w->u >> 16;
+        uint16_t param = w->u & 0xffff;
+        bool shape_op = (op >= 0x01 && op <= 0x09) || op == 0x22 || op == 0x23;
+        uint32_t slot = shape_op ? shapes++ : 0;
+
+        float r[4];
+        bool stroke;
+        if (op >= 0x01 && op <= 0x09 && shape_rect(w, r, &stroke)) {
+            /* A shape with neither flag leaves its path to a later stroke */
+            const render_state_t* p_state = &render_stack[render_top];
+            bool padded = stroke || !(param & 1);
+            float pad = padded ? stroke_pad(p_state->stroke_w, p_state->miter) : 0;
+            path_culled = !rect_visible(p_ctx, r, pad);
+            if (path_culled) {
+                /* Later path ops start afresh, as after the shape */
+                nvgBeginPath(p_ctx);
+                counts.ops_culled++;
+                w += op_words(w);
+                continue;
+            }
+            counts.ops_drawn++;
+        } else if (path_culled) {
+            if (op == 0x22 || op == 0x23) {
+                w++;
+                continue;
+            }
+            path_culled = op != 0x20 && (op < 0x26 || op > 0x2A);
+        }
+        w++;
 
         switch (op) {
+            case SCRIPT_OP_END:
+                goto done;
+
             case 0x01:  /* draw_line */
                 nvgBeginPath(p_ctx);
-                nvgMoveTo(p_ctx, get_float(p, i), get_float(p, i+4));
-                nvgLineTo(p_ctx, get_float(p, i + 8), get_float(p, i + 12));
-                if (param & 2) nvgStroke(p_ctx);
-                i += 16;
+                nvgMoveTo(p_ctx, F(0), F(1));
+                nvgLineTo(p_ctx, F(2), F(3));
+                if (param & 2) stroke_shape(p_ctx, p_entry, slot);
+                w += 4;
                 break;
 
             case 0x02:  /* draw_triangle */
                 nvgBeginPath(p_ctx);
-                nvgMoveTo(p_ctx, get_float(p, i), get_float(p, i+4));
-                nvgLineTo(p_ctx, get_float(p, i + 8), get_float(p, i + 12));
-                nvgLineTo(p_ctx, get_float(p, i + 16), get_float(p, i + 20));
+                nvgMoveTo(p_ctx, F(0), F(1));
+                nvgLineTo(p_ctx, F(2), F(3));
+                nvgLineTo(p_ctx, F(4), F(5));
                 nvgClosePath(p_ctx);
-                if (param & 1) nvgFill(p_ctx);
-                if (param & 2) nvgStroke(p_ctx);
-                i += 24;
+                if (param & 1) fill_shape(p_ctx, p_entry, slot);
+                if (param & 2) stroke_shape(p_ctx, p_entry, slot);
+                w += 6;
                 break;
 
             case 0x03:  /* draw_quad */
                 nvgBeginPath(p_ctx);
-                nvgMoveTo(p_ctx, get_float(p, i), get_float(p, i+4));
-                nvgLineTo(p_ctx, get_float(p, i + 8), get_float(p, i + 12));
-                nvgLineTo(p_ctx, get_float(p, i + 16), get_float(p, i + 20));
-                nvgLineTo(p_ctx, get_float(p, i + 24), get_float(p, i + 28));
+                nvgMoveTo(p_ctx, F(0), F(1));
+                nvgLineTo(p_ctx, F(2), F(3));
+                nvgLineTo(p_ctx, F(4), F(5));
+                nvgLineTo(p_ctx, F(6), F(7));
                 nvgClosePath(p_ctx);
-                if (param & 1) nvgFill(p_ctx);
-                if (param & 2) nvgStroke(p_ctx);
-                i += 32;
+                if (param & 1) fill_shape(p_ctx, p_entry, slot);
+                if (param & 2) stroke_shape(p_ctx, p_entry, slot);
+                w += 8;
                 break;
 
             case 0x04:  /* draw_rect */
                 nvgBeginPath(p_ctx);
-                nvgRect(p_ctx, 0, 0, get_float(p, i), get_float(p, i+4));
-                if (param & 1) nvgFill(p_ctx);
-                if (param & 2) nvgStroke(p_ctx);
-                i += 8;
+                nvgRect(p_ctx, 0, 0, F(0), F(1));
+                if (param & 1) fill_shape(p_ctx, p_entry, slot);
+                if (param & 2) stroke_shape(p_ctx, p_entry, slot);
+                w += 2;
                 break;
 
             case 0x05:  /* draw_rrect */
                 nvgBeginPath(p_ctx);
-                nvgRoundedRect(p_ctx, 0, 0, get_float(p, i), get_float(p, i + 4), get_float(p, i + 8));
-                if (param & 1) nvgFill(p_ctx);
-                if (param & 2) nvgStroke(p_ctx);
-                i += 12;
+                nvgRoundedRect(p_ctx, 0, 0, F(0), F(1), F(2));
+                if (param & 1) fill_shape(p_ctx, p_entry, slot);
+                if (param & 2) stroke_shape(p_ctx, p_entry, slot);
+                w += 3;
                 break;
 
             case 0x06:  /* draw_arc */
                 nvgBeginPath(p_ctx);
-                nvgArc(p_ctx, 0, 0, get_float(p, i), 0, get_float(p, i + 4),
-                    get_float(p, i + 4) > 0 ? NVG_CW : NVG_CCW);
-                if (param & 1) nvgFill(p_ctx);
-                if (param & 2) nvgStroke(p_ctx);
-                i += 8;
+                nvgArc(p_ctx, 0, 0, F(0), 0, F(1), F(1) > 0 ? NVG_CW : NVG_CCW);
+                if (param & 1) fill_shape(p_ctx, p_entry, slot);
+                if (param & 2) stroke_shape(p_ctx, p_entry, slot);
+                w += 2;
                 break;
 
             case 0x07:  /* draw_sector */
                 nvgBeginPath(p_ctx);
                 nvgMoveTo(p_ctx, 0, 0);
-                nvgLineTo(p_ctx, get_float(p, i), 0);
-                nvgArc(p_ctx, 0, 0, get_float(p, i), 0, get_float(p, i + 4),
-                    get_float(p, i + 4) > 0 ? NVG_CW : NVG_CCW);
+                nvgLineTo(p_ctx, F(0), 0);
+                nvgArc(p_ctx, 0, 0, F(0), 0, F(1), F(1) > 0 ? NVG_CW : NVG_CCW);
                 nvgClosePath(p_ctx);
-                if (param & 1) nvgFill(p_ctx);
-                if (param & 2) nvgStroke(p_ctx);
-                i += 8;
+                if (param & 1) fill_shape(p_ctx, p_entry, slot);
+                if (param & 2) stroke_shape(p_ctx, p_entry, slot);
+                w += 2;
                 break;
 
             case 0x08:  /* draw_circle */
                 nvgBeginPath(p_ctx);
-                nvgCircle(p_ctx, 0, 0, get_float(p, i));
-                if (param & 1) nvgFill(p_ctx);
-                if (param & 2) nvgStroke(p_ctx);
-                i += 4;
+                nvgCircle(p_ctx, 0, 0, F(0));
+                if (param & 1) fill_shape(p_ctx, p_entry, slot);
+                if (param & 2) stroke_shape(p_ctx, p_entry, slot);
+                w += 1;
                 break;
 
             case 0x09:  /* draw_ellipse */
                 nvgBeginPath(p_ctx);
-                nvgEllipse(p_ctx, 0, 0, get_float(p, i), get_float(p, i + 4));
-                if (param & 1) nvgFill(p_ctx);
-                if (param & 2) nvgStroke(p_ctx);
-                i += 8;
+                nvgEllipse(p_ctx, 0, 0, F(0), F(1));
+                if (param & 1) fill_shape(p_ctx, p_entry, slot);
+                if (param & 2) stroke_shape(p_ctx, p_entry, slot);
+                w += 2;
                 break;
 
             case 0x0A:  /* draw_text */
-                render_text(p + i, param, p_ctx);
-                i += padded_advance(param);
+                render_text((const char*)w, param, p_ctx);
+                w += pad_words(param);
                 break;
 
             case 0x0B:  /* draw_sprites */
-                i = render_sprites(p_ctx, p, i, param);
+                w = render_sprites(p_ctx, w);
                 break;
 
             case 0x0F:  /* render_script */
-                id.size = param;
-                id.p_data = p + i;
-                render_script(id, p_ctx);
-                i += padded_advance(param);
-                break;
+                *p_push_count = push_count;
+                return;
 
             case 0x20:  /* begin_path */
                 nvgBeginPath(p_ctx);
@@ -323,173 +1552,139 @@ void render_script(sid_t id, NVGcontext* p_ctx) {
                 break;
 
             case 0x22:  /* fill */
-                nvgFill(p_ctx);
+                fill_shape(p_ctx, p_entry, slot);
                 break;
 
             case 0x23:  /* stroke */
-                nvgStroke(p_ctx);
+                stroke_shape(p_ctx, p_entry, slot);
                 break;
 
             case 0x26:  /* move_to */
-                nvgMoveTo(p_ctx, get_float(p, i), get_float(p, i+4));
-                i += 8;
+                nvgMoveTo(p_ctx, F(0), F(1));
+                w += 2;
                 break;
 
             case 0x27:  /* line_to */
-                nvgLineTo(p_ctx, get_float(p, i), get_float(p, i+4));
-                i += 8;
+                nvgLineTo(p_ctx, F(0), F(1));
+                w += 2;
                 break;
 
             case 0x28:  /* arc_to */
-                nvgArcTo(p_ctx,
-                    get_float(p, i), get_float(p, i+4),
-                    get_float(p, i+8), get_float(p, i+12),
-                    get_float(p, i+16));
-                i += 20;
+                nvgArcTo(p_ctx, F(0), F(1), F(2), F(3), F(4));
+                w += 5;
                 break;
 
             case 0x29:  /* bezier_to */
-                nvgBezierTo(p_ctx,
-                    get_float(p, i), get_float(p, i+4),
-                    get_float(p, i+8), get_float(p, i+12),
-                    get_float(p, i+16), get_float(p, i+20));
-                i += 24;
+                nvgBezierTo(p_ctx, F(0), F(1), F(2), F(3), F(4), F(5));
+                w += 6;
                 break;
 
             case 0x2A:  /* quadratic_to */
-                nvgQuadTo(p_ctx,
-                    get_float(p, i), get_float(p, i+4),
-                    get_float(p, i+8), get_float(p, i+12));
-                i += 16;
+                nvgQuadTo(p_ctx, F(0), F(1), F(2), F(3));
+                w += 4;
                 break;
 
             case 0x40:  /* push_state */
                 push_count++;
-                nvgSave(p_ctx);
+                state_save(p_ctx);
                 break;
 
             case 0x41:  /* pop_state */
                 if (push_count > 0) {
                     push_count--;
-                    nvgRestore(p_ctx);
+                    state_restore(p_ctx);
                 }
                 break;
 
             case 0x42:  /* pop_push_state */
                 if (push_count > 0) {
                     push_count--;
-                    nvgRestore(p_ctx);
+                    state_restore(p_ctx);
                 }
                 push_count++;
-                nvgSave(p_ctx);
+                state_save(p_ctx);
                 break;
 
             case 0x44:  /* scissor */
-                nvgScissor(p_ctx, 0, 0, get_float(p, i), get_float(p, i+4));
-                i += 8;
+                nvgScissor(p_ctx, 0, 0, F(0), F(1));
+                limit_scissor(p_ctx);
+                set_clip(p_ctx, F(0), F(1));
+                w += 2;
                 break;
 
             case 0x50:  /* transform */
-                nvgTransform(p_ctx,
-                    get_float(p, i), get_float(p, i+4),
-                    get_float(p, i+8), get_float(p, i+12),
-                    get_float(p, i+16), get_float(p, i+20));
-                i += 24;
+                nvgTransform(p_ctx, F(0), F(1), F(2), F(3), F(4), F(5));
+                w += 6;
                 break;
 
             case 0x51:  /* scale */
-                nvgScale(p_ctx, get_float(p, i), get_float(p, i+4));
-                i += 8;
+                nvgScale(p_ctx, F(0), F(1));
+                w += 2;
                 break;
 
             case 0x52:  /* rotate */
-                nvgRotate(p_ctx, get_float(p, i));
-                i += 4;
+                nvgRotate(p_ctx, F(0));
+                w += 1;
                 break;
 
             case 0x53:  /* translate */
-                nvgTranslate(p_ctx, get_float(p, i), get_float(p, i+4));
-                i += 8;
+                nvgTranslate(p_ctx, F(0), F(1));
+                w += 2;
                 break;
 
             case 0x60:  /* fill_color */
-                nvgFillColor(p_ctx, nvgRGBA(
-                    get_byte(p, i), get_byte(p, i+1), get_byte(p, i+2), get_byte(p, i+3)));
-                i += 4;
+                nvgFillColor(p_ctx, word_color(w[0]));
+                w += 1;
                 break;
 
             case 0x61:  /* fill_linear */
                 nvgFillPaint(p_ctx,
-                    nvgLinearGradient(p_ctx,
-                        get_float(p, i), get_float(p, i+4), get_float(p, i+8), get_float(p, i+12),
-                        nvgRGBA(get_byte(p, i+16), get_byte(p, i+17), get_byte(p, i+18), get_byte(p, i+19)),
-                        nvgRGBA(get_byte(p, i+20), get_byte(p, i+21), get_byte(p, i+22), get_byte(p, i+23))));
-                i += 24;
+                    nvgLinearGradient(p_ctx, F(0), F(1), F(2), F(3),
+                        word_color(w[4]), word_color(w[5])));
+                w += 6;
                 break;
 
             case 0x62:  /* fill_radial */
                 nvgFillPaint(p_ctx,
-                    nvgRadialGradient(p_ctx,
-                        get_float(p, i), get_float(p, i+4), get_float(p, i+8), get_float(p, i+12),
-                        nvgRGBA(get_byte(p, i+16), get_byte(p, i+17), get_byte(p, i+18), get_byte(p, i+19)),
-                        nvgRGBA(get_byte(p, i+20), get_byte(p, i+21), get_byte(p, i+22), get_byte(p, i+23))));
-                i += 24;
+                    nvgRadialGradient(p_ctx, F(0), F(1), F(2), F(3),
+                        word_color(w[4]), word_color(w[5])));
+                w += 6;
                 break;
 
             case 0x63:  /* fill_image */
-                id.size = param;
-                id.p_data = p + i;
-                set_fill_image(p_ctx, id);
-                i += padded_advance(param);
-                break;
-
             case 0x64:  /* fill_stream */
-                id.size = param;
-                id.p_data = p + i;
-                set_fill_image(p_ctx, id);
-                i += padded_advance(param);
+                set_fill_image(p_ctx, w[0].u);
+                w += 1;
                 break;
 
             case 0x70:  /* stroke_width */
                 nvgStrokeWidth(p_ctx, param / 4.0);
+                render_stack[render_top].stroke_w = param / 4.0f;
                 break;
 
             case 0x71:  /* stroke_color */
-                nvgStrokeColor(p_ctx, nvgRGBA(
-                    get_byte(p, i), get_byte(p, i+1), get_byte(p, i+2), get_byte(p, i+3)));
-                i += 4;
+                nvgStrokeColor(p_ctx, word_color(w[0]));
+                w += 1;
                 break;
 
             case 0x72:  /* stroke_linear */
                 nvgStrokePaint(p_ctx,
-                    nvgLinearGradient(p_ctx,
-                        get_float(p, i), get_float(p, i+4), get_float(p, i+8), get_float(p, i+12),
-                        nvgRGBA(get_byte(p, i+16), get_byte(p, i+17), get_byte(p, i+18), get_byte(p, i+19)),
-                        nvgRGBA(get_byte(p, i+20), get_byte(p, i+21), get_byte(p, i+22), get_byte(p, i+23))));
-                i += 24;
+                    nvgLinearGradient(p_ctx, F(0), F(1), F(2), F(3),
+                        word_color(w[4]), word_color(w[5])));
+                w += 6;
                 break;
 
             case 0x73:  /* stroke_radial */
                 nvgStrokePaint(p_ctx,
-                    nvgRadialGradient(p_ctx,
-                        get_float(p, i), get_float(p, i+4), get_float(p, i+8), get_float(p, i+12),
-                        nvgRGBA(get_byte(p, i+16), get_byte(p, i+17), get_byte(p, i+18), get_byte(p, i+19)),
-                        nvgRGBA(get_byte(p, i+20), get_byte(p, i+21), get_byte(p, i+22), get_byte(p, i+23))));
-                i += 24;
+                    nvgRadialGradient(p_ctx, F(0), F(1), F(2), F(3),
+                        word_color(w[4]), word_color(w[5])));
+                w += 6;
                 break;
 
             case 0x74:  /* stroke_image */
-                id.size = param;
-                id.p_data = p + i;
-                set_stroke_image(p_ctx, id);
-                i += padded_advance(param);
-                break;
-
             case 0x75:  /* stroke_stream */
-                id.size = param;
-                id.p_data = p + i;
-                set_stroke_image(p_ctx, id);
-                i += padded_advance(param);
+                set_stroke_image(p_ctx, w[0].u);
+                w += 1;
                 break;
 
             case 0x80:  /* line_cap */
@@ -510,17 +1705,19 @@ void render_script(sid_t id, NVGcontext* p_ctx) {
 
             case 0x82:  /* miter_limit */
                 nvgMiterLimit(p_ctx, param);
+                render_stack[render_top].miter = param;
                 break;
 
-            case 0x90:  /* font */
-                id.size = param;
-                id.p_data = p + i;
-                set_font(id, p_ctx);
-                i += padded_advance(param);
+            case 0x90: {  /* font */
+                int font = set_font(w[0].u, p_ctx);
+                if (font >= 0) render_stack[render_top].font = font;
+                w += 1;
                 break;
+            }
 
             case 0x91:  /* font_size */
                 nvgFontSize(p_ctx, param / 4.0);
+                render_stack[render_top].font_size = param / 4.0f;
                 break;
 
             case 0x92:  /* text_align */
@@ -539,19 +1736,63 @@ void render_script(sid_t id, NVGcontext* p_ctx) {
                     case 0x03: nvgTextAlignV(p_ctx, NVG_ALIGN_BOTTOM); break;
                 }
                 break;
-
-            default: {
-                char msg[64];
-                snprintf(msg, sizeof(msg), "Unknown OP: 0x%02x", op);
-                send_puts(msg);
-                break;
-            }
         }
     }
 
+done:
     /* Restore any unbalanced state pushes */
     while (push_count > 0) {
         push_count--;
-        nvgRestore(p_ctx);
+        state_restore(p_ctx);
+    }
+}
+
+#undef F
+
+void render_root(NVGcontext* p_ctx, float width, float height, const float* p_region,
+                 render_counts_t* p_counts) {
+    link_draw_list();
+
+    partial_frame = p_region != NULL;
+    if (partial_frame) {
+        memcpy(viewport, p_region, sizeof(viewport));
+    } else {
+        /* Placements the full frame does not reach are now suspect */
+        viewport[0] = 0;
+        viewport[1] = 0;
+        viewport[2] = width;
+        viewport[3] = height;
+        place_epoch++;
     }
+
+    /* NanoVG's defaults after nvgBeginFrame */
+    render_top = 0;
+    memcpy(render_stack[0].clip, viewport, sizeof(viewport));
+    render_stack[0].stroke_w = 1.0f;
+    render_stack[0].miter = 10.0f;
+    render_stack[0].font = -1;
+    render_stack[0].font_size = 16.0f;
+    memset(&counts, 0, sizeof(counts));
+    text_layout_frame();
+
+    int push_count[SCRIPT_MAX_DEPTH];
+    uint32_t i = 0;
+    while (i < draw_list.count) {
+        draw_entry_t* p_entry = &draw_list.p_entries[i];
+        if (p_entry->enter) {
+            place(p_ctx, p_entry);
+            if (p_entry->depth > 0 && p_entry->cullable &&
+                !rects_overlap(p_entry->screen, render_stack[render_top].clip)) {
+                counts.scripts_culled++;
+                i = p_entry->end;
+                continue;
+            }
+            counts.scripts_drawn++;
+            push_count[p_entry->depth] = 0;
+        }
+        run_ops(p_entry, p_ctx, &push_count[p_entry->depth]);
+        i++;
+    }
+
+    if (p_counts) *p_counts = counts;
 }
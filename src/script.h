@@ -5,10 +5,47 @@
 #pragma once
 
 #include "types.h"
-#include "tommyds/tommyhashlin.h"
 
 void init_scripts(void);
 void put_script(int* p_msg_length);
+bool put_script_stream_begin(int* p_msg_length, stream_t* p_stream);
 void delete_script(int* p_msg_length);
 void reset_scripts(void);
-void render_script(sid_t id, NVGcontext* p_ctx);
+
+/* What one render_root call drew and skipped */
+typedef struct {
+    uint32_t scripts_drawn;
+    uint32_t scripts_culled;    /* whole occurrences outside the clip */
+    uint32_t ops_drawn;         /* shapes and sprites */
+    uint32_t ops_culled;
+    uint32_t shapes_reused;     /* fills and strokes not tessellated again */
+    uint32_t texts_reused;      /* draw_text ops laid out from the cache */
+} render_counts_t;
+
+/* Render the scene under _root_ from the flattened draw list, skipping
+ * scripts and shapes that fall outside the width x height viewport or the
+ * current scissor. With p_region (x0 y0 x1 y1) only that part of the
+ * viewport is being redrawn and nothing outside it is touched. */
+void render_root(NVGcontext* p_ctx, float width, float height, const float* p_region,
+                 render_counts_t* p_counts);
+
+/* Screen area (x0 y0 x1 y1, empty when x0 > x1) whose pixels changed since
+ * the last call. Returns false if the change cannot be bounded and the
+ * whole window needs redrawing. */
+bool take_damage(float p_rect[4]);
+
+/* Bring the draw list up to date; returns its entry count */
+uint32_t link_draw_list(void);
+
+typedef struct {
+    uint64_t replaced_in_place; /* puts compiled over the previous version */
+    uint64_t sys_allocs;        /* slab and large-record mallocs */
+    size_t sys_bytes;           /* memory held by the store */
+} script_store_stats_t;
+
+/* Cumulative except sys_bytes */
+void get_script_store_stats(script_store_stats_t* p_stats);
+
+/* Copies out why the last put_script was rejected, if one was since the
+ * previous call */
+bool take_script_reject(char* p_buf, size_t size);
@@ -0,0 +1,24 @@
+/*
+ * SHA-256, used to name content-addressed cache entries
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    uint32_t block_len;
+} sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t* p_ctx);
+void sha256_update(sha256_ctx_t* p_ctx, const void* p_data, size_t len);
+void sha256_final(sha256_ctx_t* p_ctx, uint8_t digest[SHA256_SIZE]);
+
+/* One-shot digest of a buffer */
+void sha256(const void* p_data, size_t len, uint8_t digest[SHA256_SIZE]);
@@ -0,0 +1,94 @@
+/*
+ * Size-class slab allocator
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+#include "utils.h"
+
+#define SLAB_CHUNK_SIZE (64 * 1024)
+
+/* Slabs are chained through a header in front of their blocks */
+typedef struct _slab_chunk_t {
+    struct _slab_chunk_t* p_next;
+} slab_chunk_t;
+
+#define CHUNK_HEADER ALIGN_UP(sizeof(slab_chunk_t), 16)
+
+void slab_init(slab_t* p_slab) {
+    memset(p_slab, 0, sizeof(*p_slab));
+}
+
+void slab_done(slab_t* p_slab) {
+    slab_chunk_t* p_chunk = p_slab->p_chunks;
+    while (p_chunk) {
+        slab_chunk_t* p_next = p_chunk->p_next;
+        free(p_chunk);
+        p_chunk = p_next;
+    }
+    uint64_t sys_allocs = p_slab->sys_allocs;
+    slab_init(p_slab);
+    p_slab->sys_allocs = sys_allocs;
+}
+
+static int size_class(size_t size) {
+    int c = 0;
+    while (((size_t)1 << (SLAB_MIN_SHIFT + c)) < size) c++;
+    return c;
+}
+
+/* Carve a fresh slab into blocks on the class's free list */
+static bool grow(slab_t* p_slab, int c) {
+    size_t block = (size_t)1 << (SLAB_MIN_SHIFT + c);
+    size_t count = SLAB_CHUNK_SIZE / block;
+    size_t chunk_size = CHUNK_HEADER + count * block;
+    slab_chunk_t* p_chunk = malloc(chunk_size);
+    if (!p_chunk) return false;
+    p_slab->sys_allocs++;
+    p_slab->sys_bytes += chunk_size;
+
+    p_chunk->p_next = p_slab->p_chunks;
+    p_slab->p_chunks = p_chunk;
+
+    uint8_t* p = (uint8_t*)p_chunk + CHUNK_HEADER;
+    for (size_t i = count; i-- > 0;) {
+        void** p_block = (void**)(p + i * block);
+        *p_block = p_slab->p_free[c];
+        p_slab->p_free[c] = p_block;
+    }
+    return true;
+}
+
+void* slab_alloc(slab_t* p_slab, size_t size, size_t* p_capacity) {
+    if (size > ((size_t)1 << SLAB_MAX_SHIFT)) {
+        void* p = malloc(size);
+        if (!p) return NULL;
+        p_slab->sys_allocs++;
+        p_slab->sys_bytes += size;
+        *p_capacity = size;
+        return p;
+    }
+
+    int c = size_class(size);
+    if (!p_slab->p_free[c] && !grow(p_slab, c)) return NULL;
+
+    void** p_block = p_slab->p_free[c];
+    p_slab->p_free[c] = *p_block;
+    *p_capacity = (size_t)1 << (SLAB_MIN_SHIFT + c);
+    return p_block;
+}
+
+void slab_free(slab_t* p_slab, void* p, size_t capacity) {
+    if (!p) return;
+    if (capacity > ((size_t)1 << SLAB_MAX_SHIFT)) {
+        p_slab->sys_bytes -= capacity;
+        free(p);
+        return;
+    }
+
+    int c = size_class(capacity);
+    *(void**)p = p_slab->p_free[c];
+    p_slab->p_free[c] = p;
+}
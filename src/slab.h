@@ -0,0 +1,37 @@
+/*
+ * Size-class slab allocator
+ *
+ * Blocks come in power-of-two classes carved from larger slabs, and a
+ * freed block goes back on its class's free list rather than to the
+ * system, so a store that keeps replacing records of similar sizes stops
+ * allocating once it has warmed up. Requests above the largest class go
+ * straight to malloc and back to free. Slabs are only returned to the
+ * system by slab_done.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLAB_MIN_SHIFT 6        /* 64 byte blocks */
+#define SLAB_MAX_SHIFT 16       /* 64KB blocks */
+#define SLAB_CLASSES (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
+
+typedef struct _slab_t {
+    void* p_free[SLAB_CLASSES];
+    void* p_chunks;             /* every slab, for slab_done */
+    uint64_t sys_allocs;        /* malloc calls made, cumulative */
+    size_t sys_bytes;           /* memory currently held */
+} slab_t;
+
+void slab_init(slab_t* p_slab);
+
+/* Releases every slab; blocks above the largest class must be freed first */
+void slab_done(slab_t* p_slab);
+
+/* Returns a block of at least size bytes, 8-byte aligned, and its usable
+ * capacity, which must be passed back to slab_free */
+void* slab_alloc(slab_t* p_slab, size_t size, size_t* p_capacity);
+void slab_free(slab_t* p_slab, void* p, size_t capacity);
@@ -0,0 +1,223 @@
+/*
+ * Text layout cache
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "text_layout.h"
+#include "utils.h"
+#include "tommyds/tommyhashlin.h"
+
+#define TEXT_LAYOUT_MAX 4096    /* layouts kept before a sweep */
+#define BREAK_BATCH 16
+
+typedef struct {
+    text_layout_t layout;
+    text_style_t style;
+    uint32_t size;
+    const char* p_text;     /* copy of the bytes, after the rows */
+    uint32_t used;          /* frame last drawn */
+    tommy_hashlin_node node;
+} layout_entry_t;
+
+typedef struct {
+    const text_style_t* p_style;
+    const char* p_text;
+    uint32_t size;
+} layout_key_t;
+
+static tommy_hashlin layouts = {0};
+static bool layouts_ready = false;
+static layout_entry_t** p_entries = NULL;
+static uint32_t entry_count = 0;
+static uint32_t entry_capacity = 0;
+static uint32_t entry_limit = TEXT_LAYOUT_MAX;
+static uint32_t frame = 0;
+
+/* Rows of the layout being built */
+static text_row_t* p_scratch = NULL;
+static uint32_t scratch_count = 0;
+static uint32_t scratch_capacity = 0;
+
+static void free_entries(uint32_t keep_frame, bool keep) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < entry_count; i++) {
+        layout_entry_t* p_entry = p_entries[i];
+        if (keep && p_entry->used == keep_frame) {
+            p_entries[kept++] = p_entry;
+            continue;
+        }
+        tommy_hashlin_remove_existing(&layouts, &p_entry->node);
+        free(p_entry);
+    }
+    entry_count = kept;
+}
+
+void reset_text_layouts(void) {
+    if (layouts_ready) {
+        free_entries(0, false);
+        tommy_hashlin_done(&layouts);
+    }
+    layouts_ready = false;
+    free(p_entries);
+    p_entries = NULL;
+    entry_capacity = 0;
+    entry_limit = TEXT_LAYOUT_MAX;
+    free(p_scratch);
+    p_scratch = NULL;
+    scratch_capacity = 0;
+}
+
+void text_layout_frame(void) {
+    frame++;
+}
+
+static uint32_t key_hash(const layout_key_t* p_key) {
+    uint32_t hash = tommy_hash_u32(0, p_key->p_text, p_key->size);
+    return tommy_hash_u32(hash, p_key->p_style, sizeof(text_style_t));
+}
+
+static int _comparator(const void* p_arg, const void* p_obj) {
+    const layout_key_t* p_key = p_arg;
+    const layout_entry_t* p_entry = p_obj;
+    return p_key->size != p_entry->size
+        || memcmp(p_key->p_style, &p_entry->style, sizeof(text_style_t))
+        || memcmp(p_key->p_text, p_entry->p_text, p_key->size);
+}
+
+static bool add_row(uint32_t start, uint32_t end) {
+    if (scratch_count == scratch_capacity) {
+        uint32_t capacity = scratch_capacity ? scratch_capacity * 2 : 64;
+        text_row_t* p = realloc(p_scratch, capacity * sizeof(text_row_t));
+        if (!p) return false;
+        p_scratch = p;
+        scratch_capacity = capacity;
+    }
+    p_scratch[scratch_count].start = start;
+    p_scratch[scratch_count].end = end;
+    scratch_count++;
+    return true;
+}
+
+/* Rows NanoVG breaks [start, end) into, as one nvgTextBreakLines call
+ * would give them */
+static bool break_rows(NVGcontext* p_ctx, const char* p_text, const char* start,
+                       const char* end) {
+    NVGtextRow rows[BREAK_BATCH];
+    int nrows;
+    do {
+        nrows = nvgTextBreakLines(p_ctx, start, end, TEXT_WRAP_WIDTH, rows, BREAK_BATCH);
+        for (int i = 0; i < nrows; i++) {
+            if (!add_row(rows[i].start - p_text, rows[i].end - p_text)) return false;
+        }
+        if (nrows < BREAK_BATCH) break;
+
+        /* The second half of a \r\n or \n\r pair ends no row of its own */
+        start = rows[nrows - 1].next;
+        if (start > p_text && start < end &&
+            ((start[-1] == '\r' && start[0] == '\n') || (start[-1] == '\n' && start[0] == '\r'))) {
+            start++;
+        }
+    } while (start < end);
+    return true;
+}
+
+static inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+/* A line with nothing for NanoVG to strip, as narrow as the wrap width,
+ * is a row as it stands */
+static bool plain_line(NVGcontext* p_ctx, const char* start, const char* end) {
+    if (start == end || is_blank(start[0]) || is_blank(end[-1])) return false;
+    return nvgTextBounds(p_ctx, 0, 0, start, end, NULL) <= TEXT_WRAP_WIDTH;
+}
+
+/* The rows nvgTextBreakLines would give for the whole text. Without \r
+ * or U+0085 / U+00A0 (lead byte 0xC2) only \n ends a line, so the text is
+ * split there with memchr and only lines that need it go through the
+ * line breaker. */
+static bool layout_rows(NVGcontext* p_ctx, const char* p_text, uint32_t size) {
+    scratch_count = 0;
+    const char* end = p_text + size;
+    if (memchr(p_text, '\r', size) || memchr(p_text, 0xC2, size)) {
+        return break_rows(p_ctx, p_text, p_text, end);
+    }
+
+    const char* line = p_text;
+    while (line < end) {
+        const char* nl = memchr(line, '\n', end - line);
+        const char* line_end = nl ? nl : end;
+        if (plain_line(p_ctx, line, line_end)) {
+            if (!add_row(line - p_text, line_end - p_text)) return false;
+        } else {
+            uint32_t before = scratch_count;
+            if (!break_rows(p_ctx, p_text, line, line_end)) return false;
+            /* A blank line still advances, unless nothing follows it */
+            if (scratch_count == before && nl &&
+                !add_row(line_end - p_text, line_end - p_text)) return false;
+        }
+        if (!nl) break;
+        line = nl + 1;
+    }
+    return true;
+}
+
+static bool make_room(void) {
+    if (entry_count >= entry_limit) {
+        /* Keep what this frame drew; if that alone fills the cache, grow */
+        free_entries(frame, true);
+        if (entry_count * 2 > entry_limit) entry_limit = entry_count * 2;
+    }
+    if (entry_count == entry_capacity) {
+        uint32_t capacity = entry_capacity ? entry_capacity * 2 : 256;
+        layout_entry_t** p = realloc(p_entries, capacity * sizeof(layout_entry_t*));
+        if (!p) return false;
+        p_entries = p;
+        entry_capacity = capacity;
+    }
+    return true;
+}
+
+const text_layout_t* text_layout(NVGcontext* p_ctx, const char* p_text, uint32_t size,
+                                 const text_style_t* p_style, bool* p_reused) {
+    if (!layouts_ready) {
+        tommy_hashlin_init(&layouts);
+        layouts_ready = true;
+    }
+    layout_key_t key = { p_style, p_text, size };
+    uint32_t hash = key_hash(&key);
+    layout_entry_t* p_entry = tommy_hashlin_search(&layouts, _comparator, &key, hash);
+    if (p_entry) {
+        p_entry->used = frame;
+        *p_reused = true;
+        return &p_entry->layout;
+    }
+    *p_reused = false;
+
+    if (!layout_rows(p_ctx, p_text, size) || !make_room()) return NULL;
+
+    size_t struct_size = ALIGN_UP(sizeof(layout_entry_t), 8);
+    size_t rows_size = scratch_count * sizeof(text_row_t);
+    p_entry = malloc(struct_size + rows_size + size);
+    if (!p_entry) return NULL;
+
+    text_row_t* p_rows = (text_row_t*)((uint8_t*)p_entry + struct_size);
+    memcpy(p_rows, p_scratch, rows_size);
+    char* p_copy = (char*)p_rows + rows_size;
+    memcpy(p_copy, p_text, size);
+
+    p_entry->layout.line_height = 0;
+    nvgTextMetrics(p_ctx, NULL, NULL, &p_entry->layout.line_height);
+    p_entry->layout.row_count = scratch_count;
+    p_entry->layout.p_rows = p_rows;
+    p_entry->style = *p_style;
+    p_entry->size = size;
+    p_entry->p_text = p_copy;
+    p_entry->used = frame;
+
+    p_entries[entry_count++] = p_entry;
+    tommy_hashlin_insert(&layouts, &p_entry->node, p_entry, hash);
+    return &p_entry->layout;
+}
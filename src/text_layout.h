@@ -0,0 +1,50 @@
+/*
+ * Text layout cache
+ *
+ * draw_text breaks its bytes into rows and needs the font's line height,
+ * and NanoVG measures every glyph again to find either. Layouts are kept
+ * by text bytes and the style that decides where rows break, so a label
+ * is measured once, when first drawn in that style, however many scripts
+ * draw it and however often they are replaced. Layouts not drawn since
+ * the previous frame are dropped once the cache fills.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nanovg/nanovg.h"
+
+#define TEXT_WRAP_WIDTH 1000.0f    /* rows wider than this wrap at words */
+
+/* What row breaks depend on; the alignment only moves rows */
+typedef struct {
+    int font;       /* NanoVG face id */
+    float size;
+    float scale;    /* nvgTextScale */
+} text_style_t;
+
+/* Byte offsets of a row within the text */
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} text_row_t;
+
+typedef struct {
+    float line_height;
+    uint32_t row_count;
+    const text_row_t* p_rows;
+} text_layout_t;
+
+/* Layout of size bytes of text in the context's current text style, which
+ * p_style describes. Sets *p_reused if it came from the cache. NULL if a
+ * new layout cannot be allocated. */
+const text_layout_t* text_layout(NVGcontext* p_ctx, const char* p_text, uint32_t size,
+                                 const text_style_t* p_style, bool* p_reused);
+
+/* Marks the start of a frame, for eviction */
+void text_layout_frame(void);
+
+/* Drops every layout, as when NanoVG face ids may be reused */
+void reset_text_layouts(void);
@@ -0,0 +1,128 @@
+/*
+ * Shared-memory transport implementation
+ *
+ * The address is the path of a unix socket the driver listens on. After
+ * connecting, the renderer passes a memfd with both rings and the two
+ * doorbell eventfds over it (see shm_link.h); all data then moves
+ * through shared memory.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "scenic_transport.h"
+#include "shm_link.h"
+
+typedef struct {
+    shm_link_t link;
+    char path[256];
+} shm_data_t;
+
+static int shm_connect(scenic_transport_t* t, const char* address) {
+    shm_data_t* data = (shm_data_t*)t->impl_data;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, address, sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (shm_link_offer(&data->link, fd, SHM_LINK_RING_SIZE) < 0) {
+        close(fd);
+        return -1;
+    }
+    strncpy(data->path, address, sizeof(data->path) - 1);
+    t->connected = true;
+
+    return 0;
+}
+
+static void shm_disconnect(scenic_transport_t* t) {
+    shm_data_t* data = (shm_data_t*)t->impl_data;
+    shm_link_close(&data->link);
+    t->connected = false;
+}
+
+static int shm_send(scenic_transport_t* t, const void* buf, size_t len) {
+    shm_data_t* data = (shm_data_t*)t->impl_data;
+    if (!data->link.p_ctl) return -1;
+    if (len > INT_MAX) len = INT_MAX;
+    return (int)shm_link_write(&data->link, buf, len);
+}
+
+static int shm_recv(scenic_transport_t* t, void* buf, size_t max_len, int timeout_ms) {
+    shm_data_t* data = (shm_data_t*)t->impl_data;
+    if (!data->link.p_ctl) return -1;
+    if (max_len > INT_MAX) max_len = INT_MAX;
+
+    size_t n = shm_link_read(&data->link, buf, max_len);
+    if (n > 0) return (int)n;
+
+    /* Empty ring: this is also where a hangup is noticed */
+    if (shm_link_wait(&data->link, false, timeout_ms) < 0) return -1;
+    return (int)shm_link_read(&data->link, buf, max_len);
+}
+
+static bool shm_data_available(scenic_transport_t* t, int timeout_ms) {
+    shm_data_t* data = (shm_data_t*)t->impl_data;
+    if (!data->link.p_ctl) return false;
+    return shm_link_wait(&data->link, false, timeout_ms) != 0;
+}
+
+static int shm_get_fd(scenic_transport_t* t) {
+    /* The doorbell only fires while we are inside shm_link_wait */
+    return -1;
+}
+
+static void shm_wake(scenic_transport_t* t) {
+    shm_data_t* data = (shm_data_t*)t->impl_data;
+    shm_link_wake(&data->link);
+}
+
+static void shm_destroy(scenic_transport_t* t) {
+    if (t) {
+        shm_disconnect(t);
+        free(t->impl_data);
+        free(t);
+    }
+}
+
+static const scenic_transport_ops_t shm_ops = {
+    .connect = shm_connect,
+    .disconnect = shm_disconnect,
+    .send = shm_send,
+    .recv = shm_recv,
+    .data_available = shm_data_available,
+    .get_fd = shm_get_fd,
+    .destroy = shm_destroy,
+    .wake = shm_wake
+};
+
+scenic_transport_t* scenic_transport_shm_create(void) {
+    scenic_transport_t* t = calloc(1, sizeof(scenic_transport_t));
+    if (!t) return NULL;
+
+    shm_data_t* data = calloc(1, sizeof(shm_data_t));
+    if (!data) {
+        free(t);
+        return NULL;
+    }
+
+    shm_link_init(&data->link);
+    t->ops = &shm_ops;
+    t->impl_data = data;
+    t->connected = false;
+
+    return t;
+}
@@ -0,0 +1,325 @@
+/*
+ * Shared-memory link between renderer and a same-host driver
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "shm_link.h"
+
+#ifdef __linux__
+
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+#define SHM_CONTROL_SIZE 4096
+
+/* head is written only by the producer, tail only by the consumer */
+typedef struct {
+    alignas(64) _Atomic uint64_t head;
+    alignas(64) _Atomic uint64_t tail;
+} shm_ring_ctl_t;
+
+struct shm_control {
+    uint32_t magic;
+    uint32_t ring_size;
+    shm_ring_ctl_t ring[2];
+    alignas(64) _Atomic uint32_t sleeping[2];
+};
+
+_Static_assert(sizeof(shm_control_t) <= SHM_CONTROL_SIZE, "control page overflow");
+
+static inline int rx_ring(const shm_link_t* link) { return link->side; }
+static inline int tx_ring(const shm_link_t* link) { return 1 - link->side; }
+static inline int peer_side(const shm_link_t* link) { return 1 - link->side; }
+
+static void ring_bell(int fd) {
+    uint64_t one = 1;
+    ssize_t n = write(fd, &one, sizeof(one));
+    (void)n;
+}
+
+/* Pairs with the store/fence/check in shm_link_wait */
+static void notify_peer(shm_link_t* link) {
+    int peer = peer_side(link);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&link->p_ctl->sleeping[peer], memory_order_relaxed)) {
+        ring_bell(link->bell_fd[peer]);
+    }
+}
+
+static size_t writable(const shm_link_t* link) {
+    const shm_ring_ctl_t* c = &link->p_ctl->ring[tx_ring(link)];
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&c->tail, memory_order_acquire);
+    return link->ring_size - (size_t)(head - tail);
+}
+
+void shm_link_init(shm_link_t* link) {
+    memset(link, 0, sizeof(*link));
+    link->sock = -1;
+    link->mem_fd = -1;
+    link->bell_fd[0] = -1;
+    link->bell_fd[1] = -1;
+}
+
+static int map_rings(shm_link_t* link) {
+    link->map_size = SHM_CONTROL_SIZE + (size_t)link->ring_size * 2;
+    link->p_map = mmap(NULL, link->map_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, link->mem_fd, 0);
+    if (link->p_map == MAP_FAILED) {
+        link->p_map = NULL;
+        return -1;
+    }
+    link->p_ctl = (shm_control_t*)link->p_map;
+    link->p_ring[0] = (uint8_t*)link->p_map + SHM_CONTROL_SIZE;
+    link->p_ring[1] = link->p_ring[0] + link->ring_size;
+    return 0;
+}
+
+int shm_link_offer(shm_link_t* link, int sock, uint32_t ring_size) {
+    uint32_t size = 4096;
+    while (size < ring_size) size <<= 1;
+
+    link->side = SHM_SIDE_RENDERER;
+    link->ring_size = size;
+#ifdef SYS_memfd_create
+    link->mem_fd = (int)syscall(SYS_memfd_create, "scenic-shm", 1 /* MFD_CLOEXEC */);
+#endif
+    link->bell_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    link->bell_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (link->mem_fd < 0 || link->bell_fd[0] < 0 || link->bell_fd[1] < 0) {
+        shm_link_close(link);
+        return -1;
+    }
+
+    if (ftruncate(link->mem_fd, SHM_CONTROL_SIZE + (off_t)size * 2) < 0 ||
+        map_rings(link) < 0) {
+        shm_link_close(link);
+        return -1;
+    }
+    link->p_ctl->magic = SHM_LINK_MAGIC;
+    link->p_ctl->ring_size = size;
+
+    /* One byte of payload carries the three descriptors */
+    int fds[3] = { link->mem_fd, link->bell_fd[0], link->bell_fd[1] };
+    char byte = 0;
+    struct iovec iov = { &byte, 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } u;
+    memset(&u, 0, sizeof(u));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1) {
+        shm_link_close(link);
+        return -1;
+    }
+
+    link->sock = sock;
+    return 0;
+}
+
+int shm_link_accept(shm_link_t* link, int sock) {
+    char byte;
+    struct iovec iov = { &byte, 1 };
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } u;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1) return -1;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+        return -1;
+    }
+    int fds[3];
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    link->side = SHM_SIDE_DRIVER;
+    link->mem_fd = fds[0];
+    link->bell_fd[0] = fds[1];
+    link->bell_fd[1] = fds[2];
+
+    struct stat st;
+    if (fstat(link->mem_fd, &st) < 0 || st.st_size <= SHM_CONTROL_SIZE) {
+        shm_link_close(link);
+        return -1;
+    }
+    link->ring_size = (uint32_t)((st.st_size - SHM_CONTROL_SIZE) / 2);
+    if (map_rings(link) < 0 ||
+        link->p_ctl->magic != SHM_LINK_MAGIC ||
+        link->p_ctl->ring_size != link->ring_size) {
+        shm_link_close(link);
+        return -1;
+    }
+
+    link->sock = sock;
+    return 0;
+}
+
+void shm_link_close(shm_link_t* link) {
+    if (link->p_map) munmap(link->p_map, link->map_size);
+    if (link->mem_fd >= 0) close(link->mem_fd);
+    if (link->bell_fd[0] >= 0) close(link->bell_fd[0]);
+    if (link->bell_fd[1] >= 0) close(link->bell_fd[1]);
+    if (link->sock >= 0) close(link->sock);
+    shm_link_init(link);
+}
+
+size_t shm_link_write(shm_link_t* link, const void* buf, size_t len) {
+    shm_ring_ctl_t* c = &link->p_ctl->ring[tx_ring(link)];
+    uint8_t* p_data = link->p_ring[tx_ring(link)];
+
+    size_t n = writable(link);
+    if (n > len) n = len;
+    if (n == 0) return 0;
+
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+    size_t off = (size_t)(head & (link->ring_size - 1));
+    size_t first = link->ring_size - off;
+    if (first > n) first = n;
+    memcpy(p_data + off, buf, first);
+    memcpy(p_data, (const uint8_t*)buf + first, n - first);
+
+    atomic_store_explicit(&c->head, head + n, memory_order_release);
+    notify_peer(link);
+    return n;
+}
+
+size_t shm_link_readable(const shm_link_t* link) {
+    const shm_ring_ctl_t* c = &link->p_ctl->ring[rx_ring(link)];
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+    return (size_t)(head - tail);
+}
+
+size_t shm_link_read(shm_link_t* link, void* buf, size_t max_len) {
+    shm_ring_ctl_t* c = &link->p_ctl->ring[rx_ring(link)];
+    const uint8_t* p_data = link->p_ring[rx_ring(link)];
+
+    size_t n = shm_link_readable(link);
+    if (n > max_len) n = max_len;
+    if (n == 0) return 0;
+
+    uint64_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+    size_t off = (size_t)(tail & (link->ring_size - 1));
+    size_t first = link->ring_size - off;
+    if (first > n) first = n;
+    memcpy(buf, p_data + off, first);
+    memcpy((uint8_t*)buf + first, p_data, n - first);
+
+    atomic_store_explicit(&c->tail, tail + n, memory_order_release);
+    notify_peer(link);
+    return n;
+}
+
+static bool link_ready(const shm_link_t* link, bool for_space) {
+    return for_space ? writable(link) > 0 : shm_link_readable(link) > 0;
+}
+
+int shm_link_wait(shm_link_t* link, bool for_space, int timeout_ms) {
+    if (!link->p_ctl) return -1;
+    if (link_ready(link, for_space)) return 1;
+
+    /* Announce the sleep, then re-check so a concurrent notify is not lost */
+    _Atomic uint32_t* p_sleeping = &link->p_ctl->sleeping[link->side];
+    if (timeout_ms != 0) {
+        atomic_store_explicit(p_sleeping, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (link_ready(link, for_space)) {
+            atomic_store_explicit(p_sleeping, 0, memory_order_relaxed);
+            return 1;
+        }
+    }
+
+    /* The peer never writes to the socket, so any readiness means hangup */
+    struct pollfd pfd[2];
+    pfd[0].fd = link->bell_fd[link->side];
+    pfd[0].events = POLLIN;
+    pfd[1].fd = link->sock;
+    pfd[1].events = POLLIN;
+    int rc;
+    do {
+        rc = poll(pfd, 2, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+    atomic_store_explicit(p_sleeping, 0, memory_order_relaxed);
+
+    if (rc > 0 && (pfd[0].revents & POLLIN)) {
+        uint64_t count;
+        ssize_t n = read(pfd[0].fd, &count, sizeof(count));
+        (void)n;
+    }
+    if (link_ready(link, for_space)) return 1;
+    if (rc > 0 && pfd[1].revents) return -1;
+    return 0;
+}
+
+void shm_link_wake(shm_link_t* link) {
+    if (link->bell_fd[link->side] >= 0) {
+        ring_bell(link->bell_fd[link->side]);
+    }
+}
+
+#else /* !__linux__ */
+
+void shm_link_init(shm_link_t* link) {
+    memset(link, 0, sizeof(*link));
+    link->sock = -1;
+    link->mem_fd = -1;
+    link->bell_fd[0] = -1;
+    link->bell_fd[1] = -1;
+}
+
+int shm_link_offer(shm_link_t* link, int sock, uint32_t ring_size) { return -1; }
+int shm_link_accept(shm_link_t* link, int sock) { return -1; }
+
+void shm_link_close(shm_link_t* link) {
+    if (link->sock >= 0) close(link->sock);
+    shm_link_init(link);
+}
+
+size_t shm_link_write(shm_link_t* link, const void* buf, size_t len) { return 0; }
+size_t shm_link_read(shm_link_t* link, void* buf, size_t max_len) { return 0; }
+size_t shm_link_readable(const shm_link_t* link) { return 0; }
+int shm_link_wait(shm_link_t* link, bool for_space, int timeout_ms) { return -1; }
+void shm_link_wake(shm_link_t* link) { }
+
+#endif /* __linux__ */
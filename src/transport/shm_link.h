@@ -0,0 +1,63 @@
+/*
+ * Shared-memory link between renderer and a same-host driver
+ *
+ * One memfd holds a control page and two single-producer/single-consumer
+ * byte rings: ring 0 carries commands to the renderer, ring 1 carries
+ * events to the driver. Each side owns an eventfd doorbell that the peer
+ * rings only while that side has announced it is about to sleep, so a
+ * busy stream costs no syscalls at all. The unix socket used to pass the
+ * descriptors stays open purely as a liveness signal.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHM_LINK_MAGIC        0x53434e4du   /* "SCNM" */
+#define SHM_LINK_RING_SIZE    (8u << 20)    /* per direction, power of two */
+
+typedef enum {
+    SHM_SIDE_RENDERER = 0,
+    SHM_SIDE_DRIVER = 1
+} shm_side_t;
+
+typedef struct shm_control shm_control_t;
+
+typedef struct {
+    int sock;               /* unix socket to the peer, -1 if none */
+    int mem_fd;             /* memfd backing the rings */
+    int bell_fd[2];         /* eventfd doorbell per side */
+    shm_side_t side;
+    void* p_map;
+    size_t map_size;
+    shm_control_t* p_ctl;
+    uint8_t* p_ring[2];
+    uint32_t ring_size;
+} shm_link_t;
+
+void shm_link_init(shm_link_t* link);
+
+/* Renderer side: create the rings and hand them to the peer over sock */
+int shm_link_offer(shm_link_t* link, int sock, uint32_t ring_size);
+
+/* Driver side: receive and map the rings offered over sock */
+int shm_link_accept(shm_link_t* link, int sock);
+
+/* Unmap and close everything, including the socket */
+void shm_link_close(shm_link_t* link);
+
+/* Non-blocking; return bytes moved, 0 if the ring is full/empty */
+size_t shm_link_write(shm_link_t* link, const void* buf, size_t len);
+size_t shm_link_read(shm_link_t* link, void* buf, size_t max_len);
+
+/* Bytes waiting to be read by this side */
+size_t shm_link_readable(const shm_link_t* link);
+
+/* Sleep until data (or ring space, for_space) arrives, a wakeup is rung,
+ * or timeout_ms passes. Returns -1 once the peer has hung up. */
+int shm_link_wait(shm_link_t* link, bool for_space, int timeout_ms);
+
+/* Ring this side's own doorbell to interrupt a wait on another thread */
+void shm_link_wake(shm_link_t* link);
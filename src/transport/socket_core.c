@@ -0,0 +1,282 @@
+/*
+ * Shared readiness core for socket transports
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "socket_core.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+int sock_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+int sock_core_init(sock_core_t* core) {
+    core->fd = -1;
+    core->listen_fd = -1;
+    core->poll_fd = -1;
+    core->wake_fd = -1;
+    core->wake_write_fd = -1;
+    core->readable = false;
+
+#ifdef __linux__
+    core->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+    core->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (core->poll_fd < 0 || core->wake_fd < 0) {
+        sock_core_destroy(core);
+        return -1;
+    }
+    core->wake_write_fd = core->wake_fd;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = core->wake_fd;
+    if (epoll_ctl(core->poll_fd, EPOLL_CTL_ADD, core->wake_fd, &ev) < 0) {
+        sock_core_destroy(core);
+        return -1;
+    }
+#else
+    int fds[2];
+    if (pipe(fds) < 0) return -1;
+    sock_set_nonblocking(fds[0]);
+    sock_set_nonblocking(fds[1]);
+    core->wake_fd = fds[0];
+    core->wake_write_fd = fds[1];
+#endif
+    return 0;
+}
+
+void sock_core_destroy(sock_core_t* core) {
+    sock_core_close(core);
+    sock_core_close_listener(core);
+    if (core->wake_write_fd >= 0 && core->wake_write_fd != core->wake_fd) {
+        close(core->wake_write_fd);
+    }
+    if (core->wake_fd >= 0) {
+        close(core->wake_fd);
+    }
+    if (core->poll_fd >= 0) {
+        close(core->poll_fd);
+    }
+    core->wake_fd = -1;
+    core->wake_write_fd = -1;
+    core->poll_fd = -1;
+}
+
+int sock_core_attach(sock_core_t* core, int fd) {
+    if (sock_set_nonblocking(fd) < 0) return -1;
+
+#ifdef __linux__
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    if (epoll_ctl(core->poll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) return -1;
+#endif
+
+    core->fd = fd;
+    /* Data may already be queued before the first edge is reported */
+    core->readable = true;
+    return 0;
+}
+
+void sock_core_close(sock_core_t* core) {
+    if (core->fd >= 0) {
+        /* Closing the fd also drops it from the epoll set */
+        close(core->fd);
+        core->fd = -1;
+    }
+    core->readable = false;
+}
+
+int sock_core_listen(sock_core_t* core, int listen_fd) {
+    if (sock_set_nonblocking(listen_fd) < 0) return -1;
+
+#ifdef __linux__
+    /* Edge-triggered: a client arriving while one is attached stays in
+     * the backlog until sock_core_accept polls for it */
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listen_fd;
+    if (epoll_ctl(core->poll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) return -1;
+#endif
+
+    core->listen_fd = listen_fd;
+    return 0;
+}
+
+void sock_core_close_listener(sock_core_t* core) {
+    if (core->listen_fd >= 0) {
+        close(core->listen_fd);
+        core->listen_fd = -1;
+    }
+}
+
+int sock_core_accept(sock_core_t* core) {
+    if (core->fd >= 0) return 0;
+    if (core->listen_fd < 0) return -1;
+
+    for (;;) {
+        int fd = accept(core->listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            if (sock_core_attach(core, fd) < 0) {
+                close(fd);
+                return -1;
+            }
+            return 1;
+        }
+        if (errno == EINTR) continue;
+        /* Clients that vanished before accept are not our error */
+        if (errno == EAGAIN || errno == EWOULDBLOCK ||
+            errno == ECONNABORTED || errno == EPROTO) {
+            return 0;
+        }
+        return -1;
+    }
+}
+
+static void drain_wakeups(sock_core_t* core) {
+    uint8_t buf[64];
+    while (read(core->wake_fd, buf, sizeof(buf)) > 0) {
+        /* eventfd drains in one read; a pipe may need several */
+    }
+}
+
+bool sock_core_wait(sock_core_t* core, int timeout_ms) {
+    if (core->fd < 0) {
+        if (core->listen_fd < 0) return false;
+        if (sock_core_accept(core) > 0) return true;
+    }
+    if (core->readable) return true;
+
+#ifdef __linux__
+    struct epoll_event events[3];
+    int n = epoll_wait(core->poll_fd, events, 3, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == core->wake_fd) {
+            drain_wakeups(core);
+        } else if (events[i].data.fd == core->listen_fd) {
+            sock_core_accept(core);
+        } else {
+            /* EOF and errors also surface as readable so recv reports them */
+            core->readable = true;
+        }
+    }
+#else
+    struct pollfd fds[2];
+    bool listening = core->fd < 0;
+    fds[0].fd = listening ? core->listen_fd : core->fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = core->wake_fd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    if (poll(fds, 2, timeout_ms) > 0) {
+        if (fds[1].revents) {
+            drain_wakeups(core);
+        }
+        if (fds[0].revents) {
+            if (listening) {
+                sock_core_accept(core);
+            } else {
+                core->readable = true;
+            }
+        }
+    }
+#endif
+
+    return core->readable;
+}
+
+bool sock_core_wait_client(sock_core_t* core, int timeout_ms) {
+    if (core->listen_fd < 0) return false;
+
+    /* poll() rather than the epoll set: taking the listener's edge here
+     * would hide it from sock_core_wait */
+    struct pollfd fds[2];
+    fds[0].fd = core->listen_fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = core->wake_fd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    if (poll(fds, 2, timeout_ms) <= 0) return false;
+    if (fds[1].revents) {
+        drain_wakeups(core);
+    }
+    return fds[0].revents != 0;
+}
+
+int sock_core_recv(sock_core_t* core, void* buf, size_t max_len, int timeout_ms) {
+    if (core->fd < 0) {
+        if (core->listen_fd < 0) return -1;
+        if (!sock_core_wait(core, timeout_ms)) return 0;
+        timeout_ms = 0;
+    }
+
+    if (timeout_ms > 0 && !sock_core_wait(core, timeout_ms)) {
+        return 0;
+    }
+
+    for (;;) {
+        ssize_t received = recv(core->fd, buf, max_len, 0);
+        if (received > 0) {
+            /* A short read drained the socket; new data raises a new edge */
+            if ((size_t)received < max_len) {
+                core->readable = false;
+            }
+            return (int)received;
+        }
+        if (received == 0) {
+            return max_len == 0 ? 0 : -1;  /* peer closed */
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            core->readable = false;
+            return 0;
+        }
+        return -1;
+    }
+}
+
+int sock_core_send(sock_core_t* core, const void* buf, size_t len) {
+    if (core->fd < 0) return -1;
+
+    for (;;) {
+        ssize_t n = send(core->fd, buf, len, MSG_NOSIGNAL);
+        if (n >= 0) return (int)n;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        return -1;
+    }
+}
+
+void sock_core_wake(sock_core_t* core) {
+    if (core->wake_write_fd < 0) return;
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t n = write(core->wake_write_fd, &one, sizeof(one));
+#else
+    uint8_t one = 1;
+    ssize_t n = write(core->wake_write_fd, &one, sizeof(one));
+#endif
+    (void)n;
+}
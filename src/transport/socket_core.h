@@ -0,0 +1,63 @@
+/*
+ * Shared readiness core for socket transports
+ *
+ * Linux uses a private epoll instance with the socket registered
+ * edge-triggered and an eventfd for cross-thread wakeups. Other systems
+ * fall back to poll() and a self-pipe. Sockets are non-blocking, so
+ * readiness that is already known costs no syscall at all.
+ *
+ * In server mode a listening socket is registered too; while no client
+ * is attached, waits also cover it and a pending client is accepted
+ * without blocking.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    int fd;             /* connected stream socket, -1 if none */
+    int listen_fd;      /* server mode listening socket, -1 if none */
+    int poll_fd;        /* epoll instance, -1 when using poll() */
+    int wake_fd;        /* eventfd, or read end of the self-pipe */
+    int wake_write_fd;  /* write end of the self-pipe, same as wake_fd for eventfd */
+    bool readable;      /* socket edge seen and not yet drained */
+} sock_core_t;
+
+int sock_core_init(sock_core_t* core);
+void sock_core_destroy(sock_core_t* core);
+
+/* Take ownership of a connected socket (made non-blocking) */
+int sock_core_attach(sock_core_t* core, int fd);
+void sock_core_close(sock_core_t* core);
+
+/* Take ownership of a bound, listening socket (made non-blocking) */
+int sock_core_listen(sock_core_t* core, int listen_fd);
+void sock_core_close_listener(sock_core_t* core);
+
+/* Attach a pending client if none is attached yet.
+ * Returns 1 if one was attached, 0 if none is pending, -1 on error. */
+int sock_core_accept(sock_core_t* core);
+
+/* Wait up to timeout_ms for the socket to become readable or a wakeup.
+ * With no client attached, a client arriving on the listener counts. */
+bool sock_core_wait(sock_core_t* core, int timeout_ms);
+
+/* Wait up to timeout_ms for a client on the listener or a wakeup. Nothing
+ * is accepted and only the wakeup is consumed, so this may run on another
+ * thread while the owner sends. True if a client is pending. */
+bool sock_core_wait_client(sock_core_t* core, int timeout_ms);
+
+/* Returns bytes read, 0 if nothing is pending (or, in server mode, no
+ * client is attached yet), -1 on error or EOF */
+int sock_core_recv(sock_core_t* core, void* buf, size_t max_len, int timeout_ms);
+
+/* Returns bytes sent (possibly short), 0 if the socket is full, -1 on error */
+int sock_core_send(sock_core_t* core, const void* buf, size_t len);
+
+/* Interrupt a sock_core_wait in progress on another thread */
+void sock_core_wake(sock_core_t* core);
+
+/* Helpers for socket setup */
+int sock_set_nonblocking(int fd);
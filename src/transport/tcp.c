@@ -10,15 +10,14 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
-#include <sys/select.h>
 #include <errno.h>
 #include <stdio.h>
 
 #include "scenic_transport.h"
+#include "socket_core.h"
 
 typedef struct {
-    int fd;
-    int listen_fd;  /* For server mode */
+    sock_core_t core;
     char host[256];
     int port;
     bool is_server;
@@ -70,7 +69,10 @@ static int tcp_connect(scenic_transport_t* t, const char* address) {
     int flag = 1;
     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
 
-    data->fd = fd;
+    if (sock_core_attach(&data->core, fd) < 0) {
+        close(fd);
+        return -1;
+    }
     strncpy(data->host, host, sizeof(data->host) - 1);
     data->port = port;
     t->connected = true;
@@ -119,93 +121,87 @@ static int tcp_server_connect(scenic_transport_t* t, const char* address) {
         return -1;
     }
 
-    data->listen_fd = listen_fd;
-    strncpy(data->host, host, sizeof(data->host) - 1);
-    data->port = port;
-
-    /* Accept connection (blocking) */
-    struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int client_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &client_len);
-    if (client_fd < 0) {
+    /* Clients are accepted from recv/data_available, never blocking */
+    if (sock_core_listen(&data->core, listen_fd) < 0) {
         close(listen_fd);
         return -1;
     }
-
-    int flag = 1;
-    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
-
-    data->fd = client_fd;
-    t->connected = true;
+    strncpy(data->host, host, sizeof(data->host) - 1);
+    data->port = port;
 
     return 0;
 }
 
-static void tcp_disconnect(scenic_transport_t* t) {
+/* Pick up a client attached by the core since the last call */
+static void tcp_server_sync(scenic_transport_t* t) {
     tcp_data_t* data = (tcp_data_t*)t->impl_data;
-    if (data->fd >= 0) {
-        close(data->fd);
-        data->fd = -1;
-    }
-    if (data->listen_fd >= 0) {
-        close(data->listen_fd);
-        data->listen_fd = -1;
+    if (!t->connected && data->core.fd >= 0) {
+        int flag = 1;
+        setsockopt(data->core.fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        t->connected = true;
     }
+}
+
+static void tcp_disconnect(scenic_transport_t* t) {
+    tcp_data_t* data = (tcp_data_t*)t->impl_data;
+    sock_core_close(&data->core);
+    sock_core_close_listener(&data->core);
     t->connected = false;
 }
 
 static int tcp_send(scenic_transport_t* t, const void* buf, size_t len) {
     tcp_data_t* data = (tcp_data_t*)t->impl_data;
-    if (data->fd < 0) return -1;
-
-    ssize_t sent = send(data->fd, buf, len, 0);
-    return (int)sent;
+    return sock_core_send(&data->core, buf, len);
 }
 
 static int tcp_recv(scenic_transport_t* t, void* buf, size_t max_len, int timeout_ms) {
     tcp_data_t* data = (tcp_data_t*)t->impl_data;
-    if (data->fd < 0) return -1;
-
-    if (timeout_ms > 0) {
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(data->fd, &fds);
-
-        struct timeval tv;
-        tv.tv_sec = timeout_ms / 1000;
-        tv.tv_usec = (timeout_ms % 1000) * 1000;
-
-        int result = select(data->fd + 1, &fds, NULL, NULL, &tv);
-        if (result <= 0) return result;
-    }
-
-    ssize_t received = recv(data->fd, buf, max_len, 0);
-    return (int)received;
+    return sock_core_recv(&data->core, buf, max_len, timeout_ms);
 }
 
 static bool tcp_data_available(scenic_transport_t* t, int timeout_ms) {
     tcp_data_t* data = (tcp_data_t*)t->impl_data;
-    if (data->fd < 0) return false;
+    return sock_core_wait(&data->core, timeout_ms);
+}
 
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(data->fd, &fds);
+static int tcp_get_fd(scenic_transport_t* t) {
+    tcp_data_t* data = (tcp_data_t*)t->impl_data;
+    return data->core.fd;
+}
 
-    struct timeval tv;
-    tv.tv_sec = timeout_ms / 1000;
-    tv.tv_usec = (timeout_ms % 1000) * 1000;
+static void tcp_wake(scenic_transport_t* t) {
+    tcp_data_t* data = (tcp_data_t*)t->impl_data;
+    sock_core_wake(&data->core);
+}
 
-    return select(data->fd + 1, &fds, NULL, NULL, &tv) > 0;
+static bool tcp_wait_client(scenic_transport_t* t, int timeout_ms) {
+    tcp_data_t* data = (tcp_data_t*)t->impl_data;
+    return sock_core_wait_client(&data->core, timeout_ms);
 }
 
-static int tcp_get_fd(scenic_transport_t* t) {
+static int tcp_server_recv(scenic_transport_t* t, void* buf, size_t max_len, int timeout_ms) {
+    tcp_data_t* data = (tcp_data_t*)t->impl_data;
+    int n = sock_core_recv(&data->core, buf, max_len, timeout_ms);
+    tcp_server_sync(t);
+    if (n < 0) {
+        /* Drop the client but keep listening for the next one */
+        sock_core_close(&data->core);
+        t->connected = false;
+    }
+    return n;
+}
+
+static bool tcp_server_data_available(scenic_transport_t* t, int timeout_ms) {
     tcp_data_t* data = (tcp_data_t*)t->impl_data;
-    return data->fd;
+    bool ready = sock_core_wait(&data->core, timeout_ms);
+    tcp_server_sync(t);
+    return ready;
 }
 
 static void tcp_destroy(scenic_transport_t* t) {
     if (t) {
         tcp_disconnect(t);
+        sock_core_destroy(&((tcp_data_t*)t->impl_data)->core);
         free(t->impl_data);
         free(t);
     }
@@ -218,17 +214,20 @@ static const scenic_transport_ops_t tcp_client_ops = {
     .recv = tcp_recv,
     .data_available = tcp_data_available,
     .get_fd = tcp_get_fd,
-    .destroy = tcp_destroy
+    .destroy = tcp_destroy,
+    .wake = tcp_wake
 };
 
 static const scenic_transport_ops_t tcp_server_ops = {
     .connect = tcp_server_connect,
     .disconnect = tcp_disconnect,
     .send = tcp_send,
-    .recv = tcp_recv,
-    .data_available = tcp_data_available,
+    .recv = tcp_server_recv,
+    .data_available = tcp_server_data_available,
     .get_fd = tcp_get_fd,
-    .destroy = tcp_destroy
+    .destroy = tcp_destroy,
+    .wake = tcp_wake,
+    .wait_client = tcp_wait_client
 };
 
 scenic_transport_t* scenic_transport_tcp_create(void) {
@@ -241,8 +240,11 @@ scenic_transport_t* scenic_transport_tcp_create(void) {
         return NULL;
     }
 
-    data->fd = -1;
-    data->listen_fd = -1;
+    if (sock_core_init(&data->core) < 0) {
+        free(data);
+        free(t);
+        return NULL;
+    }
     data->is_server = false;
     t->ops = &tcp_client_ops;
     t->impl_data = data;
@@ -261,8 +263,11 @@ scenic_transport_t* scenic_transport_tcp_server_create(void) {
         return NULL;
     }
 
-    data->fd = -1;
-    data->listen_fd = -1;
+    if (sock_core_init(&data->core) < 0) {
+        free(data);
+        free(t);
+        return NULL;
+    }
     data->is_server = true;
     t->ops = &tcp_server_ops;
     t->impl_data = data;
@@ -4,3 +4,9 @@
 
 #include <stdlib.h>
 #include "scenic_transport.h"
+
+void scenic_transport_wake(scenic_transport_t* t) {
+    if (t && t->ops->wake) {
+        t->ops->wake(t);
+    }
+}
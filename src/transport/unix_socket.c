@@ -6,15 +6,17 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
-#include <sys/select.h>
 #include <errno.h>
 
 #include "scenic_transport.h"
+#include "socket_core.h"
 
 typedef struct {
-    int fd;
+    sock_core_t core;
     char path[256];
+    bool is_server;
 } unix_socket_data_t;
 
 static int unix_connect(scenic_transport_t* t, const char* address) {
@@ -33,74 +35,122 @@ static int unix_connect(scenic_transport_t* t, const char* address) {
         return -1;
     }
 
-    data->fd = fd;
+    if (sock_core_attach(&data->core, fd) < 0) {
+        close(fd);
+        return -1;
+    }
     strncpy(data->path, address, sizeof(data->path) - 1);
     t->connected = true;
 
     return 0;
 }
 
+/* Server connect: bind and listen at the socket path */
+static int unix_server_connect(scenic_transport_t* t, const char* address) {
+    unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(address) >= sizeof(addr.sun_path)) return -1;
+    strncpy(addr.sun_path, address, sizeof(addr.sun_path) - 1);
+
+    /* A previous run may have left its socket behind; anything else at the
+     * path is not ours to remove */
+    struct stat st;
+    if (lstat(address, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            errno = EEXIST;
+            return -1;
+        }
+        unlink(address);
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) return -1;
+
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(listen_fd);
+        return -1;
+    }
+
+    if (listen(listen_fd, 1) < 0 || sock_core_listen(&data->core, listen_fd) < 0) {
+        close(listen_fd);
+        unlink(address);
+        return -1;
+    }
+    strncpy(data->path, address, sizeof(data->path) - 1);
+
+    /* Clients are accepted from recv/data_available, never blocking */
+    return 0;
+}
+
 static void unix_disconnect(scenic_transport_t* t) {
     unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
-    if (data->fd >= 0) {
-        close(data->fd);
-        data->fd = -1;
+    sock_core_close(&data->core);
+    if (data->is_server && data->core.listen_fd >= 0) {
+        sock_core_close_listener(&data->core);
+        unlink(data->path);
     }
     t->connected = false;
 }
 
 static int unix_send(scenic_transport_t* t, const void* buf, size_t len) {
     unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
-    if (data->fd < 0) return -1;
-
-    ssize_t sent = send(data->fd, buf, len, 0);
-    return (int)sent;
+    return sock_core_send(&data->core, buf, len);
 }
 
 static int unix_recv(scenic_transport_t* t, void* buf, size_t max_len, int timeout_ms) {
     unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
-    if (data->fd < 0) return -1;
-
-    if (timeout_ms > 0) {
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(data->fd, &fds);
-
-        struct timeval tv;
-        tv.tv_sec = timeout_ms / 1000;
-        tv.tv_usec = (timeout_ms % 1000) * 1000;
-
-        int result = select(data->fd + 1, &fds, NULL, NULL, &tv);
-        if (result <= 0) return result;
-    }
-
-    ssize_t received = recv(data->fd, buf, max_len, 0);
-    return (int)received;
+    return sock_core_recv(&data->core, buf, max_len, timeout_ms);
 }
 
 static bool unix_data_available(scenic_transport_t* t, int timeout_ms) {
     unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
-    if (data->fd < 0) return false;
+    return sock_core_wait(&data->core, timeout_ms);
+}
 
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(data->fd, &fds);
+static int unix_server_recv(scenic_transport_t* t, void* buf, size_t max_len, int timeout_ms) {
+    unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
+    int n = sock_core_recv(&data->core, buf, max_len, timeout_ms);
+    if (n < 0) {
+        /* Drop the client but keep listening for the next one */
+        sock_core_close(&data->core);
+    }
+    t->connected = data->core.fd >= 0;
+    return n;
+}
 
-    struct timeval tv;
-    tv.tv_sec = timeout_ms / 1000;
-    tv.tv_usec = (timeout_ms % 1000) * 1000;
+static bool unix_server_data_available(scenic_transport_t* t, int timeout_ms) {
+    unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
+    bool ready = sock_core_wait(&data->core, timeout_ms);
+    /* Only an accept changes it; a watcher thread may wait here while
+     * the owner reads connected */
+    if (!t->connected && data->core.fd >= 0) {
+        t->connected = true;
+    }
+    return ready;
+}
 
-    return select(data->fd + 1, &fds, NULL, NULL, &tv) > 0;
+static bool unix_wait_client(scenic_transport_t* t, int timeout_ms) {
+    unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
+    return sock_core_wait_client(&data->core, timeout_ms);
 }
 
 static int unix_get_fd(scenic_transport_t* t) {
     unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
-    return data->fd;
+    return data->core.fd;
+}
+
+static void unix_wake(scenic_transport_t* t) {
+    unix_socket_data_t* data = (unix_socket_data_t*)t->impl_data;
+    sock_core_wake(&data->core);
 }
 
 static void unix_destroy(scenic_transport_t* t) {
     if (t) {
         unix_disconnect(t);
+        sock_core_destroy(&((unix_socket_data_t*)t->impl_data)->core);
         free(t->impl_data);
         free(t);
     }
@@ -113,10 +163,23 @@ static const scenic_transport_ops_t unix_socket_ops = {
     .recv = unix_recv,
     .data_available = unix_data_available,
     .get_fd = unix_get_fd,
-    .destroy = unix_destroy
+    .destroy = unix_destroy,
+    .wake = unix_wake
 };
 
-scenic_transport_t* scenic_transport_unix_socket_create(void) {
+static const scenic_transport_ops_t unix_server_ops = {
+    .connect = unix_server_connect,
+    .disconnect = unix_disconnect,
+    .send = unix_send,
+    .recv = unix_server_recv,
+    .data_available = unix_server_data_available,
+    .get_fd = unix_get_fd,
+    .destroy = unix_destroy,
+    .wake = unix_wake,
+    .wait_client = unix_wait_client
+};
+
+static scenic_transport_t* unix_create(const scenic_transport_ops_t* ops, bool is_server) {
     scenic_transport_t* t = calloc(1, sizeof(scenic_transport_t));
     if (!t) return NULL;
 
@@ -126,10 +189,23 @@ scenic_transport_t* scenic_transport_unix_socket_create(void) {
         return NULL;
     }
 
-    data->fd = -1;
-    t->ops = &unix_socket_ops;
+    if (sock_core_init(&data->core) < 0) {
+        free(data);
+        free(t);
+        return NULL;
+    }
+    data->is_server = is_server;
+    t->ops = ops;
     t->impl_data = data;
     t->connected = false;
 
     return t;
 }
+
+scenic_transport_t* scenic_transport_unix_socket_create(void) {
+    return unix_create(&unix_socket_ops, false);
+}
+
+scenic_transport_t* scenic_transport_unix_server_create(void) {
+    return unix_create(&unix_server_ops, true);
+}
@@ -14,6 +14,8 @@
 #include "nanovg/nanovg.h"
 #endif
 
+#include "tommyds/tommyhash.h"
+
 #ifndef PACK
   #ifdef _MSC_VER
     #define PACK( __Declaration__ ) \
@@ -44,3 +46,26 @@ typedef struct _data_t {
 
 /* Script ID type (alias for data_t) */
 typedef data_t sid_t;
+
+/* Hash for sid_t keyed tables; ids are interned with it (intern.h) */
+static inline uint32_t sid_hash(sid_t id) {
+  return tommy_hash_u32(0, id.p_data, id.size);
+}
+
+/*
+ * Sink for a command payload that is too large for the receive buffer.
+ * Bytes land directly at p_dest when write is NULL, otherwise they are
+ * handed to write() (e.g. to convert pixels as they arrive). A sink with
+ * neither simply discards what it is given.
+ */
+typedef struct _stream_t {
+  void* p_obj;
+  uint8_t* p_dest;
+  uint32_t dest_left;
+  uint32_t format;
+  uint8_t carry[4];
+  uint32_t carry_len;
+  void (*write)(struct _stream_t* p_stream, const uint8_t* p, uint32_t len);
+  void (*finish)(struct _stream_t* p_stream, NVGcontext* p_ctx);
+  void (*abort)(struct _stream_t* p_stream, NVGcontext* p_ctx);
+} stream_t;
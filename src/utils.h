@@ -10,6 +10,16 @@
 #define ALIGN_UP(n, s) (((n) + (s) - 1) & ~((s) - 1))
 #define ALIGN_DOWN(n, s) ((n) & ~((s) - 1))
 
+#include <stdint.h>
+#include <time.h>
+
 void check_gl_error(void);
 
+/* Monotonic clock in microseconds */
+static inline uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
 #endif
@@ -0,0 +1,97 @@
+/*
+ * Stub NanoVG back end shared by the tests
+ *
+ * Nothing is drawn: every call succeeds, and textures are numbered from 1
+ * in creation order. Tests watch what NanoVG hands the back end through
+ * the counters below and the optional hooks in stub_nvg_hooks_t.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "nanovg/nanovg.h"
+
+typedef struct {
+    int texture_size;           /* reported for every texture, 0: 512 */
+    bool antialias;             /* edge antialiasing, off by default */
+
+    /* Pixels passed to renderCreateTexture or renderUpdateTexture */
+    void (*upload)(const unsigned char* data);
+    /* Setting this also enables nvgUpdateImageRegion */
+    void (*update_region)(int image, int x, int y, int w, int h,
+                          const unsigned char* data);
+    void (*fill)(const NVGpaint* paint, const NVGscissor* scissor,
+                 const NVGpath* paths, int npaths);
+    void (*stroke)(const NVGpath* paths, int npaths);
+    void (*triangles)(const NVGvertex* verts, int nverts);
+} stub_nvg_hooks_t;
+
+static stub_nvg_hooks_t stub_hooks;
+static int stub_creates;        /* textures created, not counting the font atlas */
+static int stub_updates;        /* whole-texture updates */
+
+static int stub_create(void* uptr) { return 1; }
+static int stub_create_texture(void* uptr, int type, int w, int h, int flags,
+                               const unsigned char* data) {
+    if (stub_hooks.upload && data) stub_hooks.upload(data);
+    return ++stub_creates;
+}
+static int stub_delete_texture(void* uptr, int image) { return 1; }
+static int stub_update_texture(void* uptr, int image, int x, int y, int w, int h,
+                               const unsigned char* data) {
+    if (stub_hooks.upload && data) stub_hooks.upload(data);
+    stub_updates++;
+    return 1;
+}
+static int stub_update_region(void* uptr, int image, int x, int y, int w, int h,
+                              const unsigned char* data) {
+    stub_hooks.update_region(image, x, y, w, h, data);
+    return 1;
+}
+static int stub_texture_size(void* uptr, int image, int* w, int* h) {
+    *w = *h = stub_hooks.texture_size ? stub_hooks.texture_size : 512;
+    return 1;
+}
+static void stub_viewport(void* uptr, float w, float h, float ratio) { }
+static void stub_nop(void* uptr) { }
+static void stub_fill(void* uptr, NVGpaint* paint, NVGcompositeOperationState op,
+                      NVGscissor* scissor, float fringe, const float* bounds,
+                      const NVGpath* paths, int npaths) {
+    if (stub_hooks.fill) stub_hooks.fill(paint, scissor, paths, npaths);
+}
+static void stub_stroke(void* uptr, NVGpaint* paint, NVGcompositeOperationState op,
+                        NVGscissor* scissor, float fringe, float stroke_width,
+                        const NVGpath* paths, int npaths) {
+    if (stub_hooks.stroke) stub_hooks.stroke(paths, npaths);
+}
+static void stub_triangles(void* uptr, NVGpaint* paint, NVGcompositeOperationState op,
+                           NVGscissor* scissor, const NVGvertex* verts, int nverts,
+                           float fringe) {
+    if (stub_hooks.triangles) stub_hooks.triangles(verts, nverts);
+}
+
+/* A context on the stub back end; p_hooks may be NULL */
+static NVGcontext* stub_nvg_create(const stub_nvg_hooks_t* p_hooks) {
+    stub_hooks = p_hooks ? *p_hooks : (stub_nvg_hooks_t){0};
+    NVGparams params = {
+        .renderCreate = stub_create,
+        .renderCreateTexture = stub_create_texture,
+        .renderDeleteTexture = stub_delete_texture,
+        .renderUpdateTexture = stub_update_texture,
+        .renderUpdateTextureRegion = stub_hooks.update_region ? stub_update_region : NULL,
+        .renderGetTextureSize = stub_texture_size,
+        .renderViewport = stub_viewport,
+        .renderCancel = stub_nop,
+        .renderFlush = stub_nop,
+        .renderFill = stub_fill,
+        .renderStroke = stub_stroke,
+        .renderTriangles = stub_triangles,
+        .renderDelete = stub_nop,
+        .edgeAntiAlias = stub_hooks.antialias,
+    };
+    NVGcontext* p_ctx = nvgCreateInternal(&params);
+    stub_creates = 0;
+    stub_updates = 0;
+    return p_ctx;
+}
@@ -0,0 +1,173 @@
+/*
+ * Asset cache tests
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "sha256.h"
+#include "asset_cache.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    static void test_##name(void)
+
+#define RUN_TEST(name) do { \
+    printf("  Running %s...", #name); \
+    tests_run++; \
+    test_##name(); \
+    tests_passed++; \
+    printf(" OK\n"); \
+} while(0)
+
+#define ASSERT(cond) do { \
+    if (!(cond)) { \
+        printf(" FAILED at line %d: %s\n", __LINE__, #cond); \
+        exit(1); \
+    } \
+} while(0)
+
+static void from_hex(uint8_t* p_out, const char* hex) {
+    for (int i = 0; i < SHA256_SIZE; i++) {
+        unsigned int v;
+        sscanf(hex + i * 2, "%2x", &v);
+        p_out[i] = (uint8_t)v;
+    }
+}
+
+static char g_dir[64];
+
+static void make_cache_dir(void) {
+    snprintf(g_dir, sizeof(g_dir), "/tmp/scenic_cache_XXXXXX");
+    ASSERT(mkdtemp(g_dir) != NULL);
+}
+
+static void remove_cache_dir(void) {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", g_dir);
+    ASSERT(system(cmd) == 0);
+}
+
+TEST(sha256_vectors) {
+    uint8_t digest[SHA256_SIZE];
+    uint8_t expect[SHA256_SIZE];
+
+    sha256("", 0, digest);
+    from_hex(expect, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    ASSERT(memcmp(digest, expect, SHA256_SIZE) == 0);
+
+    sha256("abc", 3, digest);
+    from_hex(expect, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    ASSERT(memcmp(digest, expect, SHA256_SIZE) == 0);
+
+    /* Two blocks, fed in uneven pieces */
+    const char* msg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, msg, 3);
+    sha256_update(&ctx, msg + 3, 50);
+    sha256_update(&ctx, msg + 53, strlen(msg) - 53);
+    sha256_final(&ctx, digest);
+    from_hex(expect, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    ASSERT(memcmp(digest, expect, SHA256_SIZE) == 0);
+}
+
+TEST(store_and_map) {
+    make_cache_dir();
+    ASSERT(asset_cache_init(g_dir));
+
+    size_t size = 300 * 1000;
+    uint8_t* p_data = malloc(size);
+    ASSERT(p_data);
+    for (size_t i = 0; i < size; i++) p_data[i] = (uint8_t)(i * 7);
+    uint8_t hash[SHA256_SIZE];
+    sha256(p_data, size, hash);
+
+    asset_map_t map;
+    ASSERT(!asset_cache_map(hash, &map));
+    ASSERT(asset_cache_store(hash, p_data, size));
+    ASSERT(asset_cache_map(hash, &map));
+    ASSERT(map.size == size);
+    ASSERT(memcmp(map.p_data, p_data, size) == 0);
+    asset_cache_unmap(&map);
+
+    /* Data that does not match its announced hash is never stored */
+    uint8_t bogus[SHA256_SIZE];
+    memset(bogus, 0x5a, sizeof(bogus));
+    ASSERT(!asset_cache_store(bogus, p_data, size));
+    ASSERT(!asset_cache_map(bogus, &map));
+
+    free(p_data);
+    asset_cache_done();
+    remove_cache_dir();
+}
+
+TEST(writer_in_pieces) {
+    make_cache_dir();
+    ASSERT(asset_cache_init(g_dir));
+
+    const char* msg = "a font blob arriving in pieces";
+    uint8_t hash[SHA256_SIZE];
+    sha256(msg, strlen(msg), hash);
+
+    asset_writer_t writer;
+    ASSERT(asset_writer_begin(&writer, hash));
+    asset_writer_write(&writer, msg, 5);
+    asset_writer_write(&writer, msg + 5, strlen(msg) - 5);
+    ASSERT(asset_writer_commit(&writer));
+
+    asset_map_t map;
+    ASSERT(asset_cache_map(hash, &map));
+    ASSERT(map.size == strlen(msg));
+    asset_cache_unmap(&map);
+
+    /* An aborted write leaves nothing behind */
+    uint8_t other[SHA256_SIZE];
+    sha256("other", 5, other);
+    ASSERT(asset_writer_begin(&writer, other));
+    asset_writer_write(&writer, "oth", 3);
+    asset_writer_abort(&writer);
+    ASSERT(!asset_cache_map(other, &map));
+
+    asset_cache_done();
+    remove_cache_dir();
+}
+
+TEST(expected_hashes) {
+    make_cache_dir();
+    ASSERT(asset_cache_init(g_dir));
+
+    uint8_t hash[SHA256_SIZE];
+    uint8_t got[SHA256_SIZE];
+    sha256("x", 1, hash);
+    sid_t id = { "logo", 4 };
+
+    ASSERT(!asset_cache_take_expected(ASSET_IMAGE, id, got));
+    asset_cache_expect(ASSET_IMAGE, id, hash);
+
+    /* Fonts and images are separate namespaces */
+    ASSERT(!asset_cache_take_expected(ASSET_FONT, id, got));
+    ASSERT(asset_cache_take_expected(ASSET_IMAGE, id, got));
+    ASSERT(memcmp(got, hash, SHA256_SIZE) == 0);
+    ASSERT(!asset_cache_take_expected(ASSET_IMAGE, id, got));
+
+    asset_cache_done();
+    remove_cache_dir();
+}
+
+int main(void) {
+    printf("Running asset cache tests...\n");
+
+    RUN_TEST(sha256_vectors);
+    RUN_TEST(store_and_map);
+    RUN_TEST(writer_in_pieces);
+    RUN_TEST(expected_hashes);
+
+    printf("\nAll tests passed! (%d/%d)\n", tests_passed, tests_run);
+    return 0;
+}
@@ -0,0 +1,413 @@
+/*
+ * Damage tracking and partial redraw tests
+ *
+ * Frames are rasterized by a minimal software NanoVG back end, so the
+ * pixels a partial redraw leaves behind can be compared with a full one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "scenic_renderer.h"
+#include "nanovg/nanovg.h"
+#include "stub_nvg.h"
+
+extern void scenic_renderer_set_nvg_context(scenic_renderer_t* r, NVGcontext* ctx);
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    static void test_##name(void)
+
+#define RUN_TEST(name) do { \
+    printf("  Running %s...", #name); \
+    tests_run++; \
+    test_##name(); \
+    tests_passed++; \
+    printf(" OK\n"); \
+} while(0)
+
+#define ASSERT(cond) do { \
+    if (!(cond)) { \
+        printf(" FAILED at line %d: %s\n", __LINE__, #cond); \
+        exit(1); \
+    } \
+} while(0)
+
+#define W 200
+#define H 100
+
+/*
+ * Software target: solid fills only, no antialiasing, pixel centers
+ * tested against the path with the nonzero rule
+ */
+
+static uint32_t* p_target;
+static uint32_t canvas[W * H];
+static uint32_t reference[W * H];
+static uint32_t clear_rgba = 0xff000000;
+static int buffer_age = 1;
+static uint32_t pixels_cleared;
+static uint32_t pixels_filled;
+static int frames_begun;
+
+static uint32_t pack(NVGcolor c) {
+    return (uint32_t)(c.r * 255.0f + 0.5f) | (uint32_t)(c.g * 255.0f + 0.5f) << 8 |
+           (uint32_t)(c.b * 255.0f + 0.5f) << 16 | (uint32_t)(c.a * 255.0f + 0.5f) << 24;
+}
+
+static bool in_scissor(const NVGscissor* p_sc, float x, float y) {
+    if (p_sc->extent[0] < -0.5f) return true;
+    float inv[6];
+    nvgTransformInverse(inv, p_sc->xform);
+    float sx, sy;
+    nvgTransformPoint(&sx, &sy, inv, x, y);
+    return sx >= -p_sc->extent[0] && sx <= p_sc->extent[0] &&
+           sy >= -p_sc->extent[1] && sy <= p_sc->extent[1];
+}
+
+static int winding(const NVGpath* paths, int npaths, float x, float y) {
+    int wn = 0;
+    for (int p = 0; p < npaths; p++) {
+        const NVGvertex* v = paths[p].fill;
+        int n = paths[p].nfill;
+        for (int i = 0, j = n - 1; i < n; j = i++) {
+            if (v[j].y <= y) {
+                if (v[i].y > y &&
+                    (v[i].x - v[j].x) * (y - v[j].y) - (x - v[j].x) * (v[i].y - v[j].y) > 0) wn++;
+            } else if (v[i].y <= y &&
+                       (v[i].x - v[j].x) * (y - v[j].y) - (x - v[j].x) * (v[i].y - v[j].y) < 0) {
+                wn--;
+            }
+        }
+    }
+    return wn;
+}
+
+static void sw_fill(const NVGpaint* paint, const NVGscissor* scissor,
+                    const NVGpath* paths, int npaths) {
+    uint32_t rgba = pack(paint->innerColor);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            float px = x + 0.5f, py = y + 0.5f;
+            if (winding(paths, npaths, px, py) != 0 && in_scissor(scissor, px, py)) {
+                p_target[y * W + x] = rgba;
+                pixels_filled++;
+            }
+        }
+    }
+}
+
+static NVGcontext* sw_nvg(void) {
+    stub_nvg_hooks_t hooks = { .fill = sw_fill };
+    return stub_nvg_create(&hooks);
+}
+
+/* Platform callbacks drawing into p_target */
+
+static void clear_area(int x, int y, int w, int h) {
+    for (int row = y; row < y + h; row++) {
+        for (int col = x; col < x + w; col++) p_target[row * W + col] = clear_rgba;
+    }
+    pixels_cleared += (uint32_t)(w * h);
+}
+
+static void test_begin_frame(void* user_data, int width, int height, float ratio) {
+    frames_begun++;
+    clear_area(0, 0, width, height);
+}
+
+static void test_begin_region(void* user_data, int width, int height, float ratio,
+                              int x, int y, int w, int h) {
+    frames_begun++;
+    clear_area(x, y, w, h);
+}
+
+static int test_buffer_age(void* user_data) {
+    return buffer_age;
+}
+
+/* Script building */
+
+typedef struct {
+    uint8_t b[1024];
+    uint32_t n;
+} body_t;
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static void op(body_t* p, uint16_t code, uint16_t param) {
+    put_u32(p->b + p->n, ((uint32_t)code << 16) | param);
+    p->n += 4;
+}
+
+static void fl(body_t* p, float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    put_u32(p->b + p->n, u);
+    p->n += 4;
+}
+
+static void color(body_t* p, uint8_t r, uint8_t g, uint8_t b) {
+    op(p, 0x60, 0);
+    uint8_t* c = p->b + p->n;
+    c[0] = r;
+    c[1] = g;
+    c[2] = b;
+    c[3] = 0xff;
+    p->n += 4;
+}
+
+static void rect(body_t* p, float w, float h) {
+    op(p, 0x04, 1);
+    fl(p, w);
+    fl(p, h);
+}
+
+static void translate(body_t* p, float x, float y) {
+    op(p, 0x53, 0);
+    fl(p, x);
+    fl(p, y);
+}
+
+/* push; translate(x, y); render_script id; pop */
+static void place(body_t* p, const char* id, float x, float y) {
+    uint32_t len = (uint32_t)strlen(id);
+    op(p, 0x40, 0);
+    translate(p, x, y);
+    op(p, 0x0F, len);
+    memset(p->b + p->n, 0, (len + 3) & ~3u);
+    memcpy(p->b + p->n, id, len);
+    p->n += (len + 3) & ~3u;
+    op(p, 0x41, 0);
+}
+
+static void put_body(scenic_renderer_t* r, const char* id, const body_t* p_body) {
+    uint8_t buf[1100];
+    uint32_t id_len = (uint32_t)strlen(id);
+    put_u32(buf, id_len);
+    memcpy(buf + 4, id, id_len);
+    memcpy(buf + 4 + id_len, p_body->b, p_body->n);
+    scenic_renderer_cmd_put_script(r, buf, 4 + id_len + p_body->n);
+}
+
+/* Caret: a 2x20 bar, optionally moved and hidden */
+static void put_caret(scenic_renderer_t* r, float dx, bool on) {
+    body_t caret = {0};
+    translate(&caret, dx, 0);
+    if (on) {
+        color(&caret, 255, 255, 255);
+        rect(&caret, 2, 20);
+    }
+    put_body(r, "caret", &caret);
+}
+
+static void put_box(scenic_renderer_t* r, uint8_t red) {
+    body_t box = {0};
+    color(&box, red, 200, 0);
+    rect(&box, 30, 20);
+    put_body(r, "box", &box);
+}
+
+/* Blue background, caret at (20, 10), box at (150, 60) */
+static scenic_renderer_t* make_scene(NVGcontext* p_ctx) {
+    scenic_renderer_config_t config = {
+        .width = W,
+        .height = H,
+        .pixel_ratio = 1.0f,
+        .platform = {
+            .begin_frame = test_begin_frame,
+            .begin_region = test_begin_region,
+            .buffer_age = test_buffer_age,
+        },
+    };
+    scenic_renderer_t* r = scenic_renderer_create(&config);
+    scenic_renderer_set_nvg_context(r, p_ctx);
+
+    body_t root = {0};
+    color(&root, 0, 0, 255);
+    rect(&root, W, H);
+    place(&root, "caret", 20, 10);
+    place(&root, "box", 150, 60);
+    put_body(r, "_root_", &root);
+    put_caret(r, 0, true);
+    put_box(r, 0);
+
+    p_target = canvas;
+    buffer_age = 1;
+    return r;
+}
+
+/* Render into the canvas; returns the renderer's redrawn pixel count */
+static uint32_t frame(scenic_renderer_t* r) {
+    pixels_cleared = 0;
+    pixels_filled = 0;
+    frames_begun = 0;
+    scenic_renderer_render(r);
+    scenic_renderer_stats_t stats;
+    scenic_renderer_get_stats(r, &stats);
+    ASSERT(stats.pixels_redrawn == pixels_cleared);
+    return stats.pixels_redrawn;
+}
+
+/* Whether the canvas matches a full redraw of the current scene */
+static bool matches_full_redraw(scenic_renderer_t* r) {
+    p_target = reference;
+    scenic_renderer_resize(r, W, H, 1.0f);
+    scenic_renderer_render(r);
+    p_target = canvas;
+    return memcmp(canvas, reference, sizeof(canvas)) == 0;
+}
+
+TEST(first_frame_is_full) {
+    NVGcontext* p_ctx = sw_nvg();
+    scenic_renderer_t* r = make_scene(p_ctx);
+
+    ASSERT(frame(r) == W * H);
+    ASSERT(canvas[0] == 0xffff0000);                /* background */
+    ASSERT(canvas[10 * W + 20] == 0xffffffff);      /* caret */
+    ASSERT(canvas[60 * W + 150] == 0xff00c800);     /* box */
+
+    scenic_renderer_destroy(r);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(unchanged_frame_skipped) {
+    NVGcontext* p_ctx = sw_nvg();
+    scenic_renderer_t* r = make_scene(p_ctx);
+    frame(r);
+
+    ASSERT(frame(r) == 0);
+    ASSERT(frames_begun == 0);
+
+    scenic_renderer_destroy(r);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(blinking_caret_redraws_caret_only) {
+    NVGcontext* p_ctx = sw_nvg();
+    scenic_renderer_t* r = make_scene(p_ctx);
+    frame(r);
+
+    /* 2x20 bar plus a pixel of fringe all round */
+    put_caret(r, 0, false);
+    ASSERT(frame(r) == 4 * 22);
+    ASSERT(pixels_filled == 4 * 22);                /* background only */
+    ASSERT(canvas[10 * W + 20] == 0xffff0000);
+    ASSERT(matches_full_redraw(r));
+
+    put_caret(r, 0, true);
+    ASSERT(frame(r) == 4 * 22);
+    ASSERT(pixels_filled == 4 * 22 + 2 * 20);
+    ASSERT(canvas[10 * W + 20] == 0xffffffff);
+    ASSERT(matches_full_redraw(r));
+
+    scenic_renderer_destroy(r);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(moved_caret_redraws_both_places) {
+    NVGcontext* p_ctx = sw_nvg();
+    scenic_renderer_t* r = make_scene(p_ctx);
+    frame(r);
+
+    /* Old bar at x 20-22 and new at 60-62: x 19-63, y 9-31 */
+    put_caret(r, 40, true);
+    ASSERT(frame(r) == 44 * 22);
+    ASSERT(canvas[10 * W + 20] == 0xffff0000);
+    ASSERT(canvas[10 * W + 60] == 0xffffffff);
+    ASSERT(matches_full_redraw(r));
+
+    scenic_renderer_destroy(r);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(older_buffer_gets_earlier_damage) {
+    NVGcontext* p_ctx = sw_nvg();
+    scenic_renderer_t* r = make_scene(p_ctx);
+    frame(r);
+
+    put_caret(r, 0, false);
+    ASSERT(frame(r) == 4 * 22);
+
+    /* Two frames old: also lacks the caret change. Box is x 149-181,
+     * y 59-81; with the caret's x 19-23, y 9-31 that is 162x72. */
+    buffer_age = 2;
+    put_box(r, 255);
+    ASSERT(frame(r) == 162 * 72);
+
+    /* Undefined contents mean a full redraw */
+    buffer_age = 0;
+    put_box(r, 0);
+    ASSERT(frame(r) == W * H);
+    ASSERT(matches_full_redraw(r));
+
+    scenic_renderer_destroy(r);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(outside_changes_redraw_everything) {
+    NVGcontext* p_ctx = sw_nvg();
+    scenic_renderer_t* r = make_scene(p_ctx);
+    frame(r);
+
+    scenic_renderer_cmd_clear_color(r, 0.5f, 0.5f, 0.5f, 1.0f);
+    ASSERT(frame(r) == W * H);
+
+    float shifted[6] = { 1, 0, 0, 1, 5, 0 };
+    scenic_renderer_cmd_global_tx(r, shifted);
+    ASSERT(frame(r) == W * H);
+
+    /* Placements from before the shift are not trusted */
+    put_caret(r, 0, false);
+    ASSERT(frame(r) == 4 * 22);
+    ASSERT(canvas[10 * W + 25] == 0xffff0000);
+    ASSERT(matches_full_redraw(r));
+
+    scenic_renderer_destroy(r);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(render_only_when_owed) {
+    NVGcontext* p_ctx = sw_nvg();
+    scenic_renderer_t* r = make_scene(p_ctx);
+    ASSERT(scenic_renderer_needs_render(r));
+    frame(r);
+    ASSERT(!scenic_renderer_needs_render(r));
+
+    /* An expose asks for a frame without the scene changing */
+    scenic_renderer_request_render(r);
+    ASSERT(scenic_renderer_needs_render(r));
+    ASSERT(frame(r) == 0);
+    ASSERT(!scenic_renderer_needs_render(r));
+
+    scenic_renderer_resize(r, W, H, 1.0f);
+    ASSERT(scenic_renderer_needs_render(r));
+    ASSERT(frame(r) == W * H);
+
+    scenic_renderer_destroy(r);
+    nvgDeleteInternal(p_ctx);
+}
+
+int main(void) {
+    printf("Running damage tracking tests...\n");
+
+    RUN_TEST(first_frame_is_full);
+    RUN_TEST(unchanged_frame_skipped);
+    RUN_TEST(blinking_caret_redraws_caret_only);
+    RUN_TEST(moved_caret_redraws_both_places);
+    RUN_TEST(older_buffer_gets_earlier_damage);
+    RUN_TEST(outside_changes_redraw_everything);
+    RUN_TEST(render_only_when_owed);
+
+    printf("\nAll tests passed! (%d/%d)\n", tests_passed, tests_run);
+    return 0;
+}
@@ -0,0 +1,618 @@
+/*
+ * Image decode pool and texture upload tests
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "asset_cache.h"
+#include "comms.h"
+#include "image.h"
+#include "decode_pool.h"
+#include "scenic_protocol.h"
+#include "nanovg/nanovg.h"
+#include "stub_nvg.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    static void test_##name(void)
+
+#define RUN_TEST(name) do { \
+    printf("  Running %s...", #name); \
+    tests_run++; \
+    test_##name(); \
+    tests_passed++; \
+    printf(" OK\n"); \
+} while(0)
+
+#define ASSERT(cond) do { \
+    if (!(cond)) { \
+        printf(" FAILED at line %d: %s\n", __LINE__, #cond); \
+        exit(1); \
+    } \
+} while(0)
+
+/* 2x2 RGBA PNGs, solid red and solid green */
+static const uint8_t red_png[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+    0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0x08, 0x06, 0x00, 0x00, 0x00, 0x72, 0xb6, 0x0d,
+    0x24, 0x00, 0x00, 0x00, 0x11, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x63, 0xf8, 0xcf, 0xc0, 0xf0,
+    0x1f, 0x84, 0x19, 0x60, 0x0c, 0x00, 0x47, 0xca, 0x07, 0xf9, 0x1a, 0xb6, 0xf1, 0xa9, 0x00, 0x00,
+    0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82
+};
+static const uint8_t green_png[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+    0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0x08, 0x06, 0x00, 0x00, 0x00, 0x72, 0xb6, 0x0d,
+    0x24, 0x00, 0x00, 0x00, 0x0e, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x63, 0x60, 0xf8, 0x0f, 0x85,
+    0x30, 0x06, 0x00, 0x43, 0xce, 0x07, 0xf9, 0xea, 0xca, 0xac, 0x99, 0x00, 0x00, 0x00, 0x00, 0x49,
+    0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82
+};
+
+static const uint8_t red[4] = { 0xff, 0x00, 0x00, 0xff };
+static const uint8_t green[4] = { 0x00, 0xff, 0x00, 0xff };
+
+/* Texture uploads the stub NanoVG backend has seen */
+static uint8_t uploaded[2 * 2 * 4];
+static atomic_int wakes;
+static int regions = 0;
+static int region_rows = 0;
+static int region_rect[4];
+static uint8_t region_data[2 * 2 * 4];
+
+static void record_upload(const unsigned char* data) {
+    memcpy(uploaded, data, sizeof(uploaded));
+}
+
+static void record_region(int image, int x, int y, int w, int h,
+                          const unsigned char* data) {
+    size_t size = (size_t)w * h * 4;
+    region_rect[0] = x; region_rect[1] = y; region_rect[2] = w; region_rect[3] = h;
+    memcpy(region_data, data, size < sizeof(region_data) ? size : sizeof(region_data));
+    region_rows += h;
+    regions++;
+}
+
+static NVGcontext* stub_nvg(void) {
+    stub_nvg_hooks_t hooks = {
+        .texture_size = 2,
+        .upload = record_upload,
+        .update_region = record_region,
+    };
+    return stub_nvg_create(&hooks);
+}
+
+static void count_wake(void* p_arg) {
+    (void)p_arg;
+    atomic_fetch_add(&wakes, 1);
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+/* PUT_IMAGE header and id for a 2x2 image, returning its length */
+static uint32_t image_header(uint8_t* buf, const char* id, uint32_t format, uint32_t size) {
+    uint32_t id_len = (uint32_t)strlen(id);
+    put_u32(buf, id_len);
+    put_u32(buf + 4, size);
+    put_u32(buf + 8, 2);
+    put_u32(buf + 12, 2);
+    put_u32(buf + 16, format);
+    memcpy(buf + 20, id, id_len);
+    return 20 + id_len;
+}
+
+/* PUT_IMAGE of a 2x2 raw image in one message */
+static void put_raw(const char* id, uint32_t format, const uint8_t color[4], NVGcontext* p_ctx) {
+    uint8_t buf[20 + 16 + 16];
+    uint32_t n = image_header(buf, id, format, 4 * format);
+    for (int i = 0; i < 4; i++) {
+        /* GRAY and GRAY_A take the first channel as gray */
+        memcpy(buf + n, color, format);
+        if (format == SCENIC_IMG_FMT_GRAY_A) buf[n + 1] = color[3];
+        n += format;
+    }
+
+    int remaining = (int)n;
+    comms_set_buffer(buf, remaining);
+    put_image(&remaining, p_ctx);
+}
+
+/* The same, streamed a byte at a time */
+static void stream_raw(const char* id, uint32_t format, const uint8_t color[4], NVGcontext* p_ctx) {
+    uint8_t buf[20 + 16];
+    uint32_t n = image_header(buf, id, format, 4 * format);
+    int remaining = (int)(n + 4 * format);
+    comms_set_buffer(buf, remaining);
+
+    stream_t stream = {0};
+    ASSERT(put_image_stream_begin(&remaining, &stream));
+    for (int i = 0; i < 4; i++) {
+        for (uint32_t c = 0; c < format; c++) {
+            if (stream.write) {
+                stream.write(&stream, &color[c], 1);
+            } else {
+                *stream.p_dest++ = color[c];
+                stream.dest_left--;
+            }
+        }
+    }
+    stream.finish(&stream, p_ctx);
+}
+
+/* PUT_IMAGE of a 2x2 encoded image */
+static void put_png(const char* id, const uint8_t* p_png, uint32_t size, NVGcontext* p_ctx) {
+    uint8_t buf[20 + 16 + 128];
+    uint32_t n = image_header(buf, id, SCENIC_IMG_FMT_ENCODED, size);
+    memcpy(buf + n, p_png, size);
+
+    int remaining = (int)(n + size);
+    comms_set_buffer(buf, remaining);
+    put_image(&remaining, p_ctx);
+}
+
+/* PUT_IMAGE_REGION of a w x h rectangle in one color, declaring data_len
+ * bytes of pixels */
+static void put_region_len(const char* id, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                           uint32_t format, const uint8_t color[4], uint32_t data_len,
+                           NVGcontext* p_ctx) {
+    uint8_t buf[28 + 16 + 16];
+    uint32_t id_len = (uint32_t)strlen(id);
+    put_u32(buf, id_len);
+    put_u32(buf + 4, data_len);
+    put_u32(buf + 8, x);
+    put_u32(buf + 12, y);
+    put_u32(buf + 16, w);
+    put_u32(buf + 20, h);
+    put_u32(buf + 24, format);
+    memcpy(buf + 28, id, id_len);
+    uint32_t n = 28 + id_len;
+    for (uint32_t i = 0; i < w * h && i < 4; i++) {
+        memcpy(buf + n, color, format);
+        n += format;
+    }
+
+    int remaining = (int)n;
+    comms_set_buffer(buf, remaining);
+    put_image_region(&remaining, p_ctx);
+}
+
+static void put_region(const char* id, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                       uint32_t format, const uint8_t color[4], NVGcontext* p_ctx) {
+    put_region_len(id, x, y, w, h, format, color, w * h * format, p_ctx);
+}
+
+/* PUT_IMAGE_HASH of a 2x2 image; returns the asset status */
+static int put_hash(const char* id, uint32_t format, const uint8_t hash[SHA256_SIZE],
+                    NVGcontext* p_ctx) {
+    uint8_t buf[20 + SHA256_SIZE + 16];
+    uint32_t id_len = (uint32_t)strlen(id);
+    put_u32(buf, id_len);
+    put_u32(buf + 4, 4 * format);
+    put_u32(buf + 8, 2);
+    put_u32(buf + 12, 2);
+    put_u32(buf + 16, format);
+    memcpy(buf + 20, hash, SHA256_SIZE);
+    memcpy(buf + 20 + SHA256_SIZE, id, id_len);
+
+    int remaining = (int)(20 + SHA256_SIZE + id_len);
+    comms_set_buffer(buf, remaining);
+    uint8_t reported[SHA256_SIZE];
+    return put_image_hash(&remaining, p_ctx, reported);
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { 0, ms * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* Waits for the pool to have finished n jobs in all */
+static void wait_wakes(int n) {
+    for (int i = 0; i < 5000 && atomic_load(&wakes) < n; i++) {
+        sleep_ms(1);
+    }
+    ASSERT(atomic_load(&wakes) >= n);
+}
+
+static bool solid(const uint8_t color[4]) {
+    for (int i = 0; i < 4; i++) {
+        if (memcmp(uploaded + i * 4, color, 4) != 0) return false;
+    }
+    return true;
+}
+
+static void reset(NVGcontext* p_ctx) {
+    decode_pool_stop();
+    reset_images(p_ctx);
+    stub_creates = stub_updates = regions = region_rows = 0;
+    atomic_store(&wakes, 0);
+    memset(uploaded, 0, sizeof(uploaded));
+    set_image_retain(false);
+}
+
+TEST(decoded_off_thread) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    ASSERT(decode_pool_start(2, count_wake, NULL));
+
+    /* Nothing is uploaded until the GL thread collects the pixels */
+    put_png("pic", red_png, sizeof(red_png), p_ctx);
+    ASSERT(stub_creates == 0);
+    wait_wakes(1);
+    ASSERT(stub_creates == 0);
+
+    ASSERT(finish_image_decodes(p_ctx) == 1);
+    ASSERT(stub_creates == 1 && stub_updates == 0);
+    ASSERT(solid(red));
+    ASSERT(finish_image_decodes(p_ctx) == 0);
+
+    /* A new put updates the texture already there */
+    put_png("pic", green_png, sizeof(green_png), p_ctx);
+    wait_wakes(2);
+    ASSERT(finish_image_decodes(p_ctx) == 1);
+    ASSERT(stub_creates == 1 && stub_updates == 1);
+    ASSERT(solid(green));
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(latest_put_wins) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    ASSERT(decode_pool_start(2, count_wake, NULL));
+
+    /* Two puts in flight at once: only the second reaches the texture,
+     * whichever worker finishes first */
+    put_png("pic", red_png, sizeof(red_png), p_ctx);
+    put_png("pic", green_png, sizeof(green_png), p_ctx);
+    wait_wakes(2);
+    ASSERT(finish_image_decodes(p_ctx) == 1);
+    ASSERT(stub_creates == 1 && stub_updates == 0);
+    ASSERT(solid(green));
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(reset_drops_pending) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    ASSERT(decode_pool_start(1, count_wake, NULL));
+
+    put_png("pic", red_png, sizeof(red_png), p_ctx);
+    wait_wakes(1);
+    reset_images(p_ctx);
+    ASSERT(finish_image_decodes(p_ctx) == 0);
+    ASSERT(stub_creates == 0);
+
+    /* Jobs still queued when the pool stops are freed with it */
+    put_png("pic", red_png, sizeof(red_png), p_ctx);
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(inline_without_pool) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    ASSERT(!decode_pool_running());
+
+    put_png("pic", red_png, sizeof(red_png), p_ctx);
+    ASSERT(stub_creates == 1);
+    ASSERT(solid(red));
+    ASSERT(finish_image_decodes(p_ctx) == 0);
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(pixels_dropped_after_upload) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+
+    put_raw("pic", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+    ASSERT(stub_creates == 1 && solid(red));
+    put_raw("pic", SCENIC_IMG_FMT_RGB, green, p_ctx);
+    ASSERT(stub_updates == 1 && solid(green));
+    stream_raw("pic", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+    ASSERT(stub_updates == 2 && solid(red));
+    stream_raw("pic", SCENIC_IMG_FMT_RGB, green, p_ctx);
+    ASSERT(stub_updates == 3 && solid(green));
+    ASSERT(retained_image_bytes() == 0);
+
+    /* Nothing to bring back into a new context */
+    restore_images(p_ctx);
+    ASSERT(stub_creates == 1);
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(short_stream_rejected) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    put_raw("pic", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+
+    /* Three of the four RGB pixels: refused before anything is staged */
+    uint8_t buf[20 + 16];
+    uint32_t n = image_header(buf, "pic", SCENIC_IMG_FMT_RGB, 3 * 3);
+    int remaining = (int)(n + 3 * 3);
+    comms_set_buffer(buf, remaining);
+    stream_t stream = {0};
+    ASSERT(!put_image_stream_begin(&remaining, &stream));
+    ASSERT(stub_creates == 1 && stub_updates == 0 && solid(red));
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(oversized_image_rejected) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+
+    /* 65536 x 65536 RGBA is 16 GiB, 0 in 32 bits: refused from the header
+     * alone, even when the payload is encoded and small */
+    static const uint32_t formats[] = { SCENIC_IMG_FMT_ENCODED, SCENIC_IMG_FMT_RGBA };
+    for (int i = 0; i < 2; i++) {
+        uint8_t buf[20 + 4 + 16];
+        uint32_t n = image_header(buf, "big", formats[i], 16);
+        put_u32(buf + 8, 65536);
+        put_u32(buf + 12, 65536);
+        memset(buf + n, 0, 16);
+        int remaining = (int)(n + 16);
+        comms_set_buffer(buf, remaining);
+        stream_t stream = {0};
+        ASSERT(!put_image_stream_begin(&remaining, &stream));
+        ASSERT(stub_creates == 0);
+    }
+
+    /* The id is still free for an image of sane size */
+    put_raw("big", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+    ASSERT(stub_creates == 1 && solid(red));
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(retained_for_restore) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    set_image_retain(true);
+
+    put_raw("pic", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+    stream_raw("tile", SCENIC_IMG_FMT_RGB, green, p_ctx);
+    ASSERT(stub_creates == 2);
+    ASSERT(retained_image_bytes() == 2 * 2 * 2 * 4);
+
+    /* Each image is uploaded again from its copy */
+    memset(uploaded, 0, sizeof(uploaded));
+    restore_images(p_ctx);
+    ASSERT(stub_creates == 4);
+    ASSERT(solid(red) || solid(green));
+
+    put_raw("pic", SCENIC_IMG_FMT_RGB, green, p_ctx);
+    put_raw("tile", SCENIC_IMG_FMT_RGBA, green, p_ctx);
+    memset(uploaded, 0, sizeof(uploaded));
+    restore_images(p_ctx);
+    ASSERT(stub_creates == 6 && solid(green));
+    ASSERT(retained_image_bytes() == 2 * 2 * 2 * 4);
+
+    reset(p_ctx);
+    ASSERT(retained_image_bytes() == 0);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(mismatched_hash_not_kept) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    char dir[] = "/tmp/scenic_decode_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    ASSERT(asset_cache_init(dir));
+
+    /* Announced as one hash, sent as other bytes */
+    uint8_t hash[SHA256_SIZE];
+    memset(hash, 0x5a, sizeof(hash));
+    ASSERT(put_hash("pic", SCENIC_IMG_FMT_RGBA, hash, p_ctx) == ASSET_MISSING);
+    put_raw("pic", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+    ASSERT(stub_creates == 1);
+    ASSERT(put_hash("pic", SCENIC_IMG_FMT_RGBA, hash, p_ctx) == ASSET_MISSING);
+
+    /* The real bytes are kept and answer for their hash */
+    uint8_t pixels[16];
+    for (int i = 0; i < 4; i++) memcpy(pixels + i * 4, green, 4);
+    sha256(pixels, sizeof(pixels), hash);
+    ASSERT(put_hash("pic", SCENIC_IMG_FMT_RGBA, hash, p_ctx) == ASSET_MISSING);
+    put_raw("pic", SCENIC_IMG_FMT_RGBA, green, p_ctx);
+    stub_updates = 0;
+    ASSERT(put_hash("pic", SCENIC_IMG_FMT_RGBA, hash, p_ctx) == ASSET_HAVE);
+    ASSERT(stub_updates == 0);
+
+    asset_cache_done();
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    ASSERT(system(cmd) == 0);
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(region_upload) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    put_raw("pic", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+
+    /* The right-hand column only, expanded from RGB */
+    put_region("pic", 1, 0, 1, 2, SCENIC_IMG_FMT_RGB, green, p_ctx);
+    ASSERT(regions == 1 && stub_updates == 0);
+    ASSERT(region_rect[0] == 1 && region_rect[1] == 0);
+    ASSERT(region_rect[2] == 1 && region_rect[3] == 2);
+    ASSERT(memcmp(region_data, green, 4) == 0 && memcmp(region_data + 4, green, 4) == 0);
+
+    put_region("pic", 0, 1, 2, 1, SCENIC_IMG_FMT_RGBA, red, p_ctx);
+    ASSERT(regions == 2);
+    ASSERT(region_rect[2] == 2 && region_rect[3] == 1);
+    ASSERT(memcmp(region_data, red, 4) == 0 && memcmp(region_data + 4, red, 4) == 0);
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(region_rejected) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    put_raw("pic", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+
+    put_region("nope", 0, 0, 1, 1, SCENIC_IMG_FMT_RGBA, green, p_ctx);
+    put_region("pic", 2, 0, 1, 1, SCENIC_IMG_FMT_RGBA, green, p_ctx);
+    put_region("pic", 0, 1, 1, 2, SCENIC_IMG_FMT_RGBA, green, p_ctx);
+    put_region("pic", 0xffffffff, 0, 2, 1, SCENIC_IMG_FMT_RGBA, green, p_ctx);
+    put_region("pic", 0, 0, 1, 1, SCENIC_IMG_FMT_ENCODED, green, p_ctx);
+    ASSERT(regions == 0 && stub_updates == 0);
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(region_length_checked) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    put_raw("pic", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+
+    /* The declared length must be the region's exactly */
+    put_region_len("pic", 0, 0, 1, 1, SCENIC_IMG_FMT_RGBA, green, 8, p_ctx);
+    put_region_len("pic", 0, 0, 1, 1, SCENIC_IMG_FMT_RGBA, green, 0, p_ctx);
+    put_region_len("pic", 0, 0, 1, 1, SCENIC_IMG_FMT_RGB, green, 4, p_ctx);
+    ASSERT(regions == 0 && stub_updates == 0);
+    put_region_len("pic", 0, 0, 1, 1, SCENIC_IMG_FMT_RGB, green, 3, p_ctx);
+    ASSERT(regions == 1);
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(region_waits_for_decode) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    ASSERT(decode_pool_start(2, count_wake, NULL));
+
+    /* The region patches the image still decoding, not what it replaces */
+    put_png("pic", red_png, sizeof(red_png), p_ctx);
+    put_region("pic", 0, 0, 1, 1, SCENIC_IMG_FMT_RGBA, green, p_ctx);
+    ASSERT(stub_creates == 1 && solid(red));
+    ASSERT(regions == 1 && memcmp(region_data, green, 4) == 0);
+
+    /* And that decode does not land again on top of the region */
+    ASSERT(finish_image_decodes(p_ctx) == 1);
+    ASSERT(stub_creates == 1 && stub_updates == 0);
+
+    put_png("pic", green_png, sizeof(green_png), p_ctx);
+    put_region("pic", 1, 1, 1, 1, SCENIC_IMG_FMT_RGBA, red, p_ctx);
+    ASSERT(stub_updates == 1 && solid(green) && regions == 2);
+    ASSERT(finish_image_decodes(p_ctx) == 1);
+    ASSERT(stub_updates == 1);
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(region_streamed_in_bands) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    set_image_retain(true);
+
+    /* A 128x600 red image, then all of it replaced by a streamed region */
+    enum { W = 128, H = 600 };
+    uint8_t* buf = malloc(24 + (size_t)W * H * 4);
+    ASSERT(buf);
+    put_u32(buf, 3);
+    put_u32(buf + 4, W * H * 4);
+    put_u32(buf + 8, W);
+    put_u32(buf + 12, H);
+    put_u32(buf + 16, SCENIC_IMG_FMT_RGBA);
+    memcpy(buf + 20, "big", 3);
+    for (int i = 0; i < W * H; i++) memcpy(buf + 23 + i * 4, red, 4);
+    int remaining = 23 + W * H * 4;
+    comms_set_buffer(buf, remaining);
+    put_image(&remaining, p_ctx);
+    ASSERT(stub_creates == 1);
+
+    uint32_t data_len = W * H * SCENIC_IMG_FMT_RGB;
+    put_u32(buf, 3);
+    put_u32(buf + 4, data_len);
+    put_u32(buf + 8, 0);
+    put_u32(buf + 12, 0);
+    put_u32(buf + 16, W);
+    put_u32(buf + 20, H);
+    put_u32(buf + 24, SCENIC_IMG_FMT_RGB);
+    memcpy(buf + 28, "big", 3);
+    remaining = (int)(31 + data_len);
+    comms_set_buffer(buf, 31);
+    stream_t stream = {0};
+    ASSERT(put_image_region_stream_begin(&remaining, &stream, p_ctx));
+
+    /* Chunks that split pixels */
+    for (uint32_t i = 0; i < W * H; i++) memcpy(buf + i * 3, green, 3);
+    for (uint32_t sent = 0; sent < data_len; sent += 1000) {
+        uint32_t n = data_len - sent < 1000 ? data_len - sent : 1000;
+        stream.write(&stream, buf + sent, n);
+    }
+    stream.finish(&stream, p_ctx);
+    free(buf);
+
+    /* 128 rows to a band */
+    ASSERT(regions == 5 && region_rows == H && stub_updates == 0);
+    ASSERT(region_rect[1] == 512 && region_rect[2] == W && region_rect[3] == H - 512);
+    ASSERT(memcmp(region_data, green, 3) == 0);
+
+    memset(uploaded, 0, sizeof(uploaded));
+    restore_images(p_ctx);
+    ASSERT(solid(green));
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(region_patches_retained) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    set_image_retain(true);
+    put_raw("pic", SCENIC_IMG_FMT_RGBA, red, p_ctx);
+    put_region("pic", 0, 1, 2, 1, SCENIC_IMG_FMT_GRAY_A, green, p_ctx);
+    ASSERT(regions == 1);
+
+    /* Top row red, bottom row from the region (green's first channel as gray) */
+    restore_images(p_ctx);
+    static const uint8_t gray[4] = { 0x00, 0x00, 0x00, 0xff };
+    ASSERT(memcmp(uploaded, red, 4) == 0 && memcmp(uploaded + 4, red, 4) == 0);
+    ASSERT(memcmp(uploaded + 8, gray, 4) == 0 && memcmp(uploaded + 12, gray, 4) == 0);
+
+    reset(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+int main(void) {
+    printf("Running image decode tests...\n");
+    RUN_TEST(decoded_off_thread);
+    RUN_TEST(latest_put_wins);
+    RUN_TEST(reset_drops_pending);
+    RUN_TEST(inline_without_pool);
+    RUN_TEST(pixels_dropped_after_upload);
+    RUN_TEST(short_stream_rejected);
+    RUN_TEST(oversized_image_rejected);
+    RUN_TEST(retained_for_restore);
+    RUN_TEST(mismatched_hash_not_kept);
+    RUN_TEST(region_upload);
+    RUN_TEST(region_rejected);
+    RUN_TEST(region_length_checked);
+    RUN_TEST(region_waits_for_decode);
+    RUN_TEST(region_streamed_in_bands);
+    RUN_TEST(region_patches_retained);
+
+    printf("\nAll tests passed! (%d/%d)\n", tests_passed, tests_run);
+    return 0;
+}
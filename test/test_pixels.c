@@ -0,0 +1,128 @@
+/*
+ * Pixel format conversion tests
+ *
+ * Run with --bench to time converting 4K frames of each format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pixels.h"
+#include "scenic_protocol.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    static void test_##name(void)
+
+#define RUN_TEST(name) do { \
+    printf("  Running %s...", #name); \
+    tests_run++; \
+    test_##name(); \
+    tests_passed++; \
+    printf(" OK\n"); \
+} while(0)
+
+#define ASSERT(cond) do { \
+    if (!(cond)) { \
+        printf(" FAILED at line %d: %s\n", __LINE__, #cond); \
+        exit(1); \
+    } \
+} while(0)
+
+#define MAX_PIXELS 300
+
+static void reference(uint8_t* d, const uint8_t* s, size_t count, uint32_t format) {
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* p = s + i * format;
+        switch (format) {
+            case 1: d[0] = d[1] = d[2] = p[0]; d[3] = 0xff; break;
+            case 2: d[0] = d[1] = d[2] = p[0]; d[3] = p[1]; break;
+            case 3: d[0] = p[0]; d[1] = p[1]; d[2] = p[2]; d[3] = 0xff; break;
+            case 4: memcpy(d, p, 4); break;
+        }
+        d += 4;
+    }
+}
+
+/* Every length up to MAX_PIXELS, at every source alignment, with the
+ * source ending exactly at the end of its allocation */
+static void check_format(uint32_t format) {
+    uint8_t expect[MAX_PIXELS * 4];
+    uint8_t got[MAX_PIXELS * 4 + 4];
+    for (size_t count = 0; count <= MAX_PIXELS; count++) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            size_t size = count * format;
+            uint8_t* p_block = malloc(offset + size ? offset + size : 1);
+            ASSERT(p_block);
+            uint8_t* s = p_block + offset;
+            for (size_t i = 0; i < size; i++) s[i] = (uint8_t)(i * 7 + count + 1);
+
+            memset(got, 0xAA, sizeof(got));
+            reference(expect, s, count, format);
+            pixels_to_rgba(got, s, count, format);
+            ASSERT(memcmp(got, expect, count * 4) == 0);
+            ASSERT(got[count * 4] == 0xAA);
+            free(p_block);
+        }
+    }
+}
+
+TEST(gray) { check_format(SCENIC_IMG_FMT_GRAY); }
+TEST(gray_alpha) { check_format(SCENIC_IMG_FMT_GRAY_A); }
+TEST(rgb) { check_format(SCENIC_IMG_FMT_RGB); }
+TEST(rgba) { check_format(SCENIC_IMG_FMT_RGBA); }
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Best of several runs converting a 3840x2160 frame */
+static void bench(void) {
+    const size_t count = 3840 * 2160;
+    const int runs = 20;
+    static const char* const names[] = { NULL, "gray", "gray_a", "rgb", "rgba" };
+    uint8_t* p_src = malloc(count * 4);
+    uint8_t* p_dst = malloc(count * 4);
+    if (!p_src || !p_dst) {
+        printf("Unable to allocate frames\n");
+        exit(1);
+    }
+    memset(p_src, 0x5A, count * 4);
+
+    printf("4K frame conversion, %s kernels\n", pixels_kernel_name());
+    for (uint32_t format = 1; format <= 4; format++) {
+        double best = 1e9;
+        for (int r = 0; r < runs; r++) {
+            double start = now_s();
+            pixels_to_rgba(p_dst, p_src, count, format);
+            double elapsed = now_s() - start;
+            if (elapsed < best) best = elapsed;
+        }
+        printf("  %-7s %7.2f ms  %7.1f frames/s  %6.2f GB/s out\n", names[format],
+               best * 1e3, 1.0 / best, count * 4 / best / 1e9);
+    }
+    free(p_src);
+    free(p_dst);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        bench();
+        return 0;
+    }
+
+    printf("Running pixel conversion tests (%s)...\n", pixels_kernel_name());
+    RUN_TEST(gray);
+    RUN_TEST(gray_alpha);
+    RUN_TEST(rgb);
+    RUN_TEST(rgba);
+
+    printf("\nAll tests passed! (%d/%d)\n", tests_passed, tests_run);
+    return 0;
+}
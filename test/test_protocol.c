@@ -9,6 +9,7 @@
 
 #include "protocol.h"
 #include "comms.h"
+#include "ringbuf.h"
 
 static int tests_run = 0;
 static int tests_passed = 0;
@@ -108,6 +109,21 @@ TEST(byte_order_macros) {
 #endif
 }
 
+TEST(bulk_byte_swap) {
+    /* Odd count and unaligned source exercise both the vector and tail paths */
+    uint8_t src[1 + 4 * 11];
+    for (size_t i = 0; i < sizeof(src); i++) src[i] = (uint8_t)i;
+
+    uint32_t out[11];
+    ntoh_ui32_array(out, src + 1, 11);
+    for (int i = 0; i < 11; i++) {
+        const uint8_t* p = src + 1 + i * 4;
+        uint32_t expect = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                          ((uint32_t)p[2] << 8) | p[3];
+        ASSERT(out[i] == expect);
+    }
+}
+
 TEST(comms_buffer) {
     uint8_t data[] = {0x01, 0x02, 0x03, 0x04, 0x05};
     uint8_t buf[3];
@@ -132,6 +148,56 @@ TEST(comms_buffer) {
     ASSERT(read_bytes_down(buf, 1, &remaining) == false);
 }
 
+TEST(comms_read_ptr) {
+    uint8_t data[] = {0x01, 0x02, 0x03, 0x04, 0x05};
+    int remaining = sizeof(data);
+
+    comms_set_buffer(data, sizeof(data));
+
+    const uint8_t* p = read_bytes_ptr(2, &remaining);
+    ASSERT(p == data);
+    ASSERT(remaining == 3);
+
+    p = read_bytes_ptr(3, &remaining);
+    ASSERT(p == data + 2);
+    ASSERT(remaining == 0);
+
+    ASSERT(read_bytes_ptr(1, &remaining) == NULL);
+}
+
+TEST(ringbuf_wraps_contiguously) {
+    ringbuf_t ring;
+    ASSERT(ringbuf_init(&ring, 4096) == true);
+    ASSERT(ring.size >= 4096);
+
+    uint32_t chunk = ring.size * 3 / 4;
+    uint8_t* src = malloc(chunk);
+    ASSERT(src);
+
+    for (int pass = 0; pass < 3; pass++) {
+        for (uint32_t i = 0; i < chunk; i++) {
+            src[i] = (uint8_t)(i * 7 + pass);
+        }
+
+        uint32_t space;
+        uint8_t* p_write = ringbuf_write_ptr(&ring, &space);
+        ASSERT(space >= chunk);
+        memcpy(p_write, src, chunk);
+        ringbuf_commit(&ring, chunk);
+
+        /* Each pass after the first straddles the end of the ring */
+        uint32_t len;
+        const uint8_t* p_read = ringbuf_read_ptr(&ring, &len);
+        ASSERT(len == chunk);
+        ASSERT(memcmp(p_read, src, chunk) == 0);
+        ringbuf_consume(&ring, chunk);
+        ASSERT(ringbuf_used(&ring) == 0);
+    }
+
+    free(src);
+    ringbuf_free(&ring);
+}
+
 int main(void) {
     printf("Running protocol tests...\n");
 
@@ -142,7 +208,10 @@ int main(void) {
     RUN_TEST(encode_event_reshape);
     RUN_TEST(encode_event_buffer_too_small);
     RUN_TEST(byte_order_macros);
+    RUN_TEST(bulk_byte_swap);
     RUN_TEST(comms_buffer);
+    RUN_TEST(comms_read_ptr);
+    RUN_TEST(ringbuf_wraps_contiguously);
 
     printf("\nAll tests passed! (%d/%d)\n", tests_passed, tests_run);
     return 0;
@@ -0,0 +1,569 @@
+/*
+ * Renderer command ingest tests
+ *
+ * Drives scenic_renderer_process_commands through an in-memory transport.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "scenic_renderer.h"
+#include "scenic_transport.h"
+#include "scenic_protocol.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    static void test_##name(void)
+
+#define RUN_TEST(name) do { \
+    printf("  Running %s...", #name); \
+    tests_run++; \
+    test_##name(); \
+    tests_passed++; \
+    printf(" OK\n"); \
+} while(0)
+
+#define ASSERT(cond) do { \
+    if (!(cond)) { \
+        printf(" FAILED at line %d: %s\n", __LINE__, #cond); \
+        exit(1); \
+    } \
+} while(0)
+
+/* In-memory transport: recv hands out at most chunk bytes per call,
+ * send accepts at most send_limit bytes per call (0 = unlimited).
+ * Setting hangup makes the next recv fail like a server losing its driver. */
+typedef struct {
+    uint8_t* p_data;
+    size_t len;
+    size_t pos;
+    size_t chunk;
+    uint8_t sent[4096];
+    size_t sent_len;
+    size_t send_limit;
+    int send_calls;
+    bool hangup;
+} mem_transport_t;
+
+static int mem_connect(scenic_transport_t* t, const char* address) {
+    (void)address;
+    t->connected = true;
+    return 0;
+}
+
+static void mem_disconnect(scenic_transport_t* t) {
+    t->connected = false;
+}
+
+static int mem_send(scenic_transport_t* t, const void* data, size_t len) {
+    mem_transport_t* m = t->impl_data;
+    m->send_calls++;
+    if (m->send_limit && len > m->send_limit) len = m->send_limit;
+    if (len > sizeof(m->sent) - m->sent_len) len = sizeof(m->sent) - m->sent_len;
+    memcpy(m->sent + m->sent_len, data, len);
+    m->sent_len += len;
+    return (int)len;
+}
+
+static int mem_recv(scenic_transport_t* t, void* buf, size_t max_len, int timeout_ms) {
+    (void)timeout_ms;
+    mem_transport_t* m = t->impl_data;
+    if (m->hangup) {
+        m->hangup = false;
+        t->connected = false;
+        return -1;
+    }
+    size_t n = m->len - m->pos;
+    if (n > max_len) n = max_len;
+    if (n > m->chunk) n = m->chunk;
+    memcpy(buf, m->p_data + m->pos, n);
+    m->pos += n;
+    return (int)n;
+}
+
+static bool mem_data_available(scenic_transport_t* t, int timeout_ms) {
+    (void)timeout_ms;
+    mem_transport_t* m = t->impl_data;
+    return m->hangup || m->pos < m->len;
+}
+
+static int mem_get_fd(scenic_transport_t* t) {
+    (void)t;
+    return -1;
+}
+
+static void mem_destroy(scenic_transport_t* t) {
+    (void)t;
+}
+
+static const scenic_transport_ops_t mem_ops = {
+    .connect = mem_connect,
+    .disconnect = mem_disconnect,
+    .send = mem_send,
+    .recv = mem_recv,
+    .data_available = mem_data_available,
+    .get_fd = mem_get_fd,
+    .destroy = mem_destroy
+};
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+/* Append a [type][len][payload] frame; payload may be NULL for zero fill */
+static size_t append_frame(uint8_t* p, uint8_t type, const void* payload, uint32_t len) {
+    p[0] = type;
+    put_u32(p + 1, len);
+    if (payload) {
+        memcpy(p + SCENIC_MSG_HEADER_SIZE, payload, len);
+    } else {
+        memset(p + SCENIC_MSG_HEADER_SIZE, 0, len);
+    }
+    return SCENIC_MSG_HEADER_SIZE + len;
+}
+
+/* Build a PUT_SCRIPT frame whose script body is `body_len` bytes of
+ * 0x20 begin_path ops (4 bytes each) */
+static size_t append_put_script(uint8_t* p, const char* id, uint32_t body_len) {
+    uint32_t id_len = (uint32_t)strlen(id);
+    uint32_t payload_len = 4 + id_len + body_len;
+    p[0] = SCENIC_CMD_PUT_SCRIPT;
+    put_u32(p + 1, payload_len);
+    put_u32(p + 5, id_len);
+    memcpy(p + 9, id, id_len);
+    uint8_t* body = p + 9 + id_len;
+    for (uint32_t i = 0; i + 4 <= body_len; i += 4) {
+        body[i] = 0x00;
+        body[i + 1] = 0x20;
+        body[i + 2] = 0x00;
+        body[i + 3] = 0x00;
+    }
+    return SCENIC_MSG_HEADER_SIZE + payload_len;
+}
+
+static int drain(scenic_renderer_t* r, mem_transport_t* m) {
+    int total = 0;
+    int guard = 0;
+    while (m->pos < m->len && guard++ < 100000) {
+        int n = scenic_renderer_process_commands(r, 0);
+        ASSERT(n >= 0);
+        total += n;
+    }
+    /* Flush anything still buffered */
+    total += scenic_renderer_process_commands(r, 0);
+    return total;
+}
+
+static scenic_renderer_t* make_renderer_cfg(scenic_transport_t* t, uint32_t event_flush_us) {
+    scenic_renderer_config_t config = {
+        .width = 800,
+        .height = 600,
+        .pixel_ratio = 1.0f,
+        .transport = t,
+        .event_flush_us = event_flush_us,
+    };
+    return scenic_renderer_create(&config);
+}
+
+static scenic_renderer_t* make_renderer(scenic_transport_t* t) {
+    return make_renderer_cfg(t, 0);
+}
+
+TEST(small_commands) {
+    uint8_t buf[256];
+    size_t len = 0;
+    float color[4] = {0};
+    len += append_put_script(buf + len, "_root_", 16);
+    len += append_frame(buf + len, SCENIC_CMD_CLEAR_COLOR, color, sizeof(color));
+    len += append_frame(buf + len, SCENIC_CMD_RENDER, NULL, 0);
+
+    mem_transport_t m = { .p_data = buf, .len = len, .chunk = 7 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer(&t);
+    ASSERT(r);
+
+    ASSERT(drain(r, &m) == 3);
+    scenic_renderer_destroy(r);
+}
+
+TEST(oversized_script_streams) {
+    /* 1MB script body, four times the receive buffer */
+    uint32_t body_len = 1024 * 1024;
+    uint8_t* buf = malloc(body_len + 1024);
+    ASSERT(buf);
+
+    size_t len = 0;
+    len += append_put_script(buf + len, "big", body_len);
+    len += append_frame(buf + len, SCENIC_CMD_RENDER, NULL, 0);
+    len += append_put_script(buf + len, "_root_", 8);
+
+    mem_transport_t m = { .p_data = buf, .len = len, .chunk = 64 * 1024 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer(&t);
+    ASSERT(r);
+
+    ASSERT(drain(r, &m) == 3);
+
+    scenic_renderer_destroy(r);
+    free(buf);
+}
+
+/* Append a PUT_SCRIPT frame with an explicit wire body */
+static size_t append_raw_script(uint8_t* p, const char* id, const uint8_t* body,
+                                uint32_t body_len) {
+    uint32_t id_len = (uint32_t)strlen(id);
+    p[0] = SCENIC_CMD_PUT_SCRIPT;
+    put_u32(p + 1, 4 + id_len + body_len);
+    put_u32(p + 5, id_len);
+    memcpy(p + 9, id, id_len);
+    memcpy(p + 9 + id_len, body, body_len);
+    return SCENIC_MSG_HEADER_SIZE + 4 + id_len + body_len;
+}
+
+TEST(malformed_scripts_rejected) {
+    uint8_t buf[256];
+    size_t len = 0;
+
+    /* 0x3F is not an op */
+    static const uint8_t unknown[] = {
+        0x00, 0x20, 0x00, 0x00,
+        0x00, 0x3F, 0x00, 0x00,
+    };
+    /* draw_rect needs 8 bytes of operands but only 4 follow */
+    static const uint8_t truncated[] = {
+        0x00, 0x04, 0x00, 0x01,
+        0x42, 0xC8, 0x00, 0x00,
+    };
+    len += append_put_script(buf + len, "_root_", 8);
+    len += append_raw_script(buf + len, "_root_", unknown, sizeof(unknown));
+    len += append_raw_script(buf + len, "_root_", truncated, sizeof(truncated));
+    len += append_frame(buf + len, SCENIC_CMD_RENDER, NULL, 0);
+
+    mem_transport_t m = { .p_data = buf, .len = len, .chunk = 5 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer(&t);
+    ASSERT(r);
+
+    ASSERT(drain(r, &m) == 4);
+
+    scenic_renderer_stats_t stats;
+    scenic_renderer_get_stats(r, &stats);
+    ASSERT(stats.scripts_rejected == 2);
+
+    /* Both rejections reach the driver as LOG_ERROR */
+    size_t off = 0;
+    int errors = 0;
+    while (off + SCENIC_MSG_HEADER_SIZE <= m.sent_len) {
+        uint32_t n = ((uint32_t)m.sent[off + 1] << 24) | ((uint32_t)m.sent[off + 2] << 16) |
+                     ((uint32_t)m.sent[off + 3] << 8) | m.sent[off + 4];
+        if (m.sent[off] == SCENIC_EVT_LOG_ERROR) errors++;
+        off += SCENIC_MSG_HEADER_SIZE + n;
+    }
+    ASSERT(errors == 2);
+
+    scenic_renderer_destroy(r);
+}
+
+TEST(oversized_unknown_command_dropped) {
+    uint32_t junk_len = 600 * 1024;
+    uint8_t* buf = malloc(junk_len + 256);
+    ASSERT(buf);
+
+    size_t len = 0;
+    len += append_frame(buf + len, 0x7E, NULL, junk_len);
+    len += append_frame(buf + len, SCENIC_CMD_RENDER, NULL, 0);
+
+    mem_transport_t m = { .p_data = buf, .len = len, .chunk = 100 * 1024 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer(&t);
+    ASSERT(r);
+
+    /* The dropped payload still counts as one command; framing resumes after it */
+    ASSERT(drain(r, &m) == 2);
+
+    scenic_renderer_destroy(r);
+    free(buf);
+}
+
+TEST(drain_with_budget) {
+    uint8_t buf[256];
+    size_t len = 0;
+    len += append_put_script(buf + len, "_root_", 16);
+    len += append_frame(buf + len, SCENIC_CMD_RENDER, NULL, 0);
+    len += append_frame(buf + len, SCENIC_CMD_RENDER, NULL, 0);
+
+    mem_transport_t m = { .p_data = buf, .len = len, .chunk = 7 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer(&t);
+    ASSERT(r);
+
+    /* Without a budget each call performs a single 7-byte read */
+    ASSERT(scenic_renderer_process_commands(r, 0) == 0);
+    scenic_renderer_stats_t stats;
+    scenic_renderer_get_stats(r, &stats);
+    ASSERT(stats.reads == 1);
+    ASSERT(stats.bytes_received == 7);
+
+    /* With a generous budget one call drains everything */
+    scenic_renderer_set_recv_budget(r, 10 * 1000 * 1000);
+    ASSERT(scenic_renderer_process_commands(r, 0) == 3);
+    scenic_renderer_get_stats(r, &stats);
+    ASSERT(stats.commands_processed == 3);
+    ASSERT(stats.bytes_received == len - 7);
+    ASSERT(stats.budget_exhausted == false);
+    ASSERT(m.pos == m.len);
+
+    scenic_renderer_destroy(r);
+}
+
+TEST(events_batched_per_flush) {
+    mem_transport_t m = { 0 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer_cfg(&t, 60 * 1000 * 1000);
+    ASSERT(r);
+
+    scenic_renderer_send_key(r, 65, 30, 1, 0);
+    scenic_renderer_send_codepoint(r, 'a', 0);
+    scenic_renderer_send_key(r, 65, 30, 0, 0);
+    ASSERT(m.send_calls == 0);
+
+    scenic_renderer_flush_events(r);
+    ASSERT(m.send_calls == 1);
+    ASSERT(m.sent_len == (5 + 16) + (5 + 8) + (5 + 16));
+    ASSERT(m.sent[0] == SCENIC_EVT_KEY);
+    ASSERT(m.sent[21] == SCENIC_EVT_CODEPOINT);
+    ASSERT(m.sent[34] == SCENIC_EVT_KEY);
+
+    scenic_renderer_stats_t stats;
+    scenic_renderer_get_stats(r, &stats);
+    ASSERT(stats.events_queued == 3);
+    ASSERT(stats.events_dropped == 0);
+    ASSERT(stats.bytes_sent == m.sent_len);
+
+    scenic_renderer_destroy(r);
+}
+
+TEST(events_partial_writes) {
+    mem_transport_t m = { .send_limit = 6 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer_cfg(&t, 60 * 1000 * 1000);
+    ASSERT(r);
+
+    scenic_renderer_send_cursor_pos(r, 1.0f, 2.0f);
+    scenic_renderer_send_cursor_enter(r, true);
+    size_t total = (5 + 8) + (5 + 1);
+
+    /* Each flush writes what the transport takes and keeps the rest */
+    int flushes = 0;
+    while (m.sent_len < total && flushes < 10) {
+        scenic_renderer_flush_events(r);
+        flushes++;
+    }
+    ASSERT(flushes == 4);
+    ASSERT(m.sent_len == total);
+    ASSERT(m.sent[0] == SCENIC_EVT_CURSOR_POS);
+    ASSERT(m.sent[13] == SCENIC_EVT_CURSOR_ENTER);
+    ASSERT(m.sent[18] == 1);
+
+    scenic_renderer_destroy(r);
+}
+
+static float get_f32(const uint8_t* p) {
+    uint32_t v = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                 ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+    float f;
+    memcpy(&f, &v, 4);
+    return f;
+}
+
+TEST(input_coalescing) {
+    mem_transport_t m = { 0 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer_cfg(&t, 60 * 1000 * 1000);
+    ASSERT(r);
+    scenic_renderer_set_input_coalescing(r, true);
+
+    scenic_renderer_send_cursor_pos(r, 1.0f, 1.0f);
+    scenic_renderer_send_cursor_pos(r, 2.0f, 2.0f);
+    scenic_renderer_send_scroll(r, 0.0f, 1.0f, 2.0f, 2.0f);
+    scenic_renderer_send_cursor_pos(r, 3.0f, 4.0f);
+    scenic_renderer_send_scroll(r, 0.5f, 2.0f, 3.0f, 4.0f);
+    scenic_renderer_send_mouse_button(r, 0, 1, 0, 3.0f, 4.0f);
+    scenic_renderer_send_cursor_pos(r, 5.0f, 6.0f);
+    scenic_renderer_flush_events(r);
+
+    /* CURSOR_POS(3,4) SCROLL(0.5,3) MOUSE_BUTTON CURSOR_POS(5,6) */
+    ASSERT(m.sent_len == 13 + 21 + 25 + 13);
+    ASSERT(m.sent[0] == SCENIC_EVT_CURSOR_POS);
+    ASSERT(get_f32(m.sent + 5) == 3.0f);
+    ASSERT(get_f32(m.sent + 9) == 4.0f);
+    ASSERT(m.sent[13] == SCENIC_EVT_SCROLL);
+    ASSERT(get_f32(m.sent + 18) == 0.5f);
+    ASSERT(get_f32(m.sent + 22) == 3.0f);
+    ASSERT(m.sent[34] == SCENIC_EVT_MOUSE_BUTTON);
+    ASSERT(m.sent[59] == SCENIC_EVT_CURSOR_POS);
+    ASSERT(get_f32(m.sent + 64) == 5.0f);
+
+    scenic_renderer_stats_t stats;
+    scenic_renderer_get_stats(r, &stats);
+    ASSERT(stats.events_coalesced == 3);
+    ASSERT(stats.events_queued == 4);
+
+    scenic_renderer_destroy(r);
+}
+
+TEST(ready_sent_on_connect) {
+    mem_transport_t m = { 0 };
+    scenic_transport_t t = { &mem_ops, &m, false };
+    scenic_renderer_t* r = make_renderer_cfg(&t, 0);
+    ASSERT(r);
+
+    /* Nothing goes out while no driver is attached */
+    scenic_renderer_send_key(r, 1, 0, 1, 0);
+    ASSERT(scenic_renderer_process_commands(r, 0) == 0);
+    ASSERT(m.sent_len == 0);
+
+    /* The stale key is dropped; the driver is greeted instead */
+    t.connected = true;
+    ASSERT(scenic_renderer_process_commands(r, 0) == 0);
+    ASSERT(m.sent_len == 13 + 13);
+    ASSERT(m.sent[0] == SCENIC_EVT_READY);
+    ASSERT(m.sent[13] == SCENIC_EVT_RESHAPE);
+
+    /* Only the rising edge triggers it */
+    ASSERT(scenic_renderer_process_commands(r, 0) == 0);
+    ASSERT(m.sent_len == 13 + 13);
+
+    scenic_renderer_destroy(r);
+}
+
+static uint64_t get_u64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+TEST(scene_kept_across_reconnect) {
+    uint8_t first[32];
+    size_t first_len = append_put_script(first, "_root_", 8);
+    uint8_t second[16];
+    size_t second_len = append_frame(second, SCENIC_CMD_RENDER, NULL, 0);
+
+    /* The first driver dies half way through a frame */
+    mem_transport_t m = { .p_data = first, .len = first_len - 4, .chunk = 64 };
+    scenic_transport_t t = { &mem_ops, &m, false };
+    scenic_renderer_t* r = make_renderer(&t);
+    ASSERT(r);
+    uint64_t generation = scenic_renderer_get_generation(r);
+
+    t.connected = true;
+    ASSERT(scenic_renderer_process_commands(r, 0) == 0);
+    ASSERT(m.sent[0] == SCENIC_EVT_READY);
+    ASSERT(get_u64(m.sent + 5) == generation);
+
+    /* Losing a server-side driver is not an error */
+    m.hangup = true;
+    ASSERT(scenic_renderer_process_commands(r, 0) == 0);
+    ASSERT(t.connected == false);
+
+    /* The next driver starts on a clean frame boundary, same generation */
+    m.p_data = second;
+    m.len = second_len;
+    m.pos = 0;
+    m.sent_len = 0;
+    t.connected = true;
+    ASSERT(scenic_renderer_process_commands(r, 0) == 1);
+    ASSERT(m.sent[0] == SCENIC_EVT_READY);
+    ASSERT(get_u64(m.sent + 5) == generation);
+
+    /* RESET starts a new generation */
+    scenic_renderer_cmd_reset(r);
+    ASSERT(scenic_renderer_get_generation(r) != generation);
+
+    scenic_renderer_destroy(r);
+}
+
+TEST(asset_hash_missing) {
+    /* PUT_IMAGE_HASH for an image nobody has seen: id_len data_len w h fmt hash id */
+    uint8_t payload[20 + 32 + 4];
+    put_u32(payload, 4);
+    put_u32(payload + 4, 16);
+    put_u32(payload + 8, 2);
+    put_u32(payload + 12, 2);
+    put_u32(payload + 16, SCENIC_IMG_FMT_RGBA);
+    for (int i = 0; i < 32; i++) payload[20 + i] = (uint8_t)i;
+    memcpy(payload + 52, "logo", 4);
+
+    uint8_t buf[128];
+    size_t len = append_frame(buf, SCENIC_CMD_PUT_IMAGE_HASH, payload, sizeof(payload));
+
+    mem_transport_t m = { .p_data = buf, .len = len, .chunk = 64 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer(&t);
+    ASSERT(r);
+
+    ASSERT(drain(r, &m) == 1);
+    scenic_renderer_flush_events(r);
+    ASSERT(m.sent_len == 5 + 33);
+    ASSERT(m.sent[0] == SCENIC_EVT_ASSET_STATUS);
+    ASSERT(m.sent[5] == SCENIC_ASSET_MISSING);
+    ASSERT(memcmp(m.sent + 6, payload + 20, 32) == 0);
+
+    scenic_renderer_stats_t stats;
+    scenic_renderer_get_stats(r, &stats);
+    ASSERT(stats.assets_missing == 1);
+
+    scenic_renderer_destroy(r);
+}
+
+TEST(renders_coalesced) {
+    uint8_t buf[256];
+    size_t len = 0;
+    len += append_put_script(buf + len, "_root_", 16);
+    len += append_frame(buf + len, SCENIC_CMD_RENDER, NULL, 0);
+    len += append_frame(buf + len, SCENIC_CMD_RENDER, NULL, 0);
+    len += append_frame(buf + len, SCENIC_CMD_RENDER, NULL, 0);
+
+    mem_transport_t m = { .p_data = buf, .len = len, .chunk = 256 };
+    scenic_transport_t t = { &mem_ops, &m, true };
+    scenic_renderer_t* r = make_renderer(&t);
+    ASSERT(r);
+
+    /* A new renderer owes its first frame; RENDERs fold into it */
+    ASSERT(scenic_renderer_needs_render(r));
+    ASSERT(drain(r, &m) == 4);
+    ASSERT(scenic_renderer_needs_render(r));
+    scenic_renderer_stats_t stats;
+    scenic_renderer_get_stats(r, &stats);
+    ASSERT(stats.renders_coalesced == 3);
+
+    scenic_renderer_destroy(r);
+}
+
+
+int main(void) {
+    printf("Running renderer tests...\n");
+
+    RUN_TEST(small_commands);
+    RUN_TEST(oversized_script_streams);
+    RUN_TEST(malformed_scripts_rejected);
+    RUN_TEST(oversized_unknown_command_dropped);
+    RUN_TEST(drain_with_budget);
+    RUN_TEST(events_batched_per_flush);
+    RUN_TEST(events_partial_writes);
+    RUN_TEST(input_coalescing);
+    RUN_TEST(ready_sent_on_connect);
+    RUN_TEST(scene_kept_across_reconnect);
+    RUN_TEST(asset_hash_missing);
+    RUN_TEST(renders_coalesced);
+
+    printf("\nAll tests passed! (%d/%d)\n", tests_passed, tests_run);
+    return 0;
+}
@@ -0,0 +1,663 @@
+/*
+ * Script store and draw list tests
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "comms.h"
+#include "script.h"
+#include "intern.h"
+#include "image.h"
+#include "nanovg/nanovg.h"
+#include "stub_nvg.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    static void test_##name(void)
+
+#define RUN_TEST(name) do { \
+    printf("  Running %s...", #name); \
+    tests_run++; \
+    reset_scripts(); \
+    test_##name(); \
+    tests_passed++; \
+    printf(" OK\n"); \
+} while(0)
+
+#define ASSERT(cond) do { \
+    if (!(cond)) { \
+        printf(" FAILED at line %d: %s\n", __LINE__, #cond); \
+        exit(1); \
+    } \
+} while(0)
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+/* PUT_SCRIPT id whose body is a begin_path then a 0x0F op per child */
+static void put(const char* id, const char* const* children, int count) {
+    uint8_t buf[1024];
+    uint32_t id_len = (uint32_t)strlen(id);
+    put_u32(buf, id_len);
+    memcpy(buf + 4, id, id_len);
+    uint32_t n = 4 + id_len;
+
+    put_u32(buf + n, 0x00200000);
+    n += 4;
+    for (int i = 0; i < count; i++) {
+        uint32_t len = (uint32_t)strlen(children[i]);
+        put_u32(buf + n, 0x000F0000 | len);
+        memset(buf + n + 4, 0, (len + 3) & ~3u);
+        memcpy(buf + n + 4, children[i], len);
+        n += 4 + ((len + 3) & ~3u);
+    }
+
+    int remaining = (int)n;
+    comms_set_buffer(buf, remaining);
+    put_script(&remaining);
+}
+
+static void del(const char* id) {
+    uint8_t buf[64];
+    uint32_t id_len = (uint32_t)strlen(id);
+    put_u32(buf, id_len);
+    memcpy(buf + 4, id, id_len);
+
+    int remaining = (int)(4 + id_len);
+    comms_set_buffer(buf, remaining);
+    delete_script(&remaining);
+}
+
+/* Wire script under construction */
+typedef struct {
+    uint8_t b[4096];
+    uint32_t n;
+} body_t;
+
+static void op(body_t* p, uint16_t code, uint16_t param) {
+    put_u32(p->b + p->n, ((uint32_t)code << 16) | param);
+    p->n += 4;
+}
+
+static void fl(body_t* p, float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    put_u32(p->b + p->n, u);
+    p->n += 4;
+}
+
+static void ref(body_t* p, uint16_t code, const char* id) {
+    uint32_t len = (uint32_t)strlen(id);
+    op(p, code, len);
+    memset(p->b + p->n, 0, (len + 3) & ~3u);
+    memcpy(p->b + p->n, id, len);
+    p->n += (len + 3) & ~3u;
+}
+
+static void put_body(const char* id, const body_t* p_body) {
+    uint8_t buf[4200];
+    uint32_t id_len = (uint32_t)strlen(id);
+    put_u32(buf, id_len);
+    memcpy(buf + 4, id, id_len);
+    memcpy(buf + 4 + id_len, p_body->b, p_body->n);
+
+    int remaining = (int)(4 + id_len + p_body->n);
+    comms_set_buffer(buf, remaining);
+    put_script(&remaining);
+}
+
+/* NanoVG back end that only counts draw calls and sums their vertices */
+static int fills;
+static double vert_sum;
+static int triangle_calls;
+static int triangle_verts;
+static double uv_sum;
+
+static void sum_paths(const NVGpath* paths, int npaths) {
+    for (int i = 0; i < npaths; i++) {
+        for (int v = 0; v < paths[i].nfill; v++) {
+            vert_sum += paths[i].fill[v].x + 3 * paths[i].fill[v].y + paths[i].fill[v].u;
+        }
+        for (int v = 0; v < paths[i].nstroke; v++) {
+            vert_sum += paths[i].stroke[v].x + 3 * paths[i].stroke[v].y + paths[i].stroke[v].v;
+        }
+    }
+}
+
+static void count_fill(const NVGpaint* paint, const NVGscissor* scissor,
+                       const NVGpath* paths, int npaths) {
+    sum_paths(paths, npaths);
+    fills++;
+}
+
+static void count_triangles(const NVGvertex* verts, int nverts) {
+    for (int v = 0; v < nverts; v++) uv_sum += verts[v].u + verts[v].v;
+    triangle_calls++;
+    triangle_verts += nverts;
+}
+
+static NVGcontext* stub_nvg(void) {
+    stub_nvg_hooks_t hooks = {
+        .fill = count_fill,
+        .stroke = sum_paths,
+        .triangles = count_triangles,
+    };
+    return stub_nvg_create(&hooks);
+}
+
+static render_counts_t render_frame(NVGcontext* p_ctx) {
+    render_counts_t counts;
+    fills = 0;
+    vert_sum = 0;
+    triangle_calls = 0;
+    triangle_verts = 0;
+    uv_sum = 0;
+    nvgBeginFrame(p_ctx, 800, 600, 1.0f);
+    render_root(p_ctx, 800, 600, NULL, &counts);
+    nvgEndFrame(p_ctx);
+    return counts;
+}
+
+/* A 100x40 filled rect */
+static void put_row(void) {
+    body_t row = {0};
+    op(&row, 0x04, 1);
+    fl(&row, 100);
+    fl(&row, 40);
+    put_body("row", &row);
+}
+
+/* One entry per script occurrence plus one per 0x0F it resumes after */
+TEST(links_tree) {
+    static const char* const root[] = { "a" };
+    static const char* const a[] = { "b", "b" };
+    put("_root_", root, 1);
+    put("a", a, 2);
+    put("b", NULL, 0);
+
+    ASSERT(link_draw_list() == 7);
+}
+
+TEST(missing_child_links_later) {
+    static const char* const root[] = { "a" };
+    put("_root_", root, 1);
+    ASSERT(link_draw_list() == 2);
+
+    put("a", NULL, 0);
+    ASSERT(link_draw_list() == 3);
+}
+
+TEST(cycle_skipped) {
+    static const char* const root[] = { "a" };
+    static const char* const a[] = { "b" };
+    static const char* const b[] = { "a", "_root_" };
+    put("_root_", root, 1);
+    put("a", a, 1);
+    put("b", b, 2);
+
+    /* root, a, b, b resume x2, a resume, root resume */
+    ASSERT(link_draw_list() == 7);
+}
+
+TEST(depth_limited) {
+    char name[16];
+    char child[16];
+    const char* const p_child[] = { child };
+    for (int i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), i ? "s%d" : "_root_", i);
+        snprintf(child, sizeof(child), "s%d", i + 1);
+        put(name, p_child, 1);
+    }
+
+    uint32_t count = link_draw_list();
+    ASSERT(count > 0 && count < 200);
+}
+
+TEST(replace_and_delete_splice) {
+    static const char* const root[] = { "a", "a" };
+    static const char* const a[] = { "b" };
+    static const char* const b[] = { "c" };
+    put("_root_", root, 2);
+    put("a", a, 1);
+    put("b", NULL, 0);
+    put("c", NULL, 0);
+    ASSERT(link_draw_list() == 9);
+
+    /* b now pulls in c under both occurrences of a */
+    put("b", b, 1);
+    ASSERT(link_draw_list() == 13);
+
+    del("a");
+    ASSERT(link_draw_list() == 3);
+
+    /* A put of the missing id relinks it */
+    put("a", NULL, 0);
+    ASSERT(link_draw_list() == 5);
+
+    del("_root_");
+    ASSERT(link_draw_list() == 0);
+}
+
+TEST(culls_offscreen_children) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+
+    /* 100 rows, 50 apart, in an 800x600 window: rows 0-12 can show */
+    body_t root = {0};
+    for (int i = 0; i < 100; i++) {
+        op(&root, 0x40, 0);
+        op(&root, 0x53, 0);
+        fl(&root, 0);
+        fl(&root, i * 50.0f);
+        ref(&root, 0x0F, "row");
+        op(&root, 0x41, 0);
+    }
+    put_body("_root_", &root);
+    put_row();
+
+    render_counts_t counts = render_frame(p_ctx);
+    ASSERT(counts.scripts_drawn == 14);
+    ASSERT(counts.scripts_culled == 87);
+    ASSERT(fills == 13);
+
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(culls_against_scissor) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+
+    /* Clipped to the top 100px; the row is drawn at y=200 */
+    body_t root = {0};
+    op(&root, 0x40, 0);
+    op(&root, 0x44, 0);
+    fl(&root, 800);
+    fl(&root, 100);
+    op(&root, 0x53, 0);
+    fl(&root, 0);
+    fl(&root, 200);
+    ref(&root, 0x0F, "row");
+    op(&root, 0x41, 0);
+    /* Outside the push the scissor is gone again */
+    ref(&root, 0x0F, "row");
+    put_body("_root_", &root);
+    put_row();
+
+    render_counts_t counts = render_frame(p_ctx);
+    ASSERT(counts.scripts_culled == 1);
+    ASSERT(fills == 1);
+
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(culls_shapes_and_keeps_strokes) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+
+    /* Rect ends 2px left of the window: culled when filled, but a wide
+     * stroke reaches into view */
+    body_t root = {0};
+    op(&root, 0x53, 0);
+    fl(&root, -102);
+    fl(&root, 0);
+    op(&root, 0x04, 1);
+    fl(&root, 100);
+    fl(&root, 100);
+    op(&root, 0x70, 40);
+    op(&root, 0x04, 2);
+    fl(&root, 100);
+    fl(&root, 100);
+    put_body("_root_", &root);
+
+    render_counts_t counts = render_frame(p_ctx);
+    ASSERT(counts.ops_culled == 1);
+    ASSERT(counts.ops_drawn == 1);
+
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(culled_shape_skips_bare_fill) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+
+    /* A filled rect in view, then a path-only rect out of view filled by a
+     * separate op: that fill must not repaint the first rect's path */
+    body_t root = {0};
+    op(&root, 0x04, 1);
+    fl(&root, 100);
+    fl(&root, 100);
+    op(&root, 0x53, 0);
+    fl(&root, -300);
+    fl(&root, 0);
+    op(&root, 0x04, 0);
+    fl(&root, 100);
+    fl(&root, 100);
+    op(&root, 0x22, 0);
+    put_body("_root_", &root);
+
+    render_counts_t counts = render_frame(p_ctx);
+    ASSERT(counts.ops_culled == 1);
+    ASSERT(fills == 1);
+
+    /* A new path after the culled shape is filled as usual */
+    body_t next = {0};
+    op(&next, 0x53, 0);
+    fl(&next, -300);
+    fl(&next, 0);
+    op(&next, 0x04, 0);
+    fl(&next, 100);
+    fl(&next, 100);
+    op(&next, 0x53, 0);
+    fl(&next, 300);
+    fl(&next, 0);
+    op(&next, 0x26, 0);
+    fl(&next, 0);
+    fl(&next, 0);
+    op(&next, 0x27, 0);
+    fl(&next, 50);
+    fl(&next, 0);
+    op(&next, 0x27, 0);
+    fl(&next, 0);
+    fl(&next, 50);
+    op(&next, 0x22, 0);
+    put_body("_root_", &next);
+
+    render_frame(p_ctx);
+    ASSERT(fills == 1);
+
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(leaky_child_not_culled) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+
+    /* "tint" sets a fill color the root relies on, and is not wrapped
+     * in a push, so skipping it would change what the root draws */
+    body_t tint = {0};
+    op(&tint, 0x60, 0);
+    put_u32(tint.b + tint.n, 0xFF0000FF);
+    tint.n += 4;
+    op(&tint, 0x53, 0);
+    fl(&tint, 0);
+    fl(&tint, 0);
+    put_body("tint", &tint);
+
+    body_t root = {0};
+    ref(&root, 0x0F, "tint");
+    op(&root, 0x04, 1);
+    fl(&root, 10);
+    fl(&root, 10);
+    put_body("_root_", &root);
+
+    render_counts_t counts = render_frame(p_ctx);
+    ASSERT(counts.scripts_culled == 0);
+    ASSERT(counts.scripts_drawn == 2);
+    ASSERT(fills == 1);
+
+    nvgDeleteInternal(p_ctx);
+}
+
+/* "a" with n 10x10 rects, then a 0x0F to child if given */
+static void put_rects(int n, const char* child) {
+    body_t a = {0};
+    for (int i = 0; i < n; i++) {
+        op(&a, 0x04, 1);
+        fl(&a, 10);
+        fl(&a, 10);
+    }
+    if (child) ref(&a, 0x0F, child);
+    put_body("a", &a);
+}
+
+TEST(replace_in_place) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+
+    static const char* const root[] = { "a", "a" };
+    put("_root_", root, 2);
+    put("b", NULL, 0);
+    put_rects(4, NULL);
+    render_frame(p_ctx);
+    ASSERT(fills == 8);
+
+    /* Steady-state animation: no allocation, and the list follows */
+    script_store_stats_t before;
+    get_script_store_stats(&before);
+    for (int frame = 0; frame < 100; frame++) {
+        put_rects(frame % 4 + 1, NULL);
+        render_frame(p_ctx);
+        ASSERT(fills == 2 * (frame % 4 + 1));
+    }
+    put_rects(2, "b");
+    ASSERT(link_draw_list() == 9);
+
+    script_store_stats_t after;
+    get_script_store_stats(&after);
+    ASSERT(after.sys_allocs == before.sys_allocs);
+    ASSERT(after.replaced_in_place == before.replaced_in_place + 101);
+
+    /* Outgrowing the block moves the record */
+    put_rects(300, NULL);
+    get_script_store_stats(&after);
+    ASSERT(after.replaced_in_place == before.replaced_in_place + 101);
+    render_frame(p_ctx);
+    ASSERT(fills == 600);
+    ASSERT(link_draw_list() == 5);
+
+    nvgDeleteInternal(p_ctx);
+}
+
+TEST(interned_handles) {
+    reset_ids();
+    sid_t a = { "a", 1 };
+    sid_t b = { "b", 1 };
+    uint32_t h = intern_id(a);
+    ASSERT(h != ID_NONE);
+    ASSERT(intern_id(a) == h);
+    ASSERT(find_id(a) == h);
+    ASSERT(intern_id(b) != h);
+    ASSERT(id_name(h).size == 1 && memcmp(id_name(h).p_data, "a", 1) == 0);
+
+    id_table_t table = {0};
+    int obj;
+    ASSERT(id_table_set(&table, h, &obj));
+    ASSERT(id_table_get(&table, h) == &obj);
+    ASSERT(id_table_get(&table, ID_NONE) == NULL);
+
+    /* After a reset the same index comes back under a new generation */
+    reset_scripts();
+    reset_ids();
+    ASSERT(find_id(a) == ID_NONE);
+    ASSERT(id_name(h).size == 0);
+    uint32_t h2 = intern_id(b);
+    ASSERT(id_index(h2) == id_index(h) && h2 != h);
+    ASSERT(id_table_get(&table, h2) == NULL);
+    free(table.p_slots);
+
+    /* Scripts link by handle across the reset */
+    static const char* const root[] = { "a" };
+    put("_root_", root, 1);
+    put("a", NULL, 0);
+    ASSERT(link_draw_list() == 3);
+}
+
+TEST(deleted_ids_released) {
+    reset_ids();
+    uint32_t indices = id_indices();
+
+    /* Churn through far more ids than are ever live at once */
+    char id[16];
+    char child[16];
+    for (int i = 0; i < 100000; i++) {
+        snprintf(id, sizeof(id), "s%d", i);
+        snprintf(child, sizeof(child), "c%d", i);
+        const char* const children[] = { child };
+        put(id, children, 1);
+        del(id);
+    }
+    ASSERT(interned_ids() == 0);
+    ASSERT(id_indices() <= (indices > 2 ? indices : 2));
+
+    /* A freed index comes back under a new generation */
+    put("x", NULL, 0);
+    uint32_t h = find_id((sid_t){ "x", 1 });
+    del("x");
+    ASSERT(find_id((sid_t){ "x", 1 }) == ID_NONE && id_name(h).size == 0);
+    put("y", NULL, 0);
+    uint32_t h2 = find_id((sid_t){ "y", 1 });
+    ASSERT(id_index(h2) == id_index(h) && h2 != h);
+    del("y");
+
+    /* A referenced id keeps its handle while the script it names comes
+     * and goes */
+    static const char* const root[] = { "a" };
+    put("_root_", root, 1);
+    put("a", NULL, 0);
+    ASSERT(link_draw_list() == 3);
+    del("a");
+    put("a", NULL, 0);
+    ASSERT(link_draw_list() == 3);
+    del("a");
+    del("_root_");
+    ASSERT(interned_ids() == 0);
+}
+
+/* Root: a filled and stroked 50x50 rect, an optional shift, then "row" */
+static void put_framed_root(float shift) {
+    body_t root = {0};
+    op(&root, 0x04, 3);
+    fl(&root, 50);
+    fl(&root, 50);
+    if (shift != 0) {
+        op(&root, 0x53, 0);
+        fl(&root, shift);
+        fl(&root, shift);
+    }
+    ref(&root, 0x0F, "row");
+    put_body("_root_", &root);
+}
+
+TEST(tessellation_reused) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+
+    put_framed_root(0);
+    put_row();
+    render_counts_t counts = render_frame(p_ctx);
+    ASSERT(counts.shapes_reused == 0);
+    double first_sum = vert_sum;
+
+    /* A static scene replays all three, vertex for vertex */
+    counts = render_frame(p_ctx);
+    ASSERT(counts.shapes_reused == 3);
+    ASSERT(fills == 2);
+    ASSERT(vert_sum == first_sum);
+
+    /* Replacing a script drops its geometry, even with the same bytes */
+    put_row();
+    counts = render_frame(p_ctx);
+    ASSERT(counts.shapes_reused == 2);
+    ASSERT(vert_sum == first_sum);
+
+    /* A moved child is tessellated again where it now is */
+    put_framed_root(5);
+    counts = render_frame(p_ctx);
+    ASSERT(counts.shapes_reused == 0);
+    double moved_sum = vert_sum;
+    ASSERT(moved_sum != first_sum);
+    counts = render_frame(p_ctx);
+    ASSERT(counts.shapes_reused == 3);
+    ASSERT(vert_sum == moved_sum);
+
+    nvgDeleteInternal(p_ctx);
+}
+
+/* PUT_IMAGE of a w x h RGBA image */
+static void put_rgba_image(const char* id, uint32_t w, uint32_t h, NVGcontext* p_ctx) {
+    static uint8_t buf[20 + 16 + 64 * 64 * 4];
+    uint32_t id_len = (uint32_t)strlen(id);
+    uint32_t pixels = w * h * 4;
+    put_u32(buf, id_len);
+    put_u32(buf + 4, pixels);
+    put_u32(buf + 8, w);
+    put_u32(buf + 12, h);
+    put_u32(buf + 16, 4);
+    memcpy(buf + 20, id, id_len);
+    memset(buf + 20 + id_len, 0xff, pixels);
+
+    int remaining = (int)(20 + id_len + pixels);
+    comms_set_buffer(buf, remaining);
+    put_image(&remaining, p_ctx);
+}
+
+TEST(sprites_batched) {
+    NVGcontext* p_ctx = stub_nvg();
+    ASSERT(p_ctx);
+    put_rgba_image("tiles", 64, 64, p_ctx);
+
+    /* 100 tiles of 10x10 in a row, the last 20 past the 800px window */
+    body_t root = {0};
+    op(&root, 0x0B, 5);
+    put_u32(root.b + root.n, 100);
+    root.n += 4;
+    memcpy(root.b + root.n, "tiles\0\0\0", 8);
+    root.n += 8;
+    for (int i = 0; i < 100; i++) {
+        fl(&root, 0);
+        fl(&root, 0);
+        fl(&root, 256);
+        fl(&root, 512);
+        fl(&root, i * 10 + 5);
+        fl(&root, 0);
+        fl(&root, 10);
+        fl(&root, 10);
+    }
+    put_body("_root_", &root);
+
+    render_counts_t counts = render_frame(p_ctx);
+    ASSERT(counts.ops_drawn == 80);
+    ASSERT(counts.ops_culled == 20);
+    ASSERT(fills == 0);
+    ASSERT(triangle_calls == 1);
+    ASSERT(triangle_verts == 80 * 6);
+    /* Half the stub's 512x512 texture: corners at u 0..0.5, v 0..1, and
+     * two triangles share the 0,0 and 0.5,1 corners */
+    ASSERT(uv_sum == 80 * (0.5 + 1.0 + 2 * 1.5));
+
+    reset_images(p_ctx);
+    nvgDeleteInternal(p_ctx);
+}
+
+int main(void) {
+    printf("Running script tests...\n");
+    init_scripts();
+
+    RUN_TEST(links_tree);
+    RUN_TEST(missing_child_links_later);
+    RUN_TEST(cycle_skipped);
+    RUN_TEST(depth_limited);
+    RUN_TEST(replace_and_delete_splice);
+    RUN_TEST(culls_offscreen_children);
+    RUN_TEST(culls_against_scissor);
+    RUN_TEST(culls_shapes_and_keeps_strokes);
+    RUN_TEST(culled_shape_skips_bare_fill);
+    RUN_TEST(leaky_child_not_culled);
+    RUN_TEST(replace_in_place);
+    RUN_TEST(interned_handles);
+    RUN_TEST(deleted_ids_released);
+    RUN_TEST(tessellation_reused);
+    RUN_TEST(sprites_batched);
+
+    printf("\nAll tests passed! (%d/%d)\n", tests_passed, tests_run);
+    return 0;
+}
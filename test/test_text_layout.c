@@ -0,0 +1,160 @@
+/*
+ * Text layout cache tests
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "text_layout.h"
+#include "nanovg/nanovg.h"
+#include "stub_nvg.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    static void test_##name(void)
+
+#define RUN_TEST(name) do { \
+    printf("  Running %s...", #name); \
+    tests_run++; \
+    reset_text_layouts(); \
+    test_##name(); \
+    tests_passed++; \
+    printf(" OK\n"); \
+} while(0)
+
+#define ASSERT(cond) do { \
+    if (!(cond)) { \
+        printf(" FAILED at line %d: %s\n", __LINE__, #cond); \
+        exit(1); \
+    } \
+} while(0)
+
+static NVGcontext* p_ctx;
+static text_style_t style;
+
+static void set_style(float size) {
+    nvgFontSize(p_ctx, size);
+    style.font = 0;
+    style.size = size;
+    style.scale = nvgTextScale(p_ctx);
+}
+
+/* The cached rows must be the rows NanoVG itself breaks the text into */
+static void check_rows(const char* text) {
+    uint32_t size = (uint32_t)strlen(text);
+    bool reused;
+    const text_layout_t* p_layout = text_layout(p_ctx, text, size, &style, &reused);
+    ASSERT(p_layout);
+
+    NVGtextRow rows[64];
+    int nrows = nvgTextBreakLines(p_ctx, text, text + size, TEXT_WRAP_WIDTH, rows, 64);
+    ASSERT(p_layout->row_count == (uint32_t)nrows);
+    for (int i = 0; i < nrows; i++) {
+        ASSERT(p_layout->p_rows[i].start == (uint32_t)(rows[i].start - text));
+        ASSERT(p_layout->p_rows[i].end == (uint32_t)(rows[i].end - text));
+    }
+
+    float lineh = 0;
+    nvgTextMetrics(p_ctx, NULL, NULL, &lineh);
+    ASSERT(p_layout->line_height == lineh);
+}
+
+TEST(rows_match_break_lines) {
+    set_style(16);
+    check_rows("");
+    check_rows("label");
+    check_rows("one\ntwo\nthree");
+    check_rows("trailing\n");
+    check_rows("\n\nblank lines\n\n");
+    check_rows("  indented\n\tand tabbed  \n   \n");
+    check_rows("crlf\r\nline\rbreaks\r\n");
+    check_rows("nbsp\xc2\xa0" "and\xc2\x85nel");
+
+    /* Long lines wrap at words, and a long word anywhere */
+    char text[1200];
+    memset(text, 0, sizeof(text));
+    for (int i = 0; i < 150; i++) strcat(text, "word ");
+    check_rows(text);
+    memset(text, 'x', 400);
+    text[400] = '\0';
+    strcat(text, "\nshort");
+    check_rows(text);
+
+    /* More rows than NanoVG is asked for at once */
+    text[0] = '\0';
+    for (int i = 0; i < 40; i++) strcat(text, i % 2 ? "row\r\n" : "row\n\r");
+    check_rows(text);
+}
+
+TEST(reused_by_bytes_and_style) {
+    set_style(16);
+    char a[] = "same label";
+    char b[] = "same label";
+    bool reused;
+    const text_layout_t* p_first = text_layout(p_ctx, a, sizeof(a) - 1, &style, &reused);
+    ASSERT(p_first && !reused);
+
+    /* The same bytes anywhere share the layout */
+    const text_layout_t* p_layout = text_layout(p_ctx, b, sizeof(b) - 1, &style, &reused);
+    ASSERT(reused && p_layout == p_first);
+
+    /* A different size lays out again */
+    set_style(32);
+    p_layout = text_layout(p_ctx, a, sizeof(a) - 1, &style, &reused);
+    ASSERT(p_layout && !reused && p_layout != p_first);
+    ASSERT(p_layout->line_height > p_first->line_height);
+
+    /* As do different bytes */
+    set_style(16);
+    p_layout = text_layout(p_ctx, a, 4, &style, &reused);
+    ASSERT(p_layout && !reused);
+}
+
+TEST(evicts_stale_layouts) {
+    set_style(16);
+    char text[16];
+    bool reused;
+
+    /* Fill the cache in one frame */
+    text_layout_frame();
+    ASSERT(text_layout(p_ctx, "kept", 4, &style, &reused));
+    for (int i = 1; i < 4096; i++) {
+        int n = snprintf(text, sizeof(text), "%d", i);
+        ASSERT(text_layout(p_ctx, text, n, &style, &reused));
+    }
+
+    /* The next frame draws one of them and then something new */
+    text_layout_frame();
+    ASSERT(text_layout(p_ctx, "kept", 4, &style, &reused) && reused);
+    ASSERT(text_layout(p_ctx, "new", 3, &style, &reused) && !reused);
+
+    /* Only what it drew survived */
+    ASSERT(text_layout(p_ctx, "kept", 4, &style, &reused) && reused);
+    ASSERT(text_layout(p_ctx, "new", 3, &style, &reused) && reused);
+    ASSERT(text_layout(p_ctx, "1", 1, &style, &reused) && !reused);
+}
+
+int main(void) {
+    printf("Running text layout tests...\n");
+
+    p_ctx = stub_nvg_create(NULL);
+    ASSERT(p_ctx);
+    ASSERT(nvgCreateFont(p_ctx, "test", TEST_FONT) == 0);
+    nvgBeginFrame(p_ctx, 800, 600, 1.0f);
+    nvgFontFaceId(p_ctx, 0);
+
+    RUN_TEST(rows_match_break_lines);
+    RUN_TEST(reused_by_bytes_and_style);
+    RUN_TEST(evicts_stale_layouts);
+
+    nvgCancelFrame(p_ctx);
+    reset_text_layouts();
+    nvgDeleteInternal(p_ctx);
+
+    printf("\nAll tests passed! (%d/%d)\n", tests_passed, tests_run);
+    return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * Transport tests
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "scenic_transport.h"
+#include "transport/shm_link.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    static void test_##name(void)
+
+#define RUN_TEST(name) do { \
+    printf("  Running %s...", #name); \
+    tests_run++; \
+    test_##name(); \
+    tests_passed++; \
+    printf(" OK\n"); \
+} while(0)
+
+#define ASSERT(cond) do { \
+    if (!(cond)) { \
+        printf(" FAILED at line %d: %s\n", __LINE__, #cond); \
+        exit(1); \
+    } \
+} while(0)
+
+static void temp_socket_path(char* path, size_t len, const char* tag) {
+    snprintf(path, len, "/tmp/scenic_test_%s_%d.sock", tag, (int)getpid());
+    unlink(path);
+}
+
+/* Plain listening socket standing in for the driver */
+static int listen_unix(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT(fd >= 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    ASSERT(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    ASSERT(listen(fd, 1) == 0);
+    return fd;
+}
+
+TEST(unix_client_recv_and_eof) {
+    char path[108];
+    temp_socket_path(path, sizeof(path), "client");
+    int listen_fd = listen_unix(path);
+
+    scenic_transport_t* t = scenic_transport_unix_socket_create();
+    ASSERT(t);
+    ASSERT(scenic_transport_connect(t, path) == 0);
+    int peer = accept(listen_fd, NULL, NULL);
+    ASSERT(peer >= 0);
+
+    /* Nothing pending: a zero timeout returns at once, recv reports 0 */
+    char buf[64];
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 0);
+    ASSERT(scenic_transport_data_available(t, 0) == false);
+
+    ASSERT(write(peer, "hello", 5) == 5);
+    ASSERT(scenic_transport_data_available(t, 1000) == true);
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 5);
+    ASSERT(memcmp(buf, "hello", 5) == 0);
+
+    ASSERT(scenic_transport_send(t, "ok", 2) == 2);
+    ASSERT(read(peer, buf, sizeof(buf)) == 2);
+
+    /* Peer hangup surfaces as readable, then as an error from recv */
+    close(peer);
+    ASSERT(scenic_transport_data_available(t, 1000) == true);
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == -1);
+
+    scenic_transport_destroy(t);
+    close(listen_fd);
+    unlink(path);
+}
+
+TEST(wake_interrupts_wait) {
+    char path[108];
+    temp_socket_path(path, sizeof(path), "wake");
+    int listen_fd = listen_unix(path);
+
+    scenic_transport_t* t = scenic_transport_unix_socket_create();
+    ASSERT(t);
+    ASSERT(scenic_transport_connect(t, path) == 0);
+    int peer = accept(listen_fd, NULL, NULL);
+    ASSERT(peer >= 0);
+
+    char buf[8];
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 0);
+
+    /* A pending wakeup ends the wait early without reporting data */
+    scenic_transport_wake(t);
+    ASSERT(scenic_transport_data_available(t, 5000) == false);
+
+    close(peer);
+    scenic_transport_destroy(t);
+    close(listen_fd);
+    unlink(path);
+}
+
+/* Plain client socket standing in for the driver */
+static int connect_unix(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT(fd >= 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    ASSERT(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+TEST(unix_server_accepts_without_blocking) {
+    char path[108];
+    temp_socket_path(path, sizeof(path), "server");
+
+    scenic_transport_t* t = scenic_transport_unix_server_create();
+    ASSERT(t);
+    ASSERT(scenic_transport_connect(t, path) == 0);
+    ASSERT(t->connected == false);
+
+    /* No driver yet: polling returns at once */
+    char buf[64];
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 0);
+    ASSERT(scenic_transport_data_available(t, 0) == false);
+    ASSERT(t->connected == false);
+
+    int driver = connect_unix(path);
+    ASSERT(write(driver, "hi", 2) == 2);
+    ASSERT(scenic_transport_data_available(t, 1000) == true);
+    ASSERT(t->connected == true);
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 2);
+    ASSERT(memcmp(buf, "hi", 2) == 0);
+
+    /* A second driver waits in the backlog while the first is attached */
+    int next = connect_unix(path);
+    ASSERT(write(next, "again", 5) == 5);
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 0);
+
+    /* Hangup drops back to listening and the next driver is picked up */
+    close(driver);
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 1000) == -1);
+    ASSERT(t->connected == false);
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 1000) == 5);
+    ASSERT(t->connected == true);
+    ASSERT(memcmp(buf, "again", 5) == 0);
+
+    close(next);
+    scenic_transport_destroy(t);
+    ASSERT(access(path, F_OK) != 0);
+}
+
+TEST(unix_server_keeps_regular_files) {
+    char path[108];
+    temp_socket_path(path, sizeof(path), "notsock");
+
+    /* A stale socket from an earlier run is replaced */
+    close(listen_unix(path));
+    scenic_transport_t* t = scenic_transport_unix_server_create();
+    ASSERT(t);
+    ASSERT(scenic_transport_connect(t, path) == 0);
+    scenic_transport_destroy(t);
+
+    /* A mistyped path naming some other file is left alone */
+    FILE* f = fopen(path, "w");
+    ASSERT(f);
+    fputs("keep", f);
+    fclose(f);
+    t = scenic_transport_unix_server_create();
+    ASSERT(t);
+    ASSERT(scenic_transport_connect(t, path) < 0);
+    scenic_transport_destroy(t);
+    ASSERT(access(path, F_OK) == 0);
+    unlink(path);
+}
+
+TEST(unix_server_waits_for_client) {
+    char path[108];
+    temp_socket_path(path, sizeof(path), "waitcl");
+
+    scenic_transport_t* t = scenic_transport_unix_server_create();
+    ASSERT(t);
+    ASSERT(scenic_transport_connect(t, path) == 0);
+
+    /* A wakeup ends the wait with no client */
+    scenic_transport_wake(t);
+    ASSERT(scenic_transport_wait_client(t, 5000) == false);
+    ASSERT(scenic_transport_wait_client(t, 0) == false);
+
+    /* A pending client is reported but left for the owner to accept */
+    int driver = connect_unix(path);
+    ASSERT(write(driver, "hi", 2) == 2);
+    ASSERT(scenic_transport_wait_client(t, 5000) == true);
+    ASSERT(t->connected == false);
+    ASSERT(scenic_transport_data_available(t, 1000) == true);
+    ASSERT(t->connected == true);
+
+    char buf[8];
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 2);
+
+    close(driver);
+    scenic_transport_destroy(t);
+}
+
+/* Connect a shm transport and map the driver end of its rings */
+static scenic_transport_t* connect_shm(const char* path, int listen_fd, shm_link_t* p_driver) {
+    scenic_transport_t* t = scenic_transport_shm_create();
+    ASSERT(t);
+    ASSERT(scenic_transport_connect(t, path) == 0);
+    int peer = accept(listen_fd, NULL, NULL);
+    ASSERT(peer >= 0);
+    shm_link_init(p_driver);
+    ASSERT(shm_link_accept(p_driver, peer) == 0);
+    return t;
+}
+
+TEST(shm_bulk_roundtrip) {
+    char path[108];
+    temp_socket_path(path, sizeof(path), "shm");
+    int listen_fd = listen_unix(path);
+    shm_link_t driver;
+    scenic_transport_t* t = connect_shm(path, listen_fd, &driver);
+
+    char buf[64];
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 0);
+    ASSERT(scenic_transport_data_available(t, 0) == false);
+
+    /* Push more than a ring's worth, interleaving producer and consumer */
+    size_t total = (size_t)SHM_LINK_RING_SIZE * 2 + 12345;
+    uint8_t* p_src = malloc(total);
+    uint8_t* p_dst = malloc(total);
+    ASSERT(p_src && p_dst);
+    for (size_t i = 0; i < total; i++) p_src[i] = (uint8_t)(i * 31 + (i >> 13));
+
+    size_t sent = 0, got = 0;
+    while (got < total) {
+        sent += shm_link_write(&driver, p_src + sent, total - sent);
+        int n = scenic_transport_recv(t, p_dst + got, 3 << 20, 0);
+        ASSERT(n >= 0);
+        got += (size_t)n;
+    }
+    ASSERT(sent == total);
+    ASSERT(memcmp(p_src, p_dst, total) == 0);
+    free(p_src);
+    free(p_dst);
+
+    /* Events flow the other way */
+    ASSERT(scenic_transport_send(t, "ok", 2) == 2);
+    ASSERT(shm_link_readable(&driver) == 2);
+    ASSERT(shm_link_read(&driver, buf, sizeof(buf)) == 2);
+    ASSERT(memcmp(buf, "ok", 2) == 0);
+
+    /* Driver hangup surfaces as an error once the ring is drained */
+    ASSERT(shm_link_write(&driver, "x", 1) == 1);
+    shm_link_close(&driver);
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 1);
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 1000) == -1);
+
+    scenic_transport_destroy(t);
+    close(listen_fd);
+    unlink(path);
+}
+
+TEST(shm_doorbell_wakes_sleeper) {
+    char path[108];
+    temp_socket_path(path, sizeof(path), "shmbell");
+    int listen_fd = listen_unix(path);
+    shm_link_t driver;
+    scenic_transport_t* t = connect_shm(path, listen_fd, &driver);
+
+    /* A separate process writes once the renderer is already asleep */
+    pid_t pid = fork();
+    ASSERT(pid >= 0);
+    if (pid == 0) {
+        usleep(50 * 1000);
+        _exit(shm_link_write(&driver, "ping", 4) == 4 ? 0 : 1);
+    }
+
+    ASSERT(scenic_transport_data_available(t, 5000) == true);
+    char buf[8];
+    ASSERT(scenic_transport_recv(t, buf, sizeof(buf), 0) == 4);
+    ASSERT(memcmp(buf, "ping", 4) == 0);
+
+    int status = 0;
+    ASSERT(waitpid(pid, &status, 0) == pid);
+    ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* wake() ends a wait without data */
+    scenic_transport_wake(t);
+    ASSERT(scenic_transport_data_available(t, 5000) == false);
+
+    shm_link_close(&driver);
+    scenic_transport_destroy(t);
+    close(listen_fd);
+    unlink(path);
+}
+
+int main(void) {
+    printf("Running transport tests...\n");
+
+    RUN_TEST(unix_client_recv_and_eof);
+    RUN_TEST(wake_interrupts_wait);
+    RUN_TEST(unix_server_accepts_without_blocking);
+    RUN_TEST(unix_server_keeps_regular_files);
+    RUN_TEST(unix_server_waits_for_client);
+#ifdef __linux__
+    RUN_TEST(shm_bulk_roundtrip);
+    RUN_TEST(shm_doorbell_wakes_sleeper);
+#endif
+
+    printf("\nAll tests passed! (%d/%d)\n", tests_passed, tests_run);
+    return 0;
+}